@@ -0,0 +1,371 @@
+#ifndef BATCH_GUARD
+#define BATCH_GUARD
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "session.h"
+
+// Файл только для чтения, отображённый в память.
+class MappedFile {
+private:
+    int fd = -1;
+    const char *data = nullptr;
+    std::size_t length = 0;
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    ~MappedFile() {
+        if (data && length > 0) munmap(const_cast<char *>(data), length);
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool open(const std::string &path, std::string &error) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) { error = "не удалось открыть файл '" + path + "'"; return false; }
+
+        struct stat st {};
+        if (fstat(fd, &st) != 0) { error = "не удалось получить размер файла '" + path + "'"; return false; }
+        length = static_cast<std::size_t>(st.st_size);
+        if (length == 0) return true;
+
+        void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) { error = "не удалось отобразить файл '" + path + "' в память"; return false; }
+        madvise(p, length, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(p);
+        return true;
+    }
+
+    std::string_view view() const { return std::string_view(data, length); }
+};
+
+// Один большой буфер поверх файлового дескриптора. После ошибки записи
+// остальной вывод отбрасывается, а flush() и ok() возвращают false.
+class BufferedWriter {
+private:
+    int fd;
+    std::string buf;
+    std::size_t limit;
+    int lastErrno = 0;
+
+public:
+    explicit BufferedWriter(int outFd = 1, std::size_t capacity = 1 << 20) : fd(outFd), limit(capacity) {
+        buf.reserve(capacity);
+    }
+    BufferedWriter(const BufferedWriter &) = delete;
+    BufferedWriter &operator=(const BufferedWriter &) = delete;
+    ~BufferedWriter() { flush(); }
+
+    void write(std::string_view s) {
+        if (buf.size() + s.size() > limit) flush();
+        if (s.size() >= limit) { writeAll(s.data(), s.size()); return; }
+        buf.append(s.data(), s.size());
+    }
+
+    bool flush() {
+        writeAll(buf.data(), buf.size());
+        buf.clear();
+        return ok();
+    }
+
+    bool ok() const { return lastErrno == 0; }
+    int errorNumber() const { return lastErrno; }
+
+private:
+    void writeAll(const char *p, std::size_t n) {
+        while (n > 0 && ok()) {
+            ssize_t w = ::write(fd, p, n);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) { lastErrno = w < 0 ? errno : EIO; return; }
+            p += w;
+            n -= static_cast<std::size_t>(w);
+        }
+    }
+};
+
+// std::ostream поверх дескриптора с одним большим буфером - для Session,
+// которая пишет в std::ostream, когда вывод идёт не в терминал.
+class FdStreamBuf : public std::streambuf {
+private:
+    int fd;
+    std::vector<char> buf;
+
+    bool drain() {
+        const char *p = pbase();
+        std::size_t n = static_cast<std::size_t>(pptr() - pbase());
+        bool ok = true;
+        while (n > 0) {
+            ssize_t w = ::write(fd, p, n);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) { ok = false; break; }
+            p += w;
+            n -= static_cast<std::size_t>(w);
+        }
+        setp(buf.data(), buf.data() + buf.size());
+        return ok;
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (!drain()) return traits_type::eof();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    int sync() override { return drain() ? 0 : -1; }
+
+public:
+    explicit FdStreamBuf(int outFd = 1, std::size_t capacity = 1 << 20) : fd(outFd), buf(capacity) {
+        setp(buf.data(), buf.data() + buf.size());
+    }
+    FdStreamBuf(const FdStreamBuf &) = delete;
+    FdStreamBuf &operator=(const FdStreamBuf &) = delete;
+    ~FdStreamBuf() override { drain(); }
+};
+
+// Строки из дескриптора, который читается большими блоками. Строка без '\n'
+// указывает в буфер и действительна до следующего next().
+class LineReader {
+private:
+    int fd;
+    std::vector<char> buf;
+    std::size_t begin = 0;
+    std::size_t end = 0;
+    bool eof = false;
+
+public:
+    explicit LineReader(int inFd = 0, std::size_t capacity = 1 << 20) : fd(inFd), buf(capacity) {}
+
+    bool next(std::string_view &line) {
+        while (true) {
+            const char *s = buf.data() + begin;
+            if (const void *nl = std::memchr(s, '\n', end - begin)) {
+                std::size_t len = static_cast<std::size_t>(static_cast<const char *>(nl) - s);
+                line = std::string_view(s, len);
+                begin += len + 1;
+                return true;
+            }
+            if (eof) {
+                if (begin == end) return false;
+                line = std::string_view(s, end - begin);
+                begin = end;
+                return true;
+            }
+            if (begin > 0) {
+                std::memmove(buf.data(), s, end - begin);
+                end -= begin;
+                begin = 0;
+            }
+            if (end == buf.size()) buf.resize(buf.size() * 2);
+            ssize_t r = ::read(fd, buf.data() + end, buf.size() - end);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) eof = true;
+            else end += static_cast<std::size_t>(r);
+        }
+    }
+};
+
+// Очередь задач одного рабочего: владелец берёт с головы, остальные крадут с хвоста.
+class StealingQueue {
+private:
+    std::deque<std::size_t> items;
+    std::mutex m;
+
+public:
+    void push(std::size_t v) {
+        std::lock_guard<std::mutex> lock(m);
+        items.push_back(v);
+    }
+
+    bool popFront(std::size_t &v) {
+        std::lock_guard<std::mutex> lock(m);
+        if (items.empty()) return false;
+        v = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    bool stealBack(std::size_t &v) {
+        std::lock_guard<std::mutex> lock(m);
+        if (items.empty()) return false;
+        v = items.back();
+        items.pop_back();
+        return true;
+    }
+};
+
+struct BatchStats {
+    std::size_t expressions = 0;
+    std::size_t lines = 0;
+    double seconds = 0.0;
+    unsigned threads = 1;
+};
+
+// Пакетный режим: файл режется на куски по границам строк, куски считаются
+// пулом потоков с кражей задач, результаты пишутся в порядке входа.
+class BatchRunner {
+private:
+    struct Chunk {
+        std::string_view text;
+        std::string output;
+        std::size_t expressions = 0;
+        std::size_t lines = 0;
+        bool quit = false;
+        bool ready = false;
+    };
+
+    NumberMode mode = NumberMode::Double;
+    std::size_t jitThreshold = 0;
+    ResultCache *cache = nullptr;
+    std::vector<Chunk> chunks;
+    std::vector<std::unique_ptr<StealingQueue>> queues;
+    std::atomic<std::size_t> quitAt{static_cast<std::size_t>(-1)};
+    std::mutex readyMutex;
+    std::condition_variable readyCv;
+
+    static std::vector<std::string_view> splitChunks(std::string_view text, std::size_t target) {
+        std::vector<std::string_view> out;
+        std::size_t pos = 0;
+        while (pos < text.size()) {
+            std::size_t end = std::min(text.size(), pos + target);
+            if (end < text.size()) {
+                std::size_t nl = text.find('\n', end);
+                end = (nl == std::string_view::npos) ? text.size() : nl + 1;
+            }
+            out.push_back(text.substr(pos, end - pos));
+            pos = end;
+        }
+        return out;
+    }
+
+    void processChunk(std::size_t index, Session &session) {
+        Chunk &c = chunks[index];
+        if (index <= quitAt.load(std::memory_order_relaxed)) {
+            std::ostringstream out;
+            std::size_t pos = 0;
+            while (pos < c.text.size()) {
+                std::size_t nl = c.text.find('\n', pos);
+                if (nl == std::string_view::npos) nl = c.text.size();
+                std::string line = trim(std::string(c.text.substr(pos, nl - pos)));
+                pos = nl + 1;
+
+                if (isQuitCommand(line)) {
+                    c.quit = true;
+                    std::size_t cur = quitAt.load();
+                    while (index < cur && !quitAt.compare_exchange_weak(cur, index)) {}
+                    break;
+                }
+                if (line.empty()) continue;
+                ++c.lines;
+                c.expressions += session.evalLine(line, out);
+            }
+            c.output = out.str();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(readyMutex);
+            c.ready = true;
+        }
+        readyCv.notify_all();
+    }
+
+    void worker(std::size_t self) {
+        Session session(mode, 4096, false);
+        session.setJitThreshold(jitThreshold);
+        session.setCache(cache);
+        std::size_t index = 0;
+        while (true) {
+            bool got = queues[self]->popFront(index);
+            for (std::size_t k = 1; !got && k < queues.size(); ++k) {
+                got = queues[(self + k) % queues.size()]->stealBack(index);
+            }
+            if (!got) return;
+            processChunk(index, session);
+        }
+    }
+
+public:
+    explicit BatchRunner(NumberMode numberMode = NumberMode::Double, std::size_t jitHits = 0)
+        : mode(numberMode), jitThreshold(jitHits) {}
+
+    void setCache(ResultCache *resultCache) { cache = resultCache; }
+
+    bool run(const std::string &path, unsigned threads, BufferedWriter &writer, BatchStats &stats, std::string &error) {
+        auto t0 = std::chrono::steady_clock::now();
+
+        MappedFile file;
+        if (!file.open(path, error)) return false;
+
+        if (threads == 0) threads = 1;
+        std::string_view text = file.view();
+        std::size_t target = std::max<std::size_t>(64 * 1024, text.size() / (threads * 16 + 1));
+
+        std::vector<std::string_view> parts = splitChunks(text, target);
+        chunks.assign(parts.size(), Chunk());
+        for (std::size_t i = 0; i < parts.size(); ++i) chunks[i].text = parts[i];
+
+        queues.clear();
+        for (unsigned t = 0; t < threads; ++t) queues.push_back(std::make_unique<StealingQueue>());
+        for (std::size_t i = 0; i < chunks.size(); ++i) queues[i % threads]->push(i);
+
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; ++t) pool.emplace_back(&BatchRunner::worker, this, static_cast<std::size_t>(t));
+
+        for (std::size_t i = 0; i < chunks.size(); ++i) {
+            {
+                std::unique_lock<std::mutex> lock(readyMutex);
+                readyCv.wait(lock, [&] { return chunks[i].ready; });
+            }
+            Chunk &c = chunks[i];
+            writer.write(c.output);
+            std::string().swap(c.output);
+            stats.expressions += c.expressions;
+            stats.lines += c.lines;
+            if (c.quit) break;
+            if (!writer.ok()) {
+                // Писать некуда: остальные куски рабочие пропускают, как после q.
+                std::size_t cur = quitAt.load();
+                while (i < cur && !quitAt.compare_exchange_weak(cur, i)) {}
+                break;
+            }
+        }
+        bool written = writer.flush();
+
+        for (std::thread &t : pool) t.join();
+        if (!written) {
+            error = std::string("не удалось записать результаты: ") + std::strerror(writer.errorNumber());
+            return false;
+        }
+
+        stats.threads = threads;
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,19 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Счётчик выделений памяти для бенчмарка. Замена operator new/delete живёт
+// в отдельной единице трансляции: видя её тело рядом с вызовами new,
+// компилятор считает free() парой не к тому выделению
+// (-Wmismatched-new-delete). new[] и delete[] по умолчанию идут сюда же.
+
+std::atomic<std::size_t> gAllocations{0};
+
+void *operator new(std::size_t n) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(n ? n : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
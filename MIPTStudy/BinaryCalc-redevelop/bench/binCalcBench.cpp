@@ -0,0 +1,352 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "columnar.h"
+#include "corpus.h"
+#include "streamEvaluator.h"
+
+// Микробенчмарк этапов: lex, toRpn, evalRpn, vm (байткод), toBinaryString,
+// а также путь без выделений памяти (toRpnScratch, evalRpnScratch, scratch -
+// разбор и вычисление вместе, stream - StreamEvaluator по строке). Для каждого набора и этапа: ns/выражение
+// (один таймер на проход), выделения памяти/выражение и перцентили по
+// отдельным замерам. Вывод - JSON. --check-allocs: код возврата 3, если
+// путь без выделений всё-таки выделял память. Отдельно - колоночный этап
+// (ColumnEvaluator против построчной VM); расхождение ответов - код 4.
+
+// Число вызовов operator new; считает allocCounter.cpp.
+extern std::atomic<std::size_t> gAllocations;
+
+using Clock = std::chrono::steady_clock;
+
+static volatile double gSink = 0.0;
+
+struct StageResult {
+    std::string name;
+    double nsPerExpr = 0.0;
+    double allocsPerExpr = 0.0;
+    double p50 = 0.0, p90 = 0.0, p99 = 0.0, max = 0.0;
+    bool allocFree = false;  // этап обязан обходиться без выделений памяти
+};
+
+struct Input {
+    std::string text;
+    std::vector<Token> rpn;
+    Program program;
+    EvalResult value;
+};
+
+static double percentile(std::vector<double> &v, double q) {
+    if (v.empty()) return 0.0;
+    std::size_t k = static_cast<std::size_t>(q * static_cast<double>(v.size() - 1));
+    std::nth_element(v.begin(), v.begin() + k, v.end());
+    return v[k];
+}
+
+// body(i) - один этап для выражения i. Прогрев, reps проходов целиком, затем
+// проход с таймером на каждое выражение для перцентилей.
+template <typename Body>
+static StageResult measure(const char *name, std::size_t count, std::size_t reps, Body body) {
+    StageResult r;
+    r.name = name;
+    for (std::size_t i = 0; i < count; ++i) body(i);
+
+    std::size_t allocs0 = gAllocations.load();
+    auto t0 = Clock::now();
+    for (std::size_t rep = 0; rep < reps; ++rep) {
+        for (std::size_t i = 0; i < count; ++i) body(i);
+    }
+    auto t1 = Clock::now();
+    std::size_t allocs = gAllocations.load() - allocs0;
+    double total = static_cast<double>(count * reps);
+    r.nsPerExpr = std::chrono::duration<double, std::nano>(t1 - t0).count() / total;
+    r.allocsPerExpr = static_cast<double>(allocs) / total;
+
+    std::vector<double> samples(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto s0 = Clock::now();
+        body(i);
+        samples[i] = std::chrono::duration<double, std::nano>(Clock::now() - s0).count();
+    }
+    r.p50 = percentile(samples, 0.50);
+    r.p90 = percentile(samples, 0.90);
+    r.p99 = percentile(samples, 0.99);
+    r.max = *std::max_element(samples.begin(), samples.end());
+    return r;
+}
+
+static std::vector<StageResult> runCorpus(const std::vector<std::string> &exprs, std::size_t reps) {
+    std::vector<Input> in(exprs.size());
+    for (std::size_t i = 0; i < exprs.size(); ++i) {
+        in[i].text = exprs[i];
+        ParseResult pr = InfixParser::toRpn(in[i].text);
+        in[i].rpn = std::move(pr.rpn);
+        in[i].program = BytecodeCompiler::fromRpn(in[i].rpn, in[i].text);
+        in[i].value = Evaluator::evalRpn(in[i].rpn);
+    }
+
+    std::size_t n = in.size();
+    std::vector<StageResult> out;
+    out.push_back(measure("lex", n, reps, [&](std::size_t i) {
+        Lexer lx(in[i].text);
+        std::size_t tokens = 0;
+        for (Token t = lx.nextToken(); t.type != TokenType::End; t = lx.nextToken()) ++tokens;
+        gSink = gSink + static_cast<double>(tokens);
+    }));
+    out.push_back(measure("toRpn", n, reps, [&](std::size_t i) {
+        ParseResult pr = InfixParser::toRpn(in[i].text);
+        gSink = gSink + static_cast<double>(pr.rpn.size());
+    }));
+    out.push_back(measure("evalRpn", n, reps, [&](std::size_t i) {
+        EvalResult r = Evaluator::evalRpn(in[i].rpn);
+        gSink = gSink + r.value.toDouble();
+    }));
+    std::vector<Token> rpn, ops;
+    std::vector<double> stack;
+    Status status;
+    out.push_back(measure("toRpnScratch", n, reps, [&](std::size_t i) {
+        InfixParser::toRpn(in[i].text, rpn, ops, status);
+        gSink = gSink + static_cast<double>(rpn.size());
+    }));
+    out.back().allocFree = true;
+    out.push_back(measure("evalRpnScratch", n, reps, [&](std::size_t i) {
+        double v = 0.0;
+        bool bitwise = false;
+        Evaluator::evalRpn(in[i].rpn, stack, v, bitwise, status);
+        gSink = gSink + v;
+    }));
+    out.back().allocFree = true;
+    ScratchEvaluator scratch;
+    out.push_back(measure("scratch", n, reps, [&](std::size_t i) {
+        double v = 0.0;
+        bool bitwise = false;
+        scratch.evaluate(in[i].text, v, bitwise, status);
+        gSink = gSink + v;
+    }));
+    out.back().allocFree = true;
+    StreamEvaluator streaming;
+    out.push_back(measure("stream", n, reps, [&](std::size_t i) {
+        StreamReader reader(in[i].text);
+        EvalResult r;
+        streaming.next(reader, r);
+        gSink = gSink + r.value.toDouble();
+    }));
+    BytecodeVm vm;
+    out.push_back(measure("vm", n, reps, [&](std::size_t i) {
+        EvalResult r = vm.run(in[i].program);
+        gSink = gSink + r.value.toDouble();
+    }));
+    out.push_back(measure("toBinaryString", n, reps, [&](std::size_t i) {
+        const EvalResult &r = in[i].value;
+        std::string s = r.value.toBinaryString(r.isBitwiseResult ? 0 : 12);
+        gSink = gSink + static_cast<double>(s.size());
+    }));
+    return out;
+}
+
+// Столбцы колоночного этапа: x - uint64_t, y - double (каждое 16-е - ноль,
+// чтобы в пакете были строки с ошибкой деления).
+static const char *const kColumnExprs[] = {
+    "x * 101 + y",
+    "(x & 11111111) << 11 | x >> 101",
+    "x / y - 1.01",
+    "-(x ^ 1010) * y + x",
+    "popcount(x) * y",
+};
+
+struct ColumnResult {
+    std::string expr;
+    double columnarNs = 0.0, vmNs = 0.0;  // на строку
+    std::size_t errorRows = 0, mismatches = 0;
+};
+
+class RowEnvironment : public Environment {
+public:
+    double x = 0.0, y = 0.0;
+
+    bool lookupDouble(std::string_view name, double &out, Fault &err) override {
+        if (name == "x") out = x;
+        else if (name == "y") out = y;
+        else { err = unknownVariable(name); return false; }
+        return true;
+    }
+    bool lookupExact(std::string_view name, Dyadic &, Fault &err) override {
+        err = unknownVariable(name);
+        return false;
+    }
+};
+
+// Каждое выражение - reps прогонов по rows строкам колоночно и построчно
+// через BytecodeVm; ответы и тексты ошибок сверяются по строкам.
+static std::vector<ColumnResult> runColumns(std::size_t rows, std::size_t reps, std::uint64_t seed,
+                                            std::string &err) {
+    std::mt19937_64 rng(seed);
+    std::vector<std::uint64_t> xs(rows);
+    std::vector<double> ys(rows);
+    for (std::size_t i = 0; i < rows; ++i) {
+        xs[i] = rng() % (1u << 20);
+        std::uint64_t r = rng();
+        ys[i] = r % 16 == 0 ? 0.0 : static_cast<double>(r % 4096) / 8.0;
+    }
+
+    ColumnEvaluator columns;
+    columns.bind("x", xs.data());
+    columns.bind("y", ys.data());
+    std::vector<double> out(rows);
+    std::vector<std::uint8_t> errors(rows);
+    BytecodeVm vm;
+    RowEnvironment env;
+
+    std::vector<ColumnResult> results;
+    for (const char *expr : kColumnExprs) {
+        ColumnResult r;
+        r.expr = expr;
+        ColumnProgram cp;
+        if (!ColumnProgram::compile(r.expr, cp, err)) return {};
+        Program p = BytecodeCompiler::compile(r.expr);
+
+        std::size_t failed = 0;
+        auto t0 = Clock::now();
+        for (std::size_t rep = 0; rep < reps; ++rep) {
+            if (!columns.run(cp, rows, out.data(), errors.data(), failed, err)) return {};
+        }
+        auto t1 = Clock::now();
+        r.errorRows = failed;
+
+        for (std::size_t rep = 0; rep < reps; ++rep) {
+            for (std::size_t i = 0; i < rows; ++i) {
+                env.x = static_cast<double>(xs[i]);
+                env.y = ys[i];
+                gSink = gSink + vm.run(p, &env).value.toDouble();
+            }
+        }
+        auto t2 = Clock::now();
+        double total = static_cast<double>(rows * reps);
+        r.columnarNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / total;
+        r.vmNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / total;
+
+        for (std::size_t i = 0; i < rows; ++i) {
+            env.x = static_cast<double>(xs[i]);
+            env.y = ys[i];
+            EvalResult v = vm.run(p, &env);
+            double want = v.value.toDouble();
+            bool same = v.ok ? errors[i] == 0 && (std::memcmp(&out[i], &want, sizeof(double)) == 0 ||
+                                                  (out[i] != out[i] && want != want))
+                             : errors[i] != 0 && errorText(static_cast<ErrorCode>(errors[i])) == v.error;
+            r.mismatches += !same;
+        }
+        results.push_back(r);
+    }
+    return results;
+}
+
+static void printUsage(const char *prog) {
+    std::cerr << "Использование: " << prog
+              << " [--count N] [--reps N] [--seed S] [--corpus имя] [--out файл.json] [--dump файл] [--check-allocs]\n"
+              << "Наборы: short, long, deep, bitwise, fractional (по умолчанию все)\n";
+}
+
+int main(int argc, char **argv) {
+    std::size_t count = 20000;
+    std::size_t reps = 5;
+    std::uint64_t seed = 1;
+    std::string outPath, dumpPath;
+    bool checkAllocs = false;
+    bool allocsFound = false;
+    bool mismatchFound = false;
+    std::vector<CorpusGenerator::Kind> kinds = CorpusGenerator::allKinds();
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        bool hasArg = i + 1 < argc;
+        if (a == "--count" && hasArg) count = std::strtoull(argv[++i], nullptr, 10);
+        else if (a == "--reps" && hasArg) reps = std::strtoull(argv[++i], nullptr, 10);
+        else if (a == "--seed" && hasArg) seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (a == "--out" && hasArg) outPath = argv[++i];
+        else if (a == "--dump" && hasArg) dumpPath = argv[++i];
+        else if (a == "--check-allocs") checkAllocs = true;
+        else if (a == "--corpus" && hasArg) {
+            CorpusGenerator::Kind k;
+            if (!CorpusGenerator::parseKind(argv[++i], k)) { printUsage(argv[0]); return 2; }
+            kinds = {k};
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (count == 0 || reps == 0) { printUsage(argv[0]); return 2; }
+
+    std::ofstream dump;
+    if (!dumpPath.empty()) {
+        dump.open(dumpPath);
+        if (!dump) { std::cerr << "Ошибка: не открыть " << dumpPath << "\n"; return 1; }
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"seed\": " << seed << ",\n  \"count\": " << count << ",\n  \"reps\": " << reps
+         << ",\n  \"corpora\": [\n";
+    for (std::size_t c = 0; c < kinds.size(); ++c) {
+        // Свой поток на каждый набор: набор не зависит от того, какие ещё выбраны.
+        CorpusGenerator gen(seed * 0x100000001b3ULL + static_cast<std::uint64_t>(kinds[c]));
+        std::vector<std::string> exprs = gen.corpus(kinds[c], count);
+        if (dump) {
+            for (const std::string &e : exprs) dump << e << "\n";
+        }
+
+        std::vector<StageResult> stages = runCorpus(exprs, reps);
+        json << "    {\"name\": \"" << CorpusGenerator::name(kinds[c]) << "\", \"stages\": [\n";
+        for (std::size_t s = 0; s < stages.size(); ++s) {
+            const StageResult &r = stages[s];
+            if (r.allocFree && r.allocsPerExpr > 0.0) {
+                allocsFound = true;
+                std::cerr << "Выделения памяти на пути без выделений: " << CorpusGenerator::name(kinds[c]) << "/"
+                          << r.name << " " << r.allocsPerExpr << " на выражение\n";
+            }
+            char buf[256];
+            std::snprintf(buf, sizeof(buf),
+                          "      {\"stage\": \"%s\", \"ns_per_expr\": %.1f, \"allocs_per_expr\": %.2f, "
+                          "\"p50_ns\": %.0f, \"p90_ns\": %.0f, \"p99_ns\": %.0f, \"max_ns\": %.0f}",
+                          r.name.c_str(), r.nsPerExpr, r.allocsPerExpr, r.p50, r.p90, r.p99, r.max);
+            json << buf << (s + 1 < stages.size() ? ",\n" : "\n");
+        }
+        json << "    ]}" << (c + 1 < kinds.size() ? ",\n" : "\n");
+    }
+    json << "  ],\n  \"columnar\": [\n";
+
+    std::string columnError;
+    std::vector<ColumnResult> columns = runColumns(count, reps, seed, columnError);
+    if (!columnError.empty()) { std::cerr << "Ошибка колоночного этапа: " << columnError << "\n"; return 1; }
+    for (std::size_t k = 0; k < columns.size(); ++k) {
+        const ColumnResult &r = columns[k];
+        if (r.mismatches > 0) {
+            mismatchFound = true;
+            std::cerr << "Колоночный ответ расходится с VM: " << r.expr << ", строк: " << r.mismatches << "\n";
+        }
+        char buf[256];
+        std::snprintf(buf, sizeof(buf),
+                      "    {\"expr\": \"%s\", \"rows\": %zu, \"columnar_ns_per_row\": %.2f, "
+                      "\"vm_ns_per_row\": %.2f, \"error_rows\": %zu, \"mismatches\": %zu}",
+                      r.expr.c_str(), count, r.columnarNs, r.vmNs, r.errorRows, r.mismatches);
+        json << buf << (k + 1 < columns.size() ? ",\n" : "\n");
+    }
+    json << "  ]\n}\n";
+
+    if (outPath.empty()) {
+        std::cout << json.str();
+    } else {
+        std::ofstream out(outPath);
+        if (!(out << json.str())) { std::cerr << "Ошибка: не записать " << outPath << "\n"; return 1; }
+    }
+    if (mismatchFound) return 4;
+    return checkAllocs && allocsFound ? 3 : 0;
+}
@@ -0,0 +1,116 @@
+#ifndef CORPUS_GUARD
+#define CORPUS_GUARD
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Воспроизводимые наборы выражений для бенчмарков. Свой генератор
+// (splitmix64), а не std::*_distribution: те дают разные числа на разных
+// стандартных библиотеках, а корпус должен совпадать везде при одном seed.
+class CorpusGenerator {
+public:
+    enum class Kind { Short, Long, Deep, Bitwise, Fractional };
+
+    static const char *name(Kind k) {
+        switch (k) {
+            case Kind::Short: return "short";
+            case Kind::Long: return "long";
+            case Kind::Deep: return "deep";
+            case Kind::Bitwise: return "bitwise";
+            case Kind::Fractional: return "fractional";
+        }
+        return "?";
+    }
+
+    static bool parseKind(const std::string &s, Kind &out) {
+        for (Kind k : allKinds()) {
+            if (s == name(k)) { out = k; return true; }
+        }
+        return false;
+    }
+
+    static std::vector<Kind> allKinds() {
+        return {Kind::Short, Kind::Long, Kind::Deep, Kind::Bitwise, Kind::Fractional};
+    }
+
+private:
+    std::uint64_t state;
+
+    std::uint64_t next() {
+        std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    std::size_t below(std::size_t n) { return static_cast<std::size_t>(next() % n); }
+
+    std::string bits(std::size_t len) {
+        std::string s(1, '1');
+        for (std::size_t i = 1; i < len; ++i) s.push_back(static_cast<char>('0' + (next() & 1)));
+        return s;
+    }
+
+    std::string integer(std::size_t maxLen) { return bits(1 + below(maxLen)); }
+
+    std::string fraction() { return integer(8) + "." + bits(1 + below(10)); }
+
+    // Сдвиг 0..63 в двоичной записи, чтобы не тонуть в ошибках диапазона.
+    std::string shiftCount() {
+        std::size_t n = below(64);
+        std::string s;
+        do { s.insert(s.begin(), static_cast<char>('0' + (n & 1))); n >>= 1; } while (n);
+        return s;
+    }
+
+    std::string arith(std::size_t terms, bool fractional) {
+        static const char *ops[] = {" + ", " - ", " * ", " / "};
+        std::string s = fractional ? fraction() : integer(16);
+        for (std::size_t i = 1; i < terms; ++i) {
+            s += ops[below(4)];
+            s += fractional ? fraction() : integer(16);
+        }
+        return s;
+    }
+
+    std::string bitwise(std::size_t terms) {
+        static const char *ops[] = {" & ", " | ", " ^ ", " and ", " or ", " xor "};
+        std::string s = integer(32);
+        for (std::size_t i = 1; i < terms; ++i) {
+            std::size_t r = below(8);
+            if (r < 6) s += ops[r] + integer(32);
+            else s = "(" + s + (r == 6 ? ") << " : ") >> ") + shiftCount();
+        }
+        return s;
+    }
+
+    std::string deep(std::size_t depth) {
+        if (depth == 0) return integer(12);
+        static const char *ops[] = {" + ", " - ", " * ", " & ", " | "};
+        return "(" + deep(depth - 1) + ops[below(5)] + integer(12) + ")";
+    }
+
+public:
+    explicit CorpusGenerator(std::uint64_t seed) : state(seed) {}
+
+    std::string expression(Kind k) {
+        switch (k) {
+            case Kind::Short: return arith(2 + below(2), false);
+            case Kind::Long: return arith(20 + below(20), false);
+            case Kind::Deep: return deep(16 + below(32));
+            case Kind::Bitwise: return bitwise(3 + below(8));
+            case Kind::Fractional: return arith(2 + below(6), true);
+        }
+        return "";
+    }
+
+    std::vector<std::string> corpus(Kind k, std::size_t count) {
+        std::vector<std::string> out;
+        out.reserve(count);
+        for (std::size_t i = 0; i < count; ++i) out.push_back(expression(k));
+        return out;
+    }
+};
+
+#endif
@@ -0,0 +1,533 @@
+#ifndef BIG_BINARY_GUARD
+#define BIG_BINARY_GUARD
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "bitText.h"
+
+// Целое произвольной длины: знак + модуль в 64-битных лимбах (младший первым).
+// Умножение выбирается по размеру: школьное, Карацуба, Тоом-3.
+// Десятичная запись - "разделяй и властвуй" с делением через умножение.
+class BigBinary {
+public:
+    using Limb = std::uint64_t;
+    using Limbs = std::vector<Limb>;
+
+    static constexpr std::size_t kKaratsubaThreshold = 32;
+    static constexpr std::size_t kToom3Threshold = 192;
+    // Десятичный перевод: до стольких лимбов - делением на 10^19 по кусочку;
+    // делители короче kBarrettLimbs - алгоритмом D, длиннее - по Барретту.
+    static constexpr std::size_t kDecimalBaseLimbs = 32;
+    static constexpr std::size_t kBarrettLimbs = 64;
+
+private:
+    bool neg = false;
+    Limbs mag;
+
+    static void trimZeros(Limbs &a) {
+        while (!a.empty() && a.back() == 0) a.pop_back();
+    }
+
+    static int cmpMag(const Limbs &a, const Limbs &b) {
+        if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+        for (std::size_t i = a.size(); i-- > 0;) {
+            if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+        }
+        return 0;
+    }
+
+    static Limbs addMag(const Limbs &a, const Limbs &b) {
+        const Limbs &x = a.size() >= b.size() ? a : b;
+        const Limbs &y = a.size() >= b.size() ? b : a;
+        Limbs r(x.size() + 1);
+        Limb carry = 0;
+        for (std::size_t i = 0; i < x.size(); ++i) {
+            Limb yi = i < y.size() ? y[i] : 0;
+            Limb s = x[i] + yi;
+            Limb c1 = s < yi;
+            Limb s2 = s + carry;
+            Limb c2 = s2 < carry;
+            r[i] = s2;
+            carry = c1 | c2;
+        }
+        r[x.size()] = carry;
+        trimZeros(r);
+        return r;
+    }
+
+    // a >= b
+    static Limbs subMag(const Limbs &a, const Limbs &b) {
+        Limbs r(a.size());
+        Limb borrow = 0;
+        for (std::size_t i = 0; i < a.size(); ++i) {
+            Limb bi = i < b.size() ? b[i] : 0;
+            Limb d = a[i] - bi;
+            Limb b1 = a[i] < bi;
+            Limb d2 = d - borrow;
+            Limb b2 = d < borrow;
+            r[i] = d2;
+            borrow = b1 | b2;
+        }
+        trimZeros(r);
+        return r;
+    }
+
+    // r[off..] += a
+    static void addInto(Limbs &r, const Limbs &a, std::size_t off) {
+        if (r.size() < off + a.size() + 1) r.resize(off + a.size() + 1, 0);
+        Limb carry = 0;
+        std::size_t i = 0;
+        for (; i < a.size(); ++i) {
+            Limb s = r[off + i] + a[i];
+            Limb c1 = s < a[i];
+            Limb s2 = s + carry;
+            Limb c2 = s2 < carry;
+            r[off + i] = s2;
+            carry = c1 | c2;
+        }
+        for (std::size_t k = off + i; carry != 0; ++k) {
+            if (k == r.size()) r.push_back(0);
+            r[k] += carry;
+            carry = r[k] == 0 ? 1 : 0;
+        }
+    }
+
+    static Limbs mulSchool(const Limbs &a, const Limbs &b) {
+        if (a.empty() || b.empty()) return {};
+        Limbs r(a.size() + b.size(), 0);
+        for (std::size_t i = 0; i < a.size(); ++i) {
+            unsigned __int128 carry = 0;
+            for (std::size_t j = 0; j < b.size(); ++j) {
+                unsigned __int128 cur = static_cast<unsigned __int128>(a[i]) * b[j] + r[i + j] + carry;
+                r[i + j] = static_cast<Limb>(cur);
+                carry = cur >> 64;
+            }
+            r[i + b.size()] = static_cast<Limb>(carry);
+        }
+        trimZeros(r);
+        return r;
+    }
+
+    static Limbs slice(const Limbs &a, std::size_t from, std::size_t len) {
+        if (from >= a.size()) return {};
+        std::size_t to = std::min(a.size(), from + len);
+        Limbs r(a.begin() + static_cast<std::ptrdiff_t>(from), a.begin() + static_cast<std::ptrdiff_t>(to));
+        trimZeros(r);
+        return r;
+    }
+
+    static Limbs mulKaratsuba(const Limbs &a, const Limbs &b) {
+        std::size_t m = std::max(a.size(), b.size()) / 2;
+        Limbs a0 = slice(a, 0, m), a1 = slice(a, m, a.size());
+        Limbs b0 = slice(b, 0, m), b1 = slice(b, m, b.size());
+
+        Limbs z0 = mulMag(a0, b0);
+        Limbs z2 = mulMag(a1, b1);
+        Limbs z1 = mulMag(addMag(a0, a1), addMag(b0, b1));
+        z1 = subMag(subMag(z1, z0), z2);
+
+        Limbs r = z0;
+        addInto(r, z1, m);
+        addInto(r, z2, 2 * m);
+        trimZeros(r);
+        return r;
+    }
+
+    static Limbs mulToom3(const Limbs &a, const Limbs &b) {
+        std::size_t k = (std::max(a.size(), b.size()) + 2) / 3;
+        BigBinary a0(slice(a, 0, k)), a1(slice(a, k, k)), a2(slice(a, 2 * k, k));
+        BigBinary b0(slice(b, 0, k)), b1(slice(b, k, k)), b2(slice(b, 2 * k, k));
+
+        // Точки 0, 1, -1, -2, бесконечность.
+        BigBinary pa = a0 + a2, pb = b0 + b2;
+        BigBinary a1p = pa + a1, am1 = pa - a1;
+        BigBinary b1p = pb + b1, bm1 = pb - b1;
+        BigBinary am2 = ((am1 + a2).shiftedLeft(1)) - a0;
+        BigBinary bm2 = ((bm1 + b2).shiftedLeft(1)) - b0;
+
+        BigBinary r0 = a0 * b0;
+        BigBinary r1 = a1p * b1p;
+        BigBinary rm1 = am1 * bm1;
+        BigBinary rm2 = am2 * bm2;
+        BigBinary rinf = a2 * b2;
+
+        // Интерполяция по Бодрато.
+        BigBinary t3 = (rm2 - r1).dividedBySmall(3);
+        BigBinary t1 = (r1 - rm1).shiftedRight(1);
+        BigBinary t2 = rm1 - r0;
+        t3 = (t2 - t3).shiftedRight(1) + rinf.shiftedLeft(1);
+        t2 = t2 + t1 - rinf;
+        t1 = t1 - t3;
+
+        Limbs r = r0.mag;
+        addInto(r, t1.mag, k);
+        addInto(r, t2.mag, 2 * k);
+        addInto(r, t3.mag, 3 * k);
+        addInto(r, rinf.mag, 4 * k);
+        trimZeros(r);
+        return r;
+    }
+
+    static Limbs mulMag(const Limbs &a, const Limbs &b) {
+        std::size_t n = std::min(a.size(), b.size());
+        if (n < kKaratsubaThreshold) return mulSchool(a, b);
+        if (n < kToom3Threshold) return mulKaratsuba(a, b);
+        return mulToom3(a, b);
+    }
+
+    static Limb divSmallMag(Limbs &a, Limb d) {
+        unsigned __int128 rem = 0;
+        for (std::size_t i = a.size(); i-- > 0;) {
+            unsigned __int128 cur = (rem << 64) | a[i];
+            a[i] = static_cast<Limb>(cur / d);
+            rem = cur % d;
+        }
+        trimZeros(a);
+        return static_cast<Limb>(rem);
+    }
+
+    static Limbs shlMag(const Limbs &a, std::size_t bits) {
+        if (a.empty()) return {};
+        std::size_t words = bits / 64;
+        unsigned sh = static_cast<unsigned>(bits % 64);
+        Limbs r(a.size() + words + 1, 0);
+        for (std::size_t i = 0; i < a.size(); ++i) {
+            r[i + words] |= a[i] << sh;
+            if (sh != 0) r[i + words + 1] |= a[i] >> (64 - sh);
+        }
+        trimZeros(r);
+        return r;
+    }
+
+    static Limbs shrMag(const Limbs &a, std::size_t bits) {
+        std::size_t words = bits / 64;
+        if (words >= a.size()) return {};
+        unsigned sh = static_cast<unsigned>(bits % 64);
+        Limbs r(a.size() - words, 0);
+        for (std::size_t i = 0; i < r.size(); ++i) {
+            r[i] = a[i + words] >> sh;
+            if (sh != 0 && i + words + 1 < a.size()) r[i] |= a[i + words + 1] << (64 - sh);
+        }
+        trimZeros(r);
+        return r;
+    }
+
+    // Кнут, алгоритм D. b не пуст.
+    static void divModMag(const Limbs &a, const Limbs &b, Limbs &q, Limbs &r) {
+        if (cmpMag(a, b) < 0) { q.clear(); r = a; return; }
+        if (b.size() == 1) {
+            q = a;
+            Limb rem = divSmallMag(q, b[0]);
+            r.clear();
+            if (rem != 0) r.push_back(rem);
+            return;
+        }
+
+        unsigned s = static_cast<unsigned>(__builtin_clzll(b.back()));
+        Limbs v = shlMag(b, s);
+        Limbs u = shlMag(a, s);
+        u.resize(a.size() + 1, 0);
+        std::size_t n = v.size(), m = u.size() - n;
+        q.assign(m, 0);
+
+        for (std::size_t j = m; j-- > 0;) {
+            unsigned __int128 num = (static_cast<unsigned __int128>(u[j + n]) << 64) | u[j + n - 1];
+            unsigned __int128 qhat = num / v[n - 1];
+            unsigned __int128 rhat = num % v[n - 1];
+            while (qhat >> 64 != 0 ||
+                   qhat * v[n - 2] > ((rhat << 64) | u[j + n - 2])) {
+                --qhat;
+                rhat += v[n - 1];
+                if (rhat >> 64 != 0) break;
+            }
+
+            Limb borrow = 0, carry = 0;
+            for (std::size_t i = 0; i < n; ++i) {
+                unsigned __int128 p = qhat * v[i] + carry;
+                carry = static_cast<Limb>(p >> 64);
+                Limb lo = static_cast<Limb>(p);
+                Limb t = u[i + j] - lo;
+                Limb b1 = u[i + j] < lo;
+                Limb t2 = t - borrow;
+                Limb b2 = t < borrow;
+                u[i + j] = t2;
+                borrow = b1 | b2;
+            }
+            Limb top = u[j + n];
+            u[j + n] = top - carry - borrow;
+            bool negative = top < carry || top - carry < borrow;
+
+            if (negative) {
+                --qhat;
+                Limb c = 0;
+                for (std::size_t i = 0; i < n; ++i) {
+                    Limb s1 = u[i + j] + v[i];
+                    Limb c1 = s1 < v[i];
+                    Limb s2 = s1 + c;
+                    Limb c2 = s2 < c;
+                    u[i + j] = s2;
+                    c = c1 | c2;
+                }
+                u[j + n] += c;
+            }
+            q[j] = static_cast<Limb>(qhat);
+        }
+
+        trimZeros(q);
+        u.resize(n);
+        trimZeros(u);
+        r = shrMag(u, s);
+    }
+
+    struct DecimalPower {
+        Limbs value;          // 10^digits, digits = 19 * 2^k
+        Limbs inverse;        // floor(2^(2 * bits) / value)
+        std::size_t bits = 0;  // длина value в битах
+        std::size_t digits = 0;
+    };
+
+    // floor(2^(2n) / d), n - длина d в битах. Приближение - обратное к старшей
+    // половине d, один шаг Ньютона x + x(2^(2n) - dx) / 2^(2n) удваивает
+    // точность, оставшиеся единицы добирает поправка.
+    static BigBinary reciprocal(const BigBinary &d) {
+        std::size_t n = d.bitLength();
+        BigBinary scale = fromUint(1).shiftedLeft(2 * n);
+        if (d.mag.size() < kBarrettLimbs) {
+            BigBinary q, r;
+            divMod(scale, d, q, r);
+            return q;
+        }
+        std::size_t h = n / 2 + 1;
+        BigBinary x = reciprocal(d.shiftedRight(n - h)).shiftedLeft(n - h);
+        x = x + (x * (scale - d * x)).shiftedRight(2 * n);
+        BigBinary r = scale - d * x, one = fromUint(1);
+        while (r.isNegative()) { x = x - one; r = r + d; }
+        while (!(r - d).isNegative()) { x = x + one; r = r - d; }
+        return x;
+    }
+
+    // a = q * p.value + r при a < p.value^2. По Барретту частное берётся из
+    // старших n + 1 бит a и занижено не больше чем на 2.
+    static void divModPower(const Limbs &a, const DecimalPower &p, Limbs &q, Limbs &r) {
+        if (p.inverse.empty()) { divModMag(a, p.value, q, r); return; }
+        q = shrMag(mulMag(shrMag(a, p.bits - 1), p.inverse), p.bits + 1);
+        r = subMag(a, mulMag(q, p.value));
+        while (cmpMag(r, p.value) >= 0) {
+            r = subMag(r, p.value);
+            q = addMag(q, Limbs{1});
+        }
+    }
+
+    // Цифры m кусками по 19; width - ровно столько цифр с ведущими нулями,
+    // 0 - без ведущих нулей.
+    static void appendDecimalSmall(Limbs m, std::size_t width, std::string &out) {
+        const Limb chunk = 10000000000000000000ULL;  // 10^19
+        std::vector<Limb> parts;
+        while (!m.empty()) parts.push_back(divSmallMag(m, chunk));
+
+        std::size_t start = out.size();
+        if (!parts.empty()) {
+            out += std::to_string(parts.back());
+            for (std::size_t i = parts.size() - 1; i-- > 0;) {
+                std::string p = std::to_string(parts[i]);
+                out.append(19 - p.size(), '0');
+                out += p;
+            }
+        }
+        std::size_t len = out.size() - start;
+        if (width > len) out.insert(start, width - len, '0');
+    }
+
+    // x < powers[level].value^2: старшие цифры - x / 10^digits, младшие -
+    // остаток ровно в digits цифр.
+    static void appendDecimal(const Limbs &x, std::size_t level, std::size_t width,
+                              const std::vector<DecimalPower> &powers, std::string &out) {
+        if (x.size() <= kDecimalBaseLimbs) { appendDecimalSmall(x, width, out); return; }
+        const DecimalPower &p = powers[level];
+        if (width == 0 && cmpMag(x, p.value) < 0) { appendDecimal(x, level - 1, 0, powers, out); return; }
+        Limbs q, r;
+        divModPower(x, p, q, r);
+        appendDecimal(q, level - 1, width == 0 ? 0 : width - p.digits, powers, out);
+        appendDecimal(r, level - 1, p.digits, powers, out);
+    }
+
+    BigBinary(Limbs m, bool negative) : neg(negative), mag(std::move(m)) {
+        trimZeros(mag);
+        if (mag.empty()) neg = false;
+    }
+
+public:
+    BigBinary() = default;
+    explicit BigBinary(Limbs m) : BigBinary(std::move(m), false) {}
+
+    static BigBinary fromUint(std::uint64_t v) {
+        return BigBinary(Limbs{v}, false);
+    }
+
+    static BigBinary fromInt(long long v) {
+        std::uint64_t m = v < 0 ? 0 - static_cast<std::uint64_t>(v) : static_cast<std::uint64_t>(v);
+        return BigBinary(Limbs{m}, v < 0);
+    }
+
+    bool isZero() const { return mag.empty(); }
+    bool isNegative() const { return neg; }
+    const Limbs &limbs() const { return mag; }
+
+    std::size_t bitLength() const {
+        if (mag.empty()) return 0;
+        return mag.size() * 64 - static_cast<std::size_t>(__builtin_clzll(mag.back()));
+    }
+
+    bool fitsUint64() const { return !neg && mag.size() <= 1; }
+    std::uint64_t lowUint64() const { return mag.empty() ? 0 : mag[0]; }
+
+    bool fitsInt64(long long &out) const {
+        if (mag.size() > 1) return false;
+        std::uint64_t m = lowUint64();
+        if (m > static_cast<std::uint64_t>(LLONG_MAX)) return false;
+        out = neg ? -static_cast<long long>(m) : static_cast<long long>(m);
+        return true;
+    }
+
+    std::size_t trailingZeros() const {
+        for (std::size_t i = 0; i < mag.size(); ++i) {
+            if (mag[i] != 0) return i * 64 + static_cast<std::size_t>(__builtin_ctzll(mag[i]));
+        }
+        return 0;
+    }
+
+    static BigBinary pow5(std::size_t k) {
+        BigBinary result = fromUint(1), base = fromUint(5);
+        while (k > 0) {
+            if (k & 1) result = result * base;
+            k >>= 1;
+            if (k > 0) base = base * base;
+        }
+        return result;
+    }
+
+    double toDouble() const {
+        double r = 0.0;
+        for (std::size_t i = mag.size(); i-- > 0;) r = r * 18446744073709551616.0 + static_cast<double>(mag[i]);
+        return neg ? -r : r;
+    }
+
+    BigBinary operator-() const { return BigBinary(mag, !neg); }
+
+    friend BigBinary operator+(const BigBinary &a, const BigBinary &b) {
+        if (a.neg == b.neg) return BigBinary(addMag(a.mag, b.mag), a.neg);
+        int c = cmpMag(a.mag, b.mag);
+        if (c == 0) return BigBinary();
+        if (c > 0) return BigBinary(subMag(a.mag, b.mag), a.neg);
+        return BigBinary(subMag(b.mag, a.mag), b.neg);
+    }
+
+    friend BigBinary operator-(const BigBinary &a, const BigBinary &b) {
+        return a + (-b);
+    }
+
+    friend BigBinary operator*(const BigBinary &a, const BigBinary &b) {
+        return BigBinary(mulMag(a.mag, b.mag), a.neg != b.neg);
+    }
+
+    // Деление с отбрасыванием дробной части (как в C++), b != 0.
+    static void divMod(const BigBinary &a, const BigBinary &b, BigBinary &q, BigBinary &r) {
+        Limbs qm, rm;
+        divModMag(a.mag, b.mag, qm, rm);
+        q = BigBinary(std::move(qm), a.neg != b.neg);
+        r = BigBinary(std::move(rm), a.neg);
+    }
+
+    // Точное деление на малое число (для интерполяции Тоом-3).
+    BigBinary dividedBySmall(Limb d) const {
+        Limbs m = mag;
+        divSmallMag(m, d);
+        return BigBinary(std::move(m), neg);
+    }
+
+    BigBinary shiftedLeft(std::size_t bits) const { return BigBinary(shlMag(mag, bits), neg); }
+    // Для отрицательных сдвиг модуля; в Тоом-3 используется только на чётных значениях.
+    BigBinary shiftedRight(std::size_t bits) const { return BigBinary(shrMag(mag, bits), neg); }
+
+    // Побитовые операции определены для неотрицательных чисел, по лимбам.
+    friend BigBinary operator&(const BigBinary &a, const BigBinary &b) {
+        std::size_t n = std::min(a.mag.size(), b.mag.size());
+        Limbs r(n);
+        for (std::size_t i = 0; i < n; ++i) r[i] = a.mag[i] & b.mag[i];
+        return BigBinary(std::move(r), false);
+    }
+
+    friend BigBinary operator|(const BigBinary &a, const BigBinary &b) {
+        const Limbs &x = a.mag.size() >= b.mag.size() ? a.mag : b.mag;
+        const Limbs &y = a.mag.size() >= b.mag.size() ? b.mag : a.mag;
+        Limbs r(x);
+        for (std::size_t i = 0; i < y.size(); ++i) r[i] |= y[i];
+        return BigBinary(std::move(r), false);
+    }
+
+    friend BigBinary operator^(const BigBinary &a, const BigBinary &b) {
+        const Limbs &x = a.mag.size() >= b.mag.size() ? a.mag : b.mag;
+        const Limbs &y = a.mag.size() >= b.mag.size() ? b.mag : a.mag;
+        Limbs r(x);
+        for (std::size_t i = 0; i < y.size(); ++i) r[i] ^= y[i];
+        return BigBinary(std::move(r), false);
+    }
+
+    friend bool operator==(const BigBinary &a, const BigBinary &b) {
+        return a.neg == b.neg && a.mag == b.mag;
+    }
+
+    static bool fromBinaryString(std::string_view text, BigBinary &out) {
+        if (text.empty()) return false;
+        std::size_t start = (text[0] == '-') ? 1 : 0;
+        if (start >= text.size()) return false;
+
+        std::string_view digits = text.substr(start);
+        Limbs m((digits.size() + 63) / 64, 0);
+        if (!packBinaryDigits(digits.data(), digits.size(), m.data())) return false;
+        out = BigBinary(std::move(m), start == 1);
+        return true;
+    }
+
+    std::string toBinaryString() const {
+        if (mag.empty()) return "0";
+        std::size_t bits = bitLength();
+        std::string res(bits + (neg ? 1 : 0), '0');
+        char *p = &res[0];
+        if (neg) *p++ = '-';
+        unpackBinaryDigits(mag.data(), bits, p);
+        return res;
+    }
+
+    // Степени 10^(19 * 2^k) - до первой, чей квадрат больше модуля; для
+    // длинных заранее считается обратное, и перевод стоит O(M(n) log n).
+    std::string toDecimalString() const {
+        if (mag.empty()) return "0";
+        std::vector<DecimalPower> powers(1);
+        powers[0].value = {10000000000000000000ULL};
+        powers[0].bits = 64;
+        powers[0].digits = 19;
+        while (2 * (powers.back().bits - 1) < bitLength()) {
+            DecimalPower next;
+            next.value = mulMag(powers.back().value, powers.back().value);
+            next.bits = BigBinary(next.value).bitLength();
+            next.digits = 2 * powers.back().digits;
+            powers.push_back(std::move(next));
+        }
+        for (DecimalPower &p : powers) {
+            if (p.value.size() >= kBarrettLimbs) p.inverse = reciprocal(BigBinary(p.value)).mag;
+        }
+
+        std::string res = neg ? "-" : "";
+        appendDecimal(mag, powers.size() - 1, 0, powers, res);
+        return res;
+    }
+};
+
+#endif
@@ -1,550 +1,307 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <string>
-#include <vector>
-#include <cctype>
-#include <cmath>
+#include <thread>
 
-class BinaryNumber {
-private:
-    double value;
-
-public:
-    explicit BinaryNumber(double v = 0.0) : value(v) {}
-
-    double toDouble() const { return value; }
-
-    bool isInteger(double eps = 1e-12) const {
-        double r = std::round(value);
-        return std::fabs(value - r) < eps;
-    }
-
-    long long toIntChecked(bool &ok, double eps = 1e-12) const {
-        if (!isInteger(eps)) {
-            ok = false;
-            return 0;
-        }
-        ok = true;
-        return static_cast<long long>(std::llround(value));
-    }
-
-    static bool fromBinaryString(const std::string &text, BinaryNumber &out) {
-        if (text.empty()) return false;
-
-        int minusCount = 0, dotCount = 0;
-        for (std::size_t i = 0; i < text.size(); ++i) {
-            char c = text[i];
-            if (!(c == '0' || c == '1' || c == '.' || c == '-')) return false;
-            if (c == '-') {
-                if (i != 0) return false;
-                ++minusCount;
-            } else if (c == '.') {
-                ++dotCount;
-            }
-        }
-        if (minusCount > 1 || dotCount > 1) return false;
-
-        std::size_t start = (text[0] == '-') ? 1 : 0;
-        if (start >= text.size()) return false;
-
-        if (text[start] == '.' || text.back() == '.') return false;
-
-        std::size_t dotPos = text.find('.');
-        std::string intPartStr, fracPartStr;
-
-        if (dotPos == std::string::npos) {
-            intPartStr = text.substr(start);
-        } else {
-            intPartStr = text.substr(start, dotPos - start);
-            fracPartStr = text.substr(dotPos + 1);
-        }
-
-        double intPart = 0.0;
-        for (char c : intPartStr) {
-            intPart = intPart * 2.0 + (c - '0');
-        }
-
-        double fracPart = 0.0;
-        double base = 0.5;
-        for (char c : fracPartStr) {
-            if (c == '1') fracPart += base;
-            base *= 0.5;
-        }
-
-        double result = intPart + fracPart;
-        if (text[0] == '-') result = -result;
-
-        out = BinaryNumber(result);
-        return true;
-    }
-
-    std::string toBinaryString(int fracBits = 12) const {
-        if (value == 0.0) return "0";
-
-        double temp = value;
-        bool neg = false;
-        if (temp < 0.0) { neg = true; temp = -temp; }
-
-        long long intPart = static_cast<long long>(temp);
-        double fracPart = temp - static_cast<double>(intPart);
-
-        std::string intStr;
-        if (intPart == 0) {
-            intStr = "0";
-        } else {
-            while (intPart > 0) {
-                int bit = static_cast<int>(intPart % 2);
-                intStr.insert(intStr.begin(), static_cast<char>('0' + bit));
-                intPart /= 2;
-            }
-        }
-
-        std::string fracStr;
-        for (int i = 0; i < fracBits; ++i) {
-            fracPart *= 2.0;
-            int bit = static_cast<int>(fracPart);
-            if (bit == 1) { fracStr.push_back('1'); fracPart -= 1.0; }
-            else { fracStr.push_back('0'); }
-            if (fracPart == 0.0) break;
-        }
-
-        std::string res = intStr;
-        if (!fracStr.empty()) { res.push_back('.'); res += fracStr; }
-        if (neg) res.insert(res.begin(), '-');
-        return res;
-    }
-};
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-enum class TokenType {
-    Number,
-    Op,
-    LParen,
-    RParen,
-    End
-};
-
-enum class OpKind {
-    Add, Sub, Mul, Div,
-    Shl, Shr,      
-    And, Or, Xor,
-    Not,              
-    UnaryMinus
-};
+#include "session.h"
+#include "batch.h"
+#include "server.h"
+#include "streamEvaluator.h"
 
-struct Token {
-    TokenType type = TokenType::End;
-    BinaryNumber number;
-    OpKind op = OpKind::Add;
-    std::string raw;
-};
+static void printUsage(const char *prog) {
+    std::cerr << "Использование: " << prog << " [--exact | --bits | --int u8..u64|i8..i64] [--jit N] [--batch файл | --serve сокет | --stream файл|- | --truth выражение]"
+              << " [--threads N] [--max-depth N] [--cache файл] [--interactive]"
+              << " [--stats] [--stats-json файл] [--stats-interval сек]\n";
+}
 
-class Lexer {
+// --stats: сводка по этапам в stderr при выходе; --stats-json: тот же
+// снимок в JSON, переписывается раз в interval и в конце.
+class StatsReport {
 private:
-    std::string s;
-    std::size_t i = 0;
-
-    static bool isSpace(char c) { return std::isspace(static_cast<unsigned char>(c)) != 0; }
-    static bool isAlpha(char c) { return std::isalpha(static_cast<unsigned char>(c)) != 0; }
-
-    static std::string toLower(std::string x) {
-        for (char &c : x) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
-        return x;
-    }
+    bool summary;
+    StatsDumper dumper;
 
 public:
-    explicit Lexer(std::string input) : s(std::move(input)) {}
-
-    Token nextToken() {
-        while (i < s.size() && isSpace(s[i])) ++i;
-        if (i >= s.size()) return Token{TokenType::End, BinaryNumber(), OpKind::Add, ""};
-
-        char c = s[i];
-
-        if (c == '(') { ++i; return Token{TokenType::LParen, BinaryNumber(), OpKind::Add, "("}; }
-        if (c == ')') { ++i; return Token{TokenType::RParen, BinaryNumber(), OpKind::Add, ")"}; }
-        if (c == '<' && i + 1 < s.size() && s[i + 1] == '<') {
-            i += 2;
-            return Token{TokenType::Op, BinaryNumber(), OpKind::Shl, "<<"};
-        }
-        if (c == '>' && i + 1 < s.size() && s[i + 1] == '>') {
-            i += 2;
-            return Token{TokenType::Op, BinaryNumber(), OpKind::Shr, ">>"};
-        }
-
-
-      if (c == '+' || c == '-' || c == '*' || c == '/' || c == '&' || c == '|' || c == '^' || c == '~') {
-            ++i;
-            Token t;
-            t.type = TokenType::Op;
-            t.raw = std::string(1, c);
-            if (c == '+') t.op = OpKind::Add;
-            if (c == '-') t.op = OpKind::Sub;
-            if (c == '*') t.op = OpKind::Mul;
-            if (c == '/') t.op = OpKind::Div;
-            if (c == '&') t.op = OpKind::And;
-            if (c == '|') t.op = OpKind::Or;
-            if (c == '^') t.op = OpKind::Xor;
-            if (c == '~') t.op = OpKind::Not;
-            return t;
-        }
-
-        if (isAlpha(c)) {
-            std::size_t start = i;
-            while (i < s.size() && isAlpha(s[i])) ++i;
-            std::string word = toLower(s.substr(start, i - start));
-
-            Token t;
-            t.type = TokenType::Op;
-            t.raw = word;
-
-            if (word == "and") { t.op = OpKind::And; return t; }
-            if (word == "or")  { t.op = OpKind::Or;  return t; }
-            if (word == "xor") { t.op = OpKind::Xor; return t; }
-            if (word == "not") { t.op = OpKind::Not; return t; }
-
+    StatsReport(bool printSummary, const std::string &jsonPath, std::chrono::milliseconds interval)
+        : summary(printSummary), dumper(jsonPath, interval) {}
 
-            t.raw = word;
-            t.type = TokenType::End;
-            return t;
-        }
-
-        if (c == '0' || c == '1' || c == '.') {
-            std::size_t start = i;
-            int dotCount = 0;
-            while (i < s.size()) {
-                char x = s[i];
-                if (x == '0' || x == '1') { ++i; continue; }
-                if (x == '.') {
-                    ++dotCount;
-                    if (dotCount > 1) break;
-                    ++i; continue;
-                }
-                break;
-            }
-            std::string numStr = s.substr(start, i - start);
-
-            BinaryNumber bn;
-            if (!BinaryNumber::fromBinaryString(numStr, bn)) {
-                return Token{TokenType::End, BinaryNumber(), OpKind::Add, numStr};
-            }
-            Token t;
-            t.type = TokenType::Number;
-            t.number = bn;
-            t.raw = numStr;
-            return t;
-        }
-
-        return Token{TokenType::End, BinaryNumber(), OpKind::Add, std::string(1, c)};
+    ~StatsReport() {
+        dumper.stop();
+        if (summary) Stats::print(std::cerr);
     }
 };
 
-
-struct ParseResult {
-    bool ok = false;
-    std::string error;
-    std::vector<Token> rpn;
-};
-
-static int precedence(OpKind op) {
-    switch (op) {
-        case OpKind::UnaryMinus: return 6;
-        case OpKind::Not:        return 6;
-
-        case OpKind::Mul:
-        case OpKind::Div:        return 5;
-
-        case OpKind::Add:
-        case OpKind::Sub:        return 4;
-
-        case OpKind::Shl:
-        case OpKind::Shr:        return 3;
-
-        case OpKind::And:        return 2;
-        case OpKind::Xor:        return 1;
-        case OpKind::Or:         return 0;
-    }
-    return -1;
+// Одна строка REPL; false - пора выходить.
+static bool handleLine(Session &session, std::string_view raw, std::ostream &out) {
+    std::string line = trim(std::string(raw));
+    if (isQuitCommand(line)) return false;
+    if (line.empty()) return true;
+    if (session.command(line, out)) return true;
+    session.evalLine(line, out);
+    return true;
 }
 
-
-static bool isRightAssociative(OpKind op) {
-    return op == OpKind::UnaryMinus || op == OpKind::Not;
+// stdin не терминал: те же команды и переменные, но без приглашений и
+// заставки, чтение блоками и вывод через один большой буфер.
+static int runPipe(Session &session) {
+    LineReader in(0);
+    FdStreamBuf buf(1);
+    std::ostream out(&buf);
+    std::string_view line;
+    while (in.next(line) && handleLine(session, line, out)) {}
+    out.flush();
+    return 0;
 }
 
-
-class InfixParser {
-public:
-    static ParseResult toRpn(const std::string &expr) {
-        Lexer lex(expr);
-        std::vector<Token> output;
-        std::vector<Token> ops;
-
-        bool expectUnary = true;
-
-        while (true) {
-            Token t = lex.nextToken();
-            if (t.type == TokenType::End) {
-                if (!t.raw.empty()) {
-                    return {false, "Неизвестный токен: '" + t.raw + "'", {}};
-                }
-                break;
-            }
-
-            if (t.type == TokenType::Number) {
-                output.push_back(t);
-                expectUnary = false;
-                continue;
-            }
-
-            if (t.type == TokenType::LParen) {
-                ops.push_back(t);
-                expectUnary = true;
-                continue;
-            }
-
-            if (t.type == TokenType::RParen) {
-                bool found = false;
-                while (!ops.empty()) {
-                    if (ops.back().type == TokenType::LParen) {
-                        ops.pop_back();
-                        found = true;
-                        break;
-                    }
-                    output.push_back(ops.back());
-                    ops.pop_back();
-                }
-                if (!found) return {false, "Ошибка: лишняя ')'", {}};
-                expectUnary = false;
-                continue;
-            }
-
-            if (t.type == TokenType::Op) {
-                if (t.op == OpKind::Sub && expectUnary) {
-                    t.op = OpKind::UnaryMinus;
-                    t.raw = "unary-";
-                }
-
-                while (!ops.empty() && ops.back().type == TokenType::Op) {
-                    OpKind top = ops.back().op;
-                    int pTop = precedence(top);
-                    int pCur = precedence(t.op);
-
-                    if (pTop > pCur || (pTop == pCur && !isRightAssociative(t.op))) {
-                        output.push_back(ops.back());
-                        ops.pop_back();
-                    } else {
-                        break;
-                    }
-                }
-
-                ops.push_back(t);
-                expectUnary = true;
-                continue;
-            }
-
-            return {false, "Ошибка: неожиданный токен '" + t.raw + "'", {}};
-        }
-
-        while (!ops.empty()) {
-            if (ops.back().type == TokenType::LParen) return {false, "Ошибка: не закрыта '('", {}};
-            output.push_back(ops.back());
-            ops.pop_back();
-        }
-
-        return {true, "", output};
-    }
-};
-
-struct EvalResult {
-    bool ok = false;
+static int runBatch(const std::string &path, unsigned threads, NumberMode mode, std::size_t jitHits,
+                    ResultCache *cache) {
+    BatchRunner runner(mode, jitHits);
+    runner.setCache(cache);
+    BatchStats stats;
     std::string error;
-    BinaryNumber value;
-    bool isBitwiseResult = false;
-};
+    BufferedWriter writer;
 
-class Evaluator {
-private:
-    static bool isZero(const BinaryNumber &b) {
-        return std::fabs(b.toDouble()) < 1e-12;
+    if (!runner.run(path, threads, writer, stats, error)) {
+        std::cerr << "Ошибка: " << error << "\n";
+        return 1;
     }
 
-    static bool toNonNegInt(const BinaryNumber& x, long long& out) {
-        bool ok = false;
-        out = x.toIntChecked(ok);
-        if (!ok) return false;
-        if (out < 0) return false;
-        return true;
+    double rate = stats.seconds > 0.0 ? static_cast<double>(stats.expressions) / stats.seconds : 0.0;
+    std::cerr << "Пакет: " << stats.expressions << " выражений (" << stats.lines << " строк) за "
+              << stats.seconds << " с, " << rate << " выражений/с, потоков: " << stats.threads << "\n";
+    if (cache) {
+        std::cerr << "Кеш: попаданий " << cache->hits() << ", промахов " << cache->misses() << ", без кеша "
+                  << cache->bypassed() << "\n";
     }
+    return 0;
+}
 
-
-        static EvalResult applyUnary(OpKind op, const BinaryNumber &a) {
-        if (op == OpKind::UnaryMinus) {
-            return {true, "", BinaryNumber(-a.toDouble()), false};
-        }
-        if (op == OpKind::Not) {
-            long long ia = 0;
-            if (!toNonNegInt(a, ia)) {
-                return {false, "NOT (~ / not) разрешён только для неотрицательных целых двоичных чисел (без точки).",
-                        BinaryNumber(), false};
-            }
-
-            unsigned long long ua = static_cast<unsigned long long>(ia);
-            unsigned long long r = ~ua;
-
-            return {true, "", BinaryNumber(static_cast<double>(static_cast<long long>(r))), true};
-        }
-        return {false, "Неизвестный унарный оператор", BinaryNumber(), false};
+// Вектор по частям: строка всех цифр была бы размером со входной литерал.
+static void printBitsChunked(const BitVector &v, std::ostream &out) {
+    constexpr std::size_t kChunkWords = 1024;
+    static char text[64 * kChunkWords];
+    std::size_t full = v.width / 64, head = v.width % 64;
+    if (head != 0) {
+        unpackBinaryDigits(v.words.data() + full, head, text);
+        out.write(text, static_cast<std::streamsize>(head));
     }
+    for (std::size_t k = full; k > 0;) {
+        std::size_t n = std::min(k, kChunkWords);
+        k -= n;
+        unpackBinaryDigits(v.words.data() + k, 64 * n, text);
+        out.write(text, static_cast<std::streamsize>(64 * n));
+    }
+    out << "   (ширина: " << v.width << ")\n";
+}
 
-
-    static EvalResult applyBinary(OpKind op, const BinaryNumber &a, const BinaryNumber &b) {
-        if (op == OpKind::Add) return {true, "", BinaryNumber(a.toDouble() + b.toDouble()), false};
-        if (op == OpKind::Sub) return {true, "", BinaryNumber(a.toDouble() - b.toDouble()), false};
-        if (op == OpKind::Mul) return {true, "", BinaryNumber(a.toDouble() * b.toDouble()), false};
-        if (op == OpKind::Div) {
-            if (isZero(b)) return {false, "Деление на ноль", BinaryNumber(), false};
-            return {true, "", BinaryNumber(a.toDouble() / b.toDouble()), false};
+static void printStreamResult(const EvalResult &r) { Session::printDouble(r, std::cout); }
+static void printStreamResult(const BitsResult &r) { printBitsChunked(r.value, std::cout); }
+static void printStreamResult(const ExactResult &r) { Session::printExact(r.value, std::cout); }
+
+template <typename Stream>
+static void streamAll(StreamReader &in, Stream &ev) {
+    typename Stream::Result r;
+    // Разбор и вычисление в потоке не разделены: всё время - этап eval.
+    StatsRecorder *rec = Stats::recorder();
+    while (Stats::timed(rec, Stage::Eval, [&] { return ev.next(in, r); })) {
+        if (r.ok) {
+            printStreamResult(r);
+        } else {
+            Stats::error(r.code);
+            std::cout << r.error << "\n";
         }
+    }
+}
 
-        if (op == OpKind::And || op == OpKind::Or || op == OpKind::Xor) {
-            bool okA = false, okB = false;
-            long long ia = 0, ib = 0;
-            if (!toNonNegInt(a, ia) || !toNonNegInt(b, ib)) {
-                return {false, "Логические операции (&, |, ^, and/or/xor) разрешены только для неотрицательных целых двоичных чисел (без точки).",
-                        BinaryNumber(), false};
-            }
-
-
-            long long r = 0;
-            if (op == OpKind::And) r = (ia & ib);
-            if (op == OpKind::Or)  r = (ia | ib);
-            if (op == OpKind::Xor) r = (ia ^ ib);
+// Окно чтения отображённого файла для --stream.
+static constexpr std::size_t kStreamWindow = std::size_t(1) << 22;
 
-            return {true, "", BinaryNumber(static_cast<double>(r)), true};
+// Выражения любой длины прямо из файла или stdin ("-"): double, exact или
+// bits. Обычный файл отображается в память, канал читается через буфер;
+// литералы собираются в значение по мере чтения.
+static int runStream(const std::string &path, NumberMode mode, std::size_t maxDepth) {
+    // Канал или терминал не отображается - тогда дескриптор через буфер.
+    MappedFile file;
+    std::string error;
+    struct stat st {};
+    int fd = -1;
+    std::unique_ptr<StreamReader> in;
+    if (path != "-" && ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && file.open(path, error)) {
+        in = std::make_unique<StreamReader>(file.view(), kStreamWindow);
+    } else {
+        fd = path == "-" ? 0 : ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Ошибка: не удалось открыть файл '" << path << "'\n";
+            return 1;
         }
-                if (op == OpKind::Shl || op == OpKind::Shr) {
-            long long ia = 0, ib = 0;
-            if (!toNonNegInt(a, ia) || !toNonNegInt(b, ib)) {
-                return {false, "Сдвиги (<<, >>) разрешены только для неотрицательных целых двоичных чисел (без точки).",
-                        BinaryNumber(), false};
-            }
-            if (ib < 0 || ib > 63) {
-                return {false, "Сдвиг должен быть в диапазоне 0..63.", BinaryNumber(), false};
-            }
-
-            unsigned long long ua = static_cast<unsigned long long>(ia);
-            unsigned long long r = 0;
-            if (op == OpKind::Shl) r = (ua << ib);
-            else                  r = (ua >> ib);
+        in = std::make_unique<StreamReader>(fd);
+    }
 
-            return {true, "", BinaryNumber(static_cast<double>(static_cast<long long>(r))), true};
-        }
+    std::ios::sync_with_stdio(false);
+    if (mode == NumberMode::Bits) {
+        BitsStreamEvaluator ev(maxDepth);
+        streamAll(*in, ev);
+    } else if (mode == NumberMode::Exact) {
+        ExactStreamEvaluator ev(maxDepth);
+        streamAll(*in, ev);
+    } else {
+        StreamEvaluator ev(maxDepth);
+        streamAll(*in, ev);
+    }
+    std::cout.flush();
+    if (fd > 0) ::close(fd);
+    return 0;
+}
 
-        return {false, "Неизвестный оператор", BinaryNumber(), false};
+// Таблица истинности одного выражения сразу в stdout, для больших k.
+static int runTruth(const std::string &expr) {
+    ParseResult pr = InfixParser::toRpn(expr);
+    TruthProgram program;
+    Fault error{pr.code, pr.error};
+    if (!pr.ok || !TruthTable::compile(pr.rpn, expr, program, error)) {
+        std::cerr << "Ошибка: " << error.message << "\n";
+        return 1;
     }
+    FdStreamBuf buf(1);
+    std::ostream out(&buf);
+    TruthTable::print(program, out);
+    out.flush();
+    return 0;
+}
 
-public:
-    static EvalResult evalRpn(const std::vector<Token> &rpn) {
-        std::vector<BinaryNumber> st;
-        bool lastWasBitwise = false;
+static int runServer(const std::string &path, unsigned threads, NumberMode mode, std::size_t jitHits,
+                     ResultCache *cache) {
+    EvalServer server(path, mode, jitHits);
+    server.setCache(cache);
+    std::string error;
+    std::cerr << "Сервер слушает " << path << ", потоков: " << threads << " (остановка: Ctrl+C)\n";
+    if (!server.run(threads, error)) {
+        std::cerr << "Ошибка: " << error << "\n";
+        return 1;
+    }
+    std::cerr << "Сервер остановлен: " << server.counters().json() << "\n";
+    return 0;
+}
 
-        for (const Token &t : rpn) {
-            if (t.type == TokenType::Number) {
-                st.push_back(t.number);
-                continue;
-            }
-            if (t.type == TokenType::Op) {
-                if (t.op == OpKind::UnaryMinus) {
-                    if (st.empty()) return {false, "Ошибка: унарный '-' без аргумента", BinaryNumber(), false};
-                    BinaryNumber a = st.back(); st.pop_back();
-                    EvalResult r = applyUnary(t.op, a);
-                    if (!r.ok) return r;
-                    st.push_back(r.value);
-                    lastWasBitwise = false;
-                } else {
-                    if (st.size() < 2) return {false, "Ошибка: бинарный оператор без двух аргументов", BinaryNumber(), false};
-                    BinaryNumber b = st.back(); st.pop_back();
-                    BinaryNumber a = st.back(); st.pop_back();
-                    EvalResult r = applyBinary(t.op, a, b);
-                    if (!r.ok) return r;
-                    st.push_back(r.value);
-                    lastWasBitwise = r.isBitwiseResult;
-                }
-                continue;
-            }
-            return {false, "Ошибка: неожиданный токен в вычислении", BinaryNumber(), false};
+int main(int argc, char **argv) {
+    std::string batchPath, socketPath, streamPath, truthExpr, cachePath, statsPath;
+    bool statsSummary = false;
+    long statsSeconds = 10;
+    NumberMode mode = NumberMode::Double;
+    std::size_t jitHits = 0;
+    std::size_t maxDepth = StreamEvaluator::kDefaultMaxDepth;
+    bool interactive = isatty(0) != 0;
+    unsigned threads = std::thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--exact") == 0) {
+            mode = NumberMode::Exact;
+        } else if (std::strcmp(argv[i], "--bits") == 0) {
+            mode = NumberMode::Bits;
+        } else if (std::strcmp(argv[i], "--int") == 0 && i + 1 < argc) {
+            IntKind kind;
+            if (!parseIntKind(argv[++i], kind)) { printUsage(argv[0]); return 2; }
+            parseNumberMode(argv[i], mode);
+        } else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batchPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            streamPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--truth") == 0 && i + 1 < argc) {
+            truthExpr = argv[++i];
+        } else if (std::strcmp(argv[i], "--interactive") == 0) {
+            interactive = true;
+        } else if (std::strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cachePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) {
+            long n = std::strtol(argv[++i], nullptr, 10);
+            if (n <= 0) { printUsage(argv[0]); return 2; }
+            maxDepth = static_cast<std::size_t>(n);
+        } else if (std::strcmp(argv[i], "--jit") == 0 && i + 1 < argc) {
+            long n = std::strtol(argv[++i], nullptr, 10);
+            if (n <= 0) { printUsage(argv[0]); return 2; }
+            jitHits = static_cast<std::size_t>(n);
+        } else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            long n = std::strtol(argv[++i], nullptr, 10);
+            if (n <= 0) { printUsage(argv[0]); return 2; }
+            threads = static_cast<unsigned>(n);
+        } else if (std::strcmp(argv[i], "--stats") == 0) {
+            statsSummary = true;
+        } else if (std::strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc) {
+            statsPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--stats-interval") == 0 && i + 1 < argc) {
+            statsSeconds = std::strtol(argv[++i], nullptr, 10);
+            if (statsSeconds <= 0) { printUsage(argv[0]); return 2; }
+        } else {
+            printUsage(argv[0]);
+            return 2;
         }
+    }
 
-        if (st.size() != 1) return {false, "Ошибка: выражение не свелось к одному значению", BinaryNumber(), false};
-        return {true, "", st.back(), lastWasBitwise};
+    ChainReducer::setThreads(threads);
+    if (statsSummary || !statsPath.empty()) Stats::enable();
+    StatsReport statsReport(statsSummary, statsPath, std::chrono::seconds(statsSeconds));
+
+    int modes = !batchPath.empty() + !socketPath.empty() + !streamPath.empty() + !truthExpr.empty();
+    if (modes > 1) { printUsage(argv[0]); return 2; }
+    if (!truthExpr.empty()) return runTruth(truthExpr);
+    if (!streamPath.empty()) {
+        IntKind kind;
+        if (intKindOf(mode, kind)) { printUsage(argv[0]); return 2; }
+        return runStream(streamPath, mode, maxDepth);
     }
-};
 
-static std::vector<std::string> splitBySemicolon(const std::string &line) {
-    std::vector<std::string> parts;
-    std::string cur;
-    for (char c : line) {
-        if (c == ';') {
-            parts.push_back(cur);
-            cur.clear();
-        } else {
-            cur.push_back(c);
+    ResultCache resultCache;
+    ResultCache *cache = nullptr;
+    if (!cachePath.empty()) {
+        std::string error;
+        if (!resultCache.open(cachePath, ResultCache::kDefaultSlotBits, error)) {
+            std::cerr << "Ошибка: " << error << "\n";
+            return 1;
         }
+        cache = &resultCache;
     }
-    parts.push_back(cur);
-    return parts;
-}
 
-static std::string trim(const std::string &s) {
-    std::size_t a = 0;
-    while (a < s.size() && std::isspace(static_cast<unsigned char>(s[a]))) ++a;
-    std::size_t b = s.size();
-    while (b > a && std::isspace(static_cast<unsigned char>(s[b - 1]))) --b;
-    return s.substr(a, b - a);
-}
+    if (!socketPath.empty()) return runServer(socketPath, threads, mode, jitHits, cache);
+    if (!batchPath.empty()) return runBatch(batchPath, threads, mode, jitHits, cache);
+
+    Session session(mode);
+    session.setJitThreshold(jitHits);
+    session.setCache(cache);
+    if (!interactive) return runPipe(session);
 
-int main() {
     std::cout << "Binary Expression Calculator\n";
     std::cout << "Числа: двоичные, можно с дробью через точку (пример: 101.01)\n";
     std::cout << "Операции: + - * /  , логика: & | ^  или слова and or xor, NOT: ~ или not, сдвиги: << >>\n";
+    std::cout << "Функции: popcount clz ctz parity (x), rotl rotr pdep pext (x, y) - над 64-битным словом\n";
     std::cout << "Скобки: ( )\n";
     std::cout << "Можно несколько выражений за раз через ';'\n";
+    std::cout << "Переменные: имя = выражение, ans - последний результат, :vars - список\n";
+    std::cout << "Функции пользователя: def имя(a, b) = выражение, вызов имя(x, y) подставляет тело, :funcs - список\n";
+    std::cout << "Режим чисел: :mode double | :mode exact (точные двоичные дроби), :fracbits N - точность деления в exact\n";
+    std::cout << "Битовые векторы любой ширины: :mode bits, :width N - минимальная ширина литерала\n";
+    std::cout << "Целые фиксированной ширины: :mode u8..u64 | i8..i64 или [u32] выражение, :overflow wrap | trap\n";
+    std::cout << "Таблица истинности: :truth выражение (переменные - однобитовые входы, до 30)\n";
+    std::cout << "Выражения через ';' оптимизируются вместе (свёртка констант, общие подвыражения), :opt - статистика\n";
+    std::cout << "JIT для часто повторяемых выражений: --jit N или :jit N (после N запусков), :jit off\n";
+    if (cache) std::cout << "Кеш результатов: " << cachePath << ", :cache - статистика\n";
+    if (Stats::enabled()) std::cout << "Время по этапам (лексер, разбор, вычисление, печать): :stats\n";
     std::cout << "Выход: q\n\n";
 
     std::string line;
     while (true) {
         std::cout << "> ";
         if (!std::getline(std::cin, line)) break;
-
-        line = trim(line);
-        if (line == "q" || line == "Q") break;
-        if (line.empty()) continue;
-
-        auto parts = splitBySemicolon(line);
-        for (std::size_t idx = 0; idx < parts.size(); ++idx) {
-            std::string expr = trim(parts[idx]);
-            if (expr.empty()) continue;
-
-            ParseResult pr = InfixParser::toRpn(expr);
-            if (!pr.ok) {
-                std::cout << "Ошибка разбора: " << pr.error << "\n";
-                continue;
-            }
-
-            EvalResult er = Evaluator::evalRpn(pr.rpn);
-            if (!er.ok) {
-                std::cout << "Ошибка вычисления: " << er.error << "\n";
-                continue;
-            }
-
-            if (er.isBitwiseResult) {
-                bool okInt = false;
-                long long iv = er.value.toIntChecked(okInt);
-                (void)iv;
-                std::cout << er.value.toBinaryString(0) << "   (dec: " << er.value.toDouble() << ")\n";
-            } else {
-                std::cout << er.value.toBinaryString(12) << "   (dec: " << er.value.toDouble() << ")\n";
-            }
-        }
+        if (!handleLine(session, line, std::cout)) break;
     }
 
     std::cout << "Пока!\n";
@@ -0,0 +1,161 @@
+#ifndef BINARY_NUMBER_GUARD
+#define BINARY_NUMBER_GUARD
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bitText.h"
+
+class BinaryNumber {
+private:
+    double value;
+
+public:
+    constexpr BinaryNumber() : value(0.0) {}
+    explicit constexpr BinaryNumber(double v) : value(v) {}
+
+    constexpr double toDouble() const { return value; }
+
+    bool isInteger(double eps = 1e-12) const {
+        double r = std::round(value);
+        return std::fabs(value - r) < eps;
+    }
+
+    long long toIntChecked(bool &ok, double eps = 1e-12) const {
+        if (!isInteger(eps)) {
+            ok = false;
+            return 0;
+        }
+        ok = true;
+        return static_cast<long long>(std::llround(value));
+    }
+
+    static bool fromBinaryString(std::string_view text, BinaryNumber &out) {
+        if (text.empty()) return false;
+
+        std::size_t start = (text[0] == '-') ? 1 : 0;
+        if (start >= text.size()) return false;
+
+        std::size_t dotPos = text.find('.', start);
+        std::string_view intPartStr, fracPartStr;
+
+        if (dotPos == std::string_view::npos) {
+            intPartStr = text.substr(start);
+        } else {
+            intPartStr = text.substr(start, dotPos - start);
+            fracPartStr = text.substr(dotPos + 1);
+            if (intPartStr.empty() || fracPartStr.empty()) return false;
+        }
+
+        double intPart = 0.0, fracPart = 0.0;
+        if (!digitsToDouble(intPartStr, 0, intPart)) return false;
+        if (!digitsToDouble(fracPartStr, -static_cast<long long>(fracPartStr.size()), fracPart)) return false;
+
+        double result = intPart + fracPart;
+        if (text[0] == '-') result = -result;
+
+        out = BinaryNumber(result);
+        return true;
+    }
+
+    std::string toBinaryString(int fracBits = 12) const {
+        if (value == 0.0) return "0";
+        if (std::isnan(value)) return "nan";
+        if (std::isinf(value)) return value < 0.0 ? "-inf" : "inf";
+
+        bool neg = value < 0.0;
+        double temp = std::fabs(value);
+        double intPart = std::floor(temp);
+        double fracPart = temp - intPart;
+
+        // Целая часть double - это не более 53 значащих бит, сдвинутых на e - 53:
+        // раскладываем её по словам без деления и вставок в начало строки.
+        std::uint64_t limbs[17] = {};
+        std::size_t bits = 0;
+        if (intPart >= 18446744073709551616.0) {
+            int e = 0;
+            double m = std::frexp(intPart, &e);
+            std::uint64_t mant = static_cast<std::uint64_t>(std::ldexp(m, 53));
+            std::size_t shift = static_cast<std::size_t>(e - 53);
+            limbs[shift / 64] |= mant << (shift % 64);
+            if (shift % 64 != 0) limbs[shift / 64 + 1] |= mant >> (64 - shift % 64);
+            bits = static_cast<std::size_t>(e);
+        } else if (intPart > 0.0) {
+            limbs[0] = static_cast<std::uint64_t>(intPart);
+            bits = 64 - static_cast<std::size_t>(__builtin_clzll(limbs[0]));
+        }
+
+        std::size_t fracCap = fracBits > 0 ? static_cast<std::size_t>(fracBits) + 1 : 0;
+        std::string res(neg + (bits == 0 ? 1 : bits) + fracCap, '0');
+        char *p = &res[0];
+        if (neg) *p++ = '-';
+        if (bits == 0) {
+            ++p;
+        } else {
+            unpackBinaryDigits(limbs, bits, p);
+            p += bits;
+        }
+
+        if (fracBits > 0) {
+            *p++ = '.';
+            for (int i = 0; i < fracBits; ++i) {
+                fracPart *= 2.0;
+                int bit = static_cast<int>(fracPart);
+                if (bit == 1) { *p++ = '1'; fracPart -= 1.0; }
+                else { *p++ = '0'; }
+                if (fracPart == 0.0) break;
+            }
+        }
+        res.resize(static_cast<std::size_t>(p - res.data()));
+        return res;
+    }
+
+private:
+    // Цифры -> double со сдвигом 2^shift. До 53 значащих бит число точное и
+    // берётся из упакованного слова; длиннее - округляем по цифре, как исходный
+    // разбор (intPart * 2 + d, fracPart += 2^-i), чтобы не менять результат.
+    static bool digitsToDouble(std::string_view digits, long long shift, double &out) {
+        out = 0.0;
+        if (digits.empty()) return true;
+
+        std::size_t n = (digits.size() + 63) / 64;
+        std::uint64_t small[4] = {0, 0, 0, 0};
+        std::vector<std::uint64_t> big;
+        std::uint64_t *limbs = small;
+        if (n > 4) {
+            big.assign(n, 0);
+            limbs = big.data();
+        }
+        if (!packBinaryDigits(digits.data(), digits.size(), limbs)) return false;
+
+        constexpr std::uint64_t kExact = std::uint64_t(1) << 53;
+        if (shift == 0) {
+            std::size_t k = n;
+            while (k > 1 && limbs[k - 1] == 0) --k;
+            if (k == 1 && limbs[0] < kExact) {
+                out = static_cast<double>(limbs[0]);
+                return true;
+            }
+            double r = 0.0;
+            for (char c : digits) r = r * 2.0 + (c - '0');
+            out = r;
+            return true;
+        }
+        if (digits.size() <= 53) {
+            out = std::ldexp(static_cast<double>(limbs[0]), static_cast<int>(shift));
+            return true;
+        }
+        double r = 0.0, base = 0.5;
+        for (char c : digits) {
+            if (c == '1') r += base;
+            base *= 0.5;
+        }
+        out = r;
+        return true;
+    }
+};
+
+#endif
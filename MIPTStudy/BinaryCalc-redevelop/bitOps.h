@@ -0,0 +1,129 @@
+#ifndef BIT_OPS_GUARD
+#define BIT_OPS_GUARD
+
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define BINCALC_CPU_DISPATCH 1
+#else
+#define BINCALC_CPU_DISPATCH 0
+#endif
+
+// Битовые функции над 64-битными словами. popcount и pdep/pext выбираются
+// при первом вызове по возможностям процессора (POPCNT, BMI2), а не при
+// компиляции: один и тот же бинарник использует инструкции, если они есть,
+// и переносимый код, если нет. clz/ctz/rotl/rotr компилятор и так сводит к
+// bsr/bsf/rol/ror.
+class BitOps {
+private:
+    using Unary = unsigned (*)(std::uint64_t);
+    using Binary = std::uint64_t (*)(std::uint64_t, std::uint64_t);
+
+#if BINCALC_CPU_DISPATCH
+    __attribute__((target("popcnt"))) static unsigned popcountNative(std::uint64_t x) {
+        return static_cast<unsigned>(_mm_popcnt_u64(x));
+    }
+
+    __attribute__((target("bmi2"))) static std::uint64_t pdepNative(std::uint64_t x, std::uint64_t mask) {
+        return _pdep_u64(x, mask);
+    }
+
+    __attribute__((target("bmi2"))) static std::uint64_t pextNative(std::uint64_t x, std::uint64_t mask) {
+        return _pext_u64(x, mask);
+    }
+
+    // Строки для __builtin_cpu_supports должны быть литералами.
+    static bool hasPopcnt() { __builtin_cpu_init(); return __builtin_cpu_supports("popcnt"); }
+    static bool hasBmi2() { __builtin_cpu_init(); return __builtin_cpu_supports("bmi2"); }
+#else
+    static bool hasPopcnt() { return false; }
+    static bool hasBmi2() { return false; }
+#endif
+
+    static Unary popcountImpl() {
+#if BINCALC_CPU_DISPATCH
+        if (hasPopcnt()) return &popcountNative;
+#endif
+        return &popcountPortable;
+    }
+
+    static Binary pdepImpl() {
+#if BINCALC_CPU_DISPATCH
+        if (hasBmi2()) return &pdepNative;
+#endif
+        return &pdepPortable;
+    }
+
+    static Binary pextImpl() {
+#if BINCALC_CPU_DISPATCH
+        if (hasBmi2()) return &pextNative;
+#endif
+        return &pextPortable;
+    }
+
+public:
+    // Переносимые версии - они же для вычисления при компиляции (constExpr.h).
+    static constexpr unsigned popcountPortable(std::uint64_t x) {
+        x = x - ((x >> 1) & 0x5555555555555555ULL);
+        x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+        return static_cast<unsigned>((x * 0x0101010101010101ULL) >> 56);
+    }
+
+    // Биты x по порядку раскладываются в единичные позиции mask.
+    static constexpr std::uint64_t pdepPortable(std::uint64_t x, std::uint64_t mask) {
+        std::uint64_t r = 0;
+        for (std::uint64_t bit = 1; mask != 0; bit <<= 1) {
+            std::uint64_t low = mask & (0 - mask);
+            if (x & bit) r |= low;
+            mask ^= low;
+        }
+        return r;
+    }
+
+    // Биты x из единичных позиций mask собираются подряд в младшие разряды.
+    static constexpr std::uint64_t pextPortable(std::uint64_t x, std::uint64_t mask) {
+        std::uint64_t r = 0;
+        for (std::uint64_t bit = 1; mask != 0; bit <<= 1) {
+            std::uint64_t low = mask & (0 - mask);
+            if (x & low) r |= bit;
+            mask ^= low;
+        }
+        return r;
+    }
+
+    static unsigned popcount(std::uint64_t x) {
+        static const Unary impl = popcountImpl();
+        return impl(x);
+    }
+
+    static unsigned parity(std::uint64_t x) { return popcount(x) & 1u; }
+
+    // clz(0) = ctz(0) = 64, как у lzcnt/tzcnt.
+    static constexpr unsigned clz(std::uint64_t x) { return x == 0 ? 64 : static_cast<unsigned>(__builtin_clzll(x)); }
+    static constexpr unsigned ctz(std::uint64_t x) { return x == 0 ? 64 : static_cast<unsigned>(__builtin_ctzll(x)); }
+
+    // Поворот на n по модулю 64.
+    static constexpr std::uint64_t rotl(std::uint64_t x, std::uint64_t n) {
+        unsigned s = static_cast<unsigned>(n & 63);
+        return (x << s) | (x >> ((64 - s) & 63));
+    }
+
+    static constexpr std::uint64_t rotr(std::uint64_t x, std::uint64_t n) {
+        unsigned s = static_cast<unsigned>(n & 63);
+        return (x >> s) | (x << ((64 - s) & 63));
+    }
+
+    static std::uint64_t pdep(std::uint64_t x, std::uint64_t mask) {
+        static const Binary impl = pdepImpl();
+        return impl(x, mask);
+    }
+
+    static std::uint64_t pext(std::uint64_t x, std::uint64_t mask) {
+        static const Binary impl = pextImpl();
+        return impl(x, mask);
+    }
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef BIT_TEXT_GUARD
+#define BIT_TEXT_GUARD
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Перевод строк из '0'/'1' в 64-битные слова и обратно по словам, без
+// цикла по отдельным битам. Первый символ строки - старший бит.
+
+inline std::uint64_t reverseBits64(std::uint64_t x) {
+    x = __builtin_bswap64(x);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    x = ((x >> 2) & 0x3333333333333333ULL) | ((x & 0x3333333333333333ULL) << 2);
+    x = ((x >> 1) & 0x5555555555555555ULL) | ((x & 0x5555555555555555ULL) << 1);
+    return x;
+}
+
+// 64 символа q[0..63] -> маска, где бит j = (q[j] == '1'). false, если есть не 0/1.
+inline bool maskBinaryDigits64(const char *q, std::uint64_t &mask) {
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i one = _mm256_set1_epi8('1');
+    __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(q));
+    __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(q + 32));
+    __m256i o0 = _mm256_cmpeq_epi8(v0, one), o1 = _mm256_cmpeq_epi8(v1, one);
+    __m256i ok0 = _mm256_or_si256(o0, _mm256_cmpeq_epi8(v0, zero));
+    __m256i ok1 = _mm256_or_si256(o1, _mm256_cmpeq_epi8(v1, zero));
+    if (static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(ok0, ok1))) != 0xFFFFFFFFu) return false;
+    mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(o0)) |
+           (static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(o1))) << 32);
+    return true;
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i one = _mm_set1_epi8('1');
+    std::uint64_t m = 0;
+    for (int k = 0; k < 4; ++k) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(q + 16 * k));
+        __m128i o = _mm_cmpeq_epi8(v, one);
+        __m128i ok = _mm_or_si128(o, _mm_cmpeq_epi8(v, zero));
+        if (_mm_movemask_epi8(ok) != 0xFFFF) return false;
+        m |= static_cast<std::uint64_t>(static_cast<unsigned>(_mm_movemask_epi8(o))) << (16 * k);
+    }
+    mask = m;
+    return true;
+#else
+    std::uint64_t m = 0;
+    for (int k = 0; k < 8; ++k) {
+        std::uint64_t x;
+        std::memcpy(&x, q + 8 * k, 8);
+        x ^= 0x3030303030303030ULL;
+        if ((x & ~0x0101010101010101ULL) != 0) return false;
+        m |= ((x * 0x0102040810204080ULL) >> 56) << (8 * k);
+    }
+    mask = m;
+    return true;
+#endif
+}
+
+// n символов '0'/'1' -> (n + 63) / 64 слов, младшее слово первым. Проверяет
+// символы попутно; false при первом постороннем символе.
+inline bool packBinaryDigits(const char *p, std::size_t n, std::uint64_t *limbs) {
+    std::size_t full = n / 64;
+    const char *end = p + n;
+    for (std::size_t k = 0; k < full; ++k) {
+        std::uint64_t mask = 0;
+        if (!maskBinaryDigits64(end - 64 * (k + 1), mask)) return false;
+        limbs[k] = reverseBits64(mask);
+    }
+
+    std::size_t head = n % 64;
+    if (head != 0) {
+        std::uint64_t v = 0;
+        for (std::size_t j = 0; j < head; ++j) {
+            char c = p[j];
+            if (c != '0' && c != '1') return false;
+            v = (v << 1) | static_cast<std::uint64_t>(c - '0');
+        }
+        limbs[full] = v;
+    }
+    return true;
+}
+
+struct ByteText {
+    std::array<std::array<char, 8>, 256> text{};
+};
+
+constexpr ByteText makeByteText() {
+    ByteText t{};
+    for (int b = 0; b < 256; ++b) {
+        for (int j = 0; j < 8; ++j) t.text[b][j] = ((b >> (7 - j)) & 1) ? '1' : '0';
+    }
+    return t;
+}
+
+inline constexpr ByteText kByteText = makeByteText();
+
+// Младшие bits бит числа из слов limbs -> bits символов в out (старший первым).
+inline void unpackBinaryDigits(const std::uint64_t *limbs, std::size_t bits, char *out) {
+    std::size_t head = bits % 64;
+    std::size_t full = bits / 64;
+    if (head != 0) {
+        std::uint64_t v = limbs[full];
+        for (std::size_t j = head; j-- > 0;) *out++ = static_cast<char>('0' + ((v >> j) & 1));
+    }
+    for (std::size_t k = full; k-- > 0;) {
+        std::uint64_t v = limbs[k];
+        for (int b = 7; b >= 0; --b) {
+            std::memcpy(out, kByteText.text[(v >> (8 * b)) & 0xFF].data(), 8);
+            out += 8;
+        }
+    }
+}
+
+#endif
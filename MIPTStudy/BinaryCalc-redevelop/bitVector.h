@@ -0,0 +1,403 @@
+#ifndef BIT_VECTOR_GUARD
+#define BIT_VECTOR_GUARD
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "bitOps.h"
+#include "bitText.h"
+#include "parser.h"
+
+// Битовый вектор фиксированной ширины: width бит в 64-битных словах, младшее
+// слово первым. Биты выше width всегда нули.
+struct BitVector {
+    std::size_t width = 0;
+    std::vector<std::uint64_t> words;
+
+    static std::size_t wordsFor(std::size_t bits) { return (bits + 63) / 64; }
+
+    // Обнуляет биты старшего слова выше width.
+    void clearTail() {
+        std::size_t head = width % 64;
+        if (head != 0) words.back() &= (std::uint64_t(1) << head) - 1;
+    }
+
+    // Новая ширина: при расширении старшие биты - нули, при сужении отбрасываются.
+    void resize(std::size_t bits) {
+        width = bits;
+        words.resize(wordsFor(bits), 0);
+        clearTail();
+    }
+
+    // Ширина - число цифр, ведущие нули тоже считаются.
+    static bool fromBinaryString(std::string_view text, BitVector &out) {
+        if (text.empty()) return false;
+        out.width = text.size();
+        out.words.assign(wordsFor(text.size()), 0);
+        return packBinaryDigits(text.data(), text.size(), out.words.data());
+    }
+
+    // Ровно width цифр, с ведущими нулями.
+    std::string toBinaryString() const {
+        std::string s(width, '0');
+        unpackBinaryDigits(words.data(), width, &s[0]);
+        return s;
+    }
+
+    // false, если значение не помещается в 64 бита.
+    bool toUint64(std::uint64_t &out) const {
+        for (std::size_t k = 1; k < words.size(); ++k) {
+            if (words[k] != 0) return false;
+        }
+        out = words.empty() ? 0 : words[0];
+        return true;
+    }
+};
+
+// Побитовые операции над массивами слов: AVX2 по 4 слова, SSE2 по 2, хвост -
+// по одному. Набор инструкций выбирается при компиляции, как в columnar.h.
+class BitKernels {
+public:
+    enum class Logic { And, Or, Xor };
+
+private:
+    template <Logic op>
+    static std::uint64_t scalar(std::uint64_t a, std::uint64_t b) {
+        if constexpr (op == Logic::And) return a & b;
+        else if constexpr (op == Logic::Or) return a | b;
+        else return a ^ b;
+    }
+
+#if defined(__AVX2__)
+    template <Logic op>
+    static __m256i vector(__m256i a, __m256i b) {
+        if constexpr (op == Logic::And) return _mm256_and_si256(a, b);
+        else if constexpr (op == Logic::Or) return _mm256_or_si256(a, b);
+        else return _mm256_xor_si256(a, b);
+    }
+#elif defined(__SSE2__)
+    template <Logic op>
+    static __m128i vector(__m128i a, __m128i b) {
+        if constexpr (op == Logic::And) return _mm_and_si128(a, b);
+        else if constexpr (op == Logic::Or) return _mm_or_si128(a, b);
+        else return _mm_xor_si128(a, b);
+    }
+#endif
+
+    template <Logic op>
+    static void apply(const std::uint64_t *a, const std::uint64_t *b, std::uint64_t *out, std::size_t n) {
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), vector<op>(x, y));
+        }
+#elif defined(__SSE2__)
+        for (; i + 2 <= n; i += 2) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), vector<op>(x, y));
+        }
+#endif
+        for (; i < n; ++i) out[i] = scalar<op>(a[i], b[i]);
+    }
+
+public:
+    // out может совпадать с a или b.
+    static void logic(Logic op, const std::uint64_t *a, const std::uint64_t *b, std::uint64_t *out, std::size_t n) {
+        if (op == Logic::And) apply<Logic::And>(a, b, out, n);
+        else if (op == Logic::Or) apply<Logic::Or>(a, b, out, n);
+        else apply<Logic::Xor>(a, b, out, n);
+    }
+
+    static void invert(const std::uint64_t *a, std::uint64_t *out, std::size_t n) {
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        const __m256i ones = _mm256_set1_epi64x(-1);
+        for (; i + 4 <= n; i += 4) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_xor_si256(x, ones));
+        }
+#elif defined(__SSE2__)
+        const __m128i ones = _mm_set1_epi64x(-1);
+        for (; i + 2 <= n; i += 2) {
+            __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_xor_si128(x, ones));
+        }
+#endif
+        for (; i < n; ++i) out[i] = ~a[i];
+    }
+
+    // out[i] = src[i - k] << s | src[i - k - 1] >> (64 - s): биты, ушедшие из
+    // слова, переносятся в следующее. Векторный сдвиг на 64 даёт 0, поэтому
+    // s == 0 особым случаем нужен только в скалярном хвосте. out != src.
+    static void shiftLeft(const std::uint64_t *src, std::uint64_t *out, std::size_t n, std::uint64_t count) {
+        std::size_t k = count / 64 < n ? static_cast<std::size_t>(count / 64) : n;
+        unsigned s = static_cast<unsigned>(count % 64);
+        for (std::size_t i = 0; i < k; ++i) out[i] = 0;
+        if (k == n) return;
+        out[k] = src[0] << s;
+        std::size_t i = k + 1;
+#if defined(__AVX2__)
+        const __m128i sl = _mm_cvtsi32_si128(static_cast<int>(s)), sr = _mm_cvtsi32_si128(static_cast<int>(64 - s));
+        for (; i + 4 <= n; i += 4) {
+            __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i - k));
+            __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i - k - 1));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                                _mm256_or_si256(_mm256_sll_epi64(lo, sl), _mm256_srl_epi64(hi, sr)));
+        }
+#elif defined(__SSE2__)
+        const __m128i sl = _mm_cvtsi32_si128(static_cast<int>(s)), sr = _mm_cvtsi32_si128(static_cast<int>(64 - s));
+        for (; i + 2 <= n; i += 2) {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i - k));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i - k - 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_or_si128(_mm_sll_epi64(lo, sl), _mm_srl_epi64(hi, sr)));
+        }
+#endif
+        for (; i < n; ++i) out[i] = (src[i - k] << s) | (s ? src[i - k - 1] >> (64 - s) : 0);
+    }
+
+    // out[i] = src[i + k] >> s | src[i + k + 1] << (64 - s). out != src.
+    static void shiftRight(const std::uint64_t *src, std::uint64_t *out, std::size_t n, std::uint64_t count) {
+        std::size_t k = count / 64 < n ? static_cast<std::size_t>(count / 64) : n;
+        unsigned s = static_cast<unsigned>(count % 64);
+        for (std::size_t i = n - k; i < n; ++i) out[i] = 0;
+        if (k == n) return;
+        std::size_t last = n - k - 1;  // у этого слова переноса сверху нет
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        const __m128i sr = _mm_cvtsi32_si128(static_cast<int>(s)), sl = _mm_cvtsi32_si128(static_cast<int>(64 - s));
+        for (; i + 4 <= last; i += 4) {
+            __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + k));
+            __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + k + 1));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i),
+                                _mm256_or_si256(_mm256_srl_epi64(lo, sr), _mm256_sll_epi64(hi, sl)));
+        }
+#elif defined(__SSE2__)
+        const __m128i sr = _mm_cvtsi32_si128(static_cast<int>(s)), sl = _mm_cvtsi32_si128(static_cast<int>(64 - s));
+        for (; i + 2 <= last; i += 2) {
+            __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + k));
+            __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + k + 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_or_si128(_mm_srl_epi64(lo, sr), _mm_sll_epi64(hi, sl)));
+        }
+#endif
+        for (; i < last; ++i) out[i] = (src[i + k] >> s) | (s ? src[i + k + 1] << (64 - s) : 0);
+        out[last] = src[n - 1] >> s;
+    }
+};
+
+struct BitsResult {
+    bool ok = false;
+    std::string error;
+    BitVector value;
+    ErrorCode code = ErrorCode::None;
+};
+
+// Режим bits: тот же RPN, значения - BitVector. Ширина литерала - число его
+// цифр, но не меньше minWidth (:width). & | ^ дополняют более узкий аргумент
+// нулями до ширины более широкого, ~ инвертирует ровно width бит, << и >>
+// сохраняют ширину левого аргумента (выдвинутые биты теряются). Функции:
+// rotl/rotr поворачивают в пределах ширины, popcount/clz/ctz считают в её
+// пределах, pdep/pext работают с вектором любой ширины по 64-битным словам.
+class BitsEvaluator {
+public:
+    static constexpr std::size_t kMaxWidth = std::size_t(1) << 32;
+
+private:
+    // Тексты без кода ошибки (ширина, литералы, операции режима).
+    static BitsResult failure(const std::string &err) {
+        return {false, err, BitVector()};
+    }
+
+    static BitsResult failure(ErrorCode code) {
+        return {false, errorText(code), BitVector(), code};
+    }
+
+    static bool literal(const Token &t, std::string_view source, std::size_t minWidth, BitVector &out,
+                        std::string &err) {
+        std::string_view text = t.text(source);
+        if (text.size() > kMaxWidth) {
+            err = "Ширина больше " + std::to_string(kMaxWidth) + " бит";
+            return false;
+        }
+        if (!BitVector::fromBinaryString(text, out)) {
+            err = "В режиме bits числа - только целые двоичные литералы: '" + std::string(text) + "'";
+            return false;
+        }
+        if (out.width < minWidth) out.resize(minWidth);
+        return true;
+    }
+
+    // Счётчик 0..width - вектор наименьшей ширины, в которую помещается width.
+    static BitVector counter(std::size_t value, std::size_t width) {
+        std::size_t bits = 1;
+        while (bits < 64 && (width >> bits) != 0) ++bits;
+        BitVector v;
+        v.resize(bits);
+        v.words[0] = value;
+        return v;
+    }
+
+    // popcount, parity, clz, ctz - в пределах width.
+    static BitVector applyCount(OpKind op, const BitVector &a) {
+        std::size_t ones = 0, low = a.width, high = 0;
+        for (std::size_t k = 0; k < a.words.size(); ++k) {
+            std::uint64_t w = a.words[k];
+            ones += BitOps::popcount(w);
+            if (w == 0) continue;
+            if (low == a.width) low = k * 64 + BitOps::ctz(w);
+            high = k * 64 + 64 - BitOps::clz(w);
+        }
+        if (op == OpKind::Popcount) return counter(ones, a.width);
+        if (op == OpKind::Parity) return counter(ones & 1, 1);
+        if (op == OpKind::Ctz) return counter(low, a.width);
+        return counter(a.width - high, a.width);
+    }
+
+    static std::uint64_t modulo(const BitVector &b, std::uint64_t m) {
+        unsigned __int128 r = 0;
+        for (std::size_t k = b.words.size(); k-- > 0;) r = ((r << 64) | b.words[k]) % m;
+        return static_cast<std::uint64_t>(r);
+    }
+
+    // Поворот в пределах ширины a на b mod width.
+    static void rotate(OpKind op, BitVector &a, BitVector &b) {
+        std::uint64_t n = modulo(b, a.width);
+        if (n == 0) return;
+        if (op == OpKind::Rotr) n = a.width - n;
+        std::size_t words = a.words.size();
+        b.width = a.width;
+        b.words.resize(words);
+        std::vector<std::uint64_t> high(words);
+        BitKernels::shiftLeft(a.words.data(), b.words.data(), words, n);
+        BitKernels::shiftRight(a.words.data(), high.data(), words, a.width - n);
+        BitKernels::logic(BitKernels::Logic::Or, b.words.data(), high.data(), a.words.data(), words);
+        a.clearTail();
+    }
+
+    // 64 бита w начиная с бита pos, за концом - нули.
+    static std::uint64_t chunk(const std::vector<std::uint64_t> &w, std::size_t pos) {
+        std::size_t k = pos / 64;
+        unsigned s = static_cast<unsigned>(pos % 64);
+        if (k >= w.size()) return 0;
+        std::uint64_t v = w[k] >> s;
+        if (s != 0 && k + 1 < w.size()) v |= w[k + 1] << (64 - s);
+        return v;
+    }
+
+    // pdep/pext по словам маски через BitOps: у каждого слова маски своя
+    // порция бит, смещение порции - сумма popcount предыдущих слов.
+    static void deposit(OpKind op, BitVector &a, const BitVector &mask) {
+        std::vector<std::uint64_t> out(a.words.size(), 0);
+        std::size_t pos = 0;
+        for (std::size_t k = 0; k < mask.words.size(); ++k) {
+            std::uint64_t m = mask.words[k];
+            unsigned cnt = BitOps::popcount(m);
+            if (op == OpKind::Pdep) {
+                out[k] = BitOps::pdep(chunk(a.words, pos), m);
+            } else {
+                std::uint64_t bits = BitOps::pext(a.words[k], m);
+                unsigned s = static_cast<unsigned>(pos % 64);
+                out[pos / 64] |= bits << s;
+                if (s != 0 && s + cnt > 64) out[pos / 64 + 1] |= bits >> (64 - s);
+            }
+            pos += cnt;
+        }
+        a.words.swap(out);
+    }
+
+public:
+    // Ядра над значениями, для вычислителей вне RPN (streamEvaluator.h).
+    static bool applyUnary(OpKind op, BitVector &a, std::string &err) {
+        if (op == OpKind::Not) {
+            BitKernels::invert(a.words.data(), a.words.data(), a.words.size());
+            a.clearTail();
+            return true;
+        }
+        if (functionArity(op) == 1) {
+            a = applyCount(op, a);
+            return true;
+        }
+        err = "В режиме bits доступны только & | ^ ~ << >> (and, or, xor, not) и битовые функции";
+        return false;
+    }
+
+    static bool applyBinary(OpKind op, BitVector &a, BitVector &b, std::string &err) {
+        if (op == OpKind::Rotl || op == OpKind::Rotr) {
+            rotate(op, a, b);
+            return true;
+        }
+        if (op == OpKind::Pdep || op == OpKind::Pext) {
+            if (a.width < b.width) a.resize(b.width);
+            if (b.width < a.width) b.resize(a.width);
+            deposit(op, a, b);
+            return true;
+        }
+        if (op == OpKind::And || op == OpKind::Or || op == OpKind::Xor) {
+            if (a.width < b.width) a.resize(b.width);
+            if (b.width < a.width) b.resize(a.width);
+            BitKernels::Logic l = op == OpKind::And ? BitKernels::Logic::And
+                                : op == OpKind::Or  ? BitKernels::Logic::Or
+                                                    : BitKernels::Logic::Xor;
+            BitKernels::logic(l, a.words.data(), b.words.data(), a.words.data(), a.words.size());
+            return true;
+        }
+        if (op == OpKind::Shl || op == OpKind::Shr) {
+            std::uint64_t n = 0;
+            if (!b.toUint64(n)) n = a.width;  // всё равно больше ширины
+            b.width = a.width;
+            b.words.resize(a.words.size());
+            if (op == OpKind::Shl) BitKernels::shiftLeft(a.words.data(), b.words.data(), a.words.size(), n);
+            else BitKernels::shiftRight(a.words.data(), b.words.data(), a.words.size(), n);
+            std::swap(a, b);
+            a.clearTail();
+            return true;
+        }
+        err = "В режиме bits доступны только & | ^ ~ << >> (and, or, xor, not) и битовые функции";
+        return false;
+    }
+
+    static BitsResult evalRpn(const std::vector<Token> &rpn, std::string_view source, std::size_t minWidth = 0) {
+        std::vector<BitVector> st;
+        std::string err;
+
+        for (const Token &t : rpn) {
+            if (t.type == TokenType::Number) {
+                BitVector v;
+                if (!literal(t, source, minWidth, v, err)) return failure(err);
+                st.push_back(std::move(v));
+                continue;
+            }
+            if (t.type == TokenType::Ident) {
+                return failure("Переменные недоступны в режиме bits: '" + std::string(t.text(source)) + "'");
+            }
+            if (t.type == TokenType::Op) {
+                if (operandCount(t.op) == 1) {
+                    if (st.empty()) {
+                        return failure(t.op == OpKind::Not ? ErrorCode::NotNoArg : ErrorCode::UnaryNoArg);
+                    }
+                    if (!applyUnary(t.op, st.back(), err)) return failure(err);
+                    continue;
+                }
+                if (st.size() < 2) return failure(ErrorCode::BinaryNoArgs);
+                BitVector b = std::move(st.back());
+                st.pop_back();
+                if (!applyBinary(t.op, st.back(), b, err)) return failure(err);
+                continue;
+            }
+            return failure(ErrorCode::EvalUnexpectedToken);
+        }
+
+        if (st.size() != 1) return failure(ErrorCode::NotReduced);
+        return {true, "", std::move(st.back())};
+    }
+};
+
+#endif
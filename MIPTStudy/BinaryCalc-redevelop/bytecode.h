@@ -0,0 +1,285 @@
+#ifndef BYTECODE_GUARD
+#define BYTECODE_GUARD
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "evaluator.h"
+#include "environment.h"
+#include "userFunctions.h"
+
+// Скомпилированная форма выражения: RPN превращается в плоскую программу
+// для стековой VM. Ядра операций берутся из Evaluator, поэтому семантика
+// (включая тексты ошибок и порядок их появления) та же, что у evalRpn.
+
+enum class OpCode : std::uint8_t {
+    PushConst,    // push consts[arg]
+    PushVar,      // push значение переменной vars[arg]
+    Unary,        // top = un(top)
+    Binary,       // b = pop; top = fn(top, b)
+    BinaryConst,  // PushConst + Binary: top = fn(top, consts[arg])
+    BinaryPair,   // два бинарных подряд (например << и &): c = pop; b = pop; top = fn2(top, fn(b, c))
+    Fail,         // ошибка с кодом ErrorCode(arg)
+    Halt
+};
+
+struct Instr {
+    OpCode code = OpCode::Halt;
+    std::uint32_t arg = 0;
+    UnaryKernel un = nullptr;
+    BinaryKernel fn = nullptr;
+    BinaryKernel fn2 = nullptr;
+};
+
+class JitCode;
+
+struct Program {
+    bool parsed = false;
+    Fault parseError;
+    std::vector<Instr> code;
+    std::vector<double> consts;
+    std::vector<std::string> vars;
+    std::size_t maxDepth = 0;
+    bool isBitwiseResult = false;
+
+    // Для JitTier: число запусков и машинный код, если выражение горячее.
+    std::size_t hits = 0;
+    bool jitFailed = false;
+    std::shared_ptr<const JitCode> native;
+};
+
+class BytecodeCompiler {
+private:
+    static void emit(Program &p, OpCode code, std::uint32_t arg = 0) {
+        Instr in;
+        in.code = code;
+        in.arg = arg;
+        p.code.push_back(in);
+    }
+
+    static void fail(Program &p, ErrorCode code) {
+        emit(p, OpCode::Fail, static_cast<std::uint32_t>(code));
+    }
+
+    static void emitBinary(Program &p, BinaryKernel k) {
+        if (!p.code.empty()) {
+            Instr &last = p.code.back();
+            if (last.code == OpCode::PushConst) {
+                last.code = OpCode::BinaryConst;
+                last.fn = k;
+                return;
+            }
+            if (last.code == OpCode::Binary) {
+                last.code = OpCode::BinaryPair;
+                last.fn2 = k;
+                return;
+            }
+        }
+        emit(p, OpCode::Binary);
+        p.code.back().fn = k;
+    }
+
+public:
+    // functions - подставлять вызовы функций пользователя (nullptr - без них).
+    static Program compile(const std::string &expr, const FunctionLibrary *functions = nullptr) {
+        ParseResult pr = parseWithFunctions(functions, expr);
+        if (!pr.ok) {
+            Program p;
+            p.parseError = {pr.code, pr.error};
+            return p;
+        }
+        return fromRpn(pr.rpn, pr.source(expr));
+    }
+
+    // source нужен для имён переменных (токены хранят только позиции).
+    static Program fromRpn(const std::vector<Token> &rpn, std::string_view source) {
+        Program p;
+        p.parsed = true;
+
+        std::size_t depth = 0;
+        bool lastWasBitwise = false;
+
+        for (const Token &t : rpn) {
+            if (t.type == TokenType::Number) {
+                p.consts.push_back(t.number.toDouble());
+                emit(p, OpCode::PushConst, static_cast<std::uint32_t>(p.consts.size() - 1));
+                ++depth;
+                if (depth > p.maxDepth) p.maxDepth = depth;
+                continue;
+            }
+            if (t.type == TokenType::Ident) {
+                std::string_view name = t.text(source);
+                std::size_t slot = 0;
+                while (slot < p.vars.size() && p.vars[slot] != name) ++slot;
+                if (slot == p.vars.size()) p.vars.emplace_back(name);
+                emit(p, OpCode::PushVar, static_cast<std::uint32_t>(slot));
+                ++depth;
+                if (depth > p.maxDepth) p.maxDepth = depth;
+                continue;
+            }
+            if (t.type == TokenType::Op) {
+                if (Evaluator::isUnary(t.op)) {
+                    if (depth == 0) { fail(p, Evaluator::missingArgument(t.op)); return p; }
+                    emit(p, OpCode::Unary);
+                    p.code.back().un = Evaluator::unaryKernel(t.op);
+                    lastWasBitwise = Evaluator::isBitwise(t.op);
+                    continue;
+                }
+                if (depth < 2) { fail(p, ErrorCode::BinaryNoArgs); return p; }
+                BinaryKernel k = Evaluator::binaryKernel(t.op);
+                if (!k) { fail(p, ErrorCode::UnknownOperator); return p; }
+                emitBinary(p, k);
+                --depth;
+                lastWasBitwise = Evaluator::isBitwise(t.op);
+                continue;
+            }
+            fail(p, ErrorCode::EvalUnexpectedToken);
+            return p;
+        }
+
+        if (depth != 1) {
+            fail(p, ErrorCode::NotReduced);
+            return p;
+        }
+        emit(p, OpCode::Halt);
+        p.isBitwiseResult = lastWasBitwise;
+        return p;
+    }
+};
+
+// Стек VM переиспользуется между вызовами: после прогрева run() не выделяет память.
+class BytecodeVm {
+private:
+    std::vector<double> stack;
+    std::vector<double> varValues;
+
+    static EvalResult failure(ErrorCode code) {
+        return {false, errorText(code), BinaryNumber(), false, code};
+    }
+
+    // Ядра отдают текст из errorText: код по нему находится сравнением указателей.
+    static EvalResult failure(const char *err) { return failure(codeOf(err)); }
+
+    static EvalResult failure(Fault &&f) {
+        return {false, std::move(f.message), BinaryNumber(), false, f.code};
+    }
+
+public:
+    // Значения переменных программы по слотам; false + fail при ошибке.
+    bool loadVariables(const Program &p, Environment *env, EvalResult &fail) {
+        if (p.vars.empty()) return true;
+        if (varValues.size() < p.vars.size()) varValues.resize(p.vars.size());
+        for (std::size_t k = 0; k < p.vars.size(); ++k) {
+            Fault verr;
+            double v = 0.0;
+            if (!env) { fail = failure(unknownVariable(p.vars[k])); return false; }
+            if (!env->lookupDouble(p.vars[k], v, verr)) { fail = failure(std::move(verr)); return false; }
+            varValues[k] = v;
+        }
+        return true;
+    }
+
+    const double *variables() const { return varValues.data(); }
+
+    // Переменные читаются из env один раз перед выполнением.
+    EvalResult run(const Program &p, Environment *env = nullptr) {
+        if (stack.size() < p.maxDepth) stack.resize(p.maxDepth);
+        EvalResult fail;
+        if (!loadVariables(p, env, fail)) return fail;
+
+        double *sp = stack.data();
+        const double *consts = p.consts.data();
+        const char *err = nullptr;
+
+        for (const Instr *ip = p.code.data();; ++ip) {
+            switch (ip->code) {
+                case OpCode::PushConst:
+                    *sp++ = consts[ip->arg];
+                    break;
+                case OpCode::PushVar:
+                    *sp++ = varValues[ip->arg];
+                    break;
+                case OpCode::Unary:
+                    if (!ip->un(sp[-1], sp[-1], err)) return failure(err);
+                    break;
+                case OpCode::Binary:
+                    --sp;
+                    if (!ip->fn(sp[-1], sp[0], sp[-1], err)) return failure(err);
+                    break;
+                case OpCode::BinaryConst:
+                    if (!ip->fn(sp[-1], consts[ip->arg], sp[-1], err)) return failure(err);
+                    break;
+                case OpCode::BinaryPair: {
+                    double r = 0.0;
+                    sp -= 2;
+                    if (!ip->fn(sp[0], sp[1], r, err)) return failure(err);
+                    if (!ip->fn2(sp[-1], r, sp[-1], err)) return failure(err);
+                    break;
+                }
+                case OpCode::Fail:
+                    return failure(static_cast<ErrorCode>(ip->arg));
+                case OpCode::Halt:
+                    return {true, "", BinaryNumber(stack[0]), p.isBitwiseResult};
+            }
+        }
+    }
+};
+
+// LRU-кэш скомпилированных программ по тексту выражения: повторное выражение
+// не проходит ни лексер, ни парсер. Ошибки разбора кэшируются тоже.
+class PlanCache {
+private:
+    struct Entry {
+        std::string key;
+        Program program;
+    };
+
+    std::size_t capacity;
+    std::list<Entry> lru;
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+    std::size_t hitCount = 0;
+    std::size_t missCount = 0;
+
+public:
+    explicit PlanCache(std::size_t cap = 4096) : capacity(cap == 0 ? 1 : cap) {}
+
+    // Уже скомпилированная программа или nullptr, без компиляции.
+    Program *find(const std::string &expr) {
+        auto it = index.find(std::string_view(expr));
+        if (it == index.end()) return nullptr;
+        ++hitCount;
+        lru.splice(lru.begin(), lru, it->second);
+        return &it->second->program;
+    }
+
+    Program &get(const std::string &expr, const FunctionLibrary *functions = nullptr) {
+        if (Program *p = find(expr)) return *p;
+
+        ++missCount;
+        lru.push_front(Entry{expr, BytecodeCompiler::compile(expr, functions)});
+        index.emplace(std::string_view(lru.front().key), lru.begin());
+
+        if (lru.size() > capacity) {
+            index.erase(std::string_view(lru.back().key));
+            lru.pop_back();
+        }
+        return lru.front().program;
+    }
+
+    // Программы с подставленными функциями устаревают при их переопределении.
+    void clear() {
+        index.clear();
+        lru.clear();
+    }
+
+    std::size_t hits() const { return hitCount; }
+    std::size_t misses() const { return missCount; }
+    std::size_t size() const { return lru.size(); }
+};
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef CHAIN_REDUCE_GUARD
+#define CHAIN_REDUCE_GUARD
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "lexer.h"
+
+// Длинная цепочка одного оператора в RPN: t0 t1 op t2 op ... tn op, то есть
+// ((t0 op t1) op t2) ... Операнды - любые поддеревья, терм k занимает токены
+// first[k]..last[k]. Если op ассоциативен, цепочку можно свернуть блоками
+// параллельно и получить то же значение, что и последовательно.
+struct OperatorChain {
+    OpKind op = OpKind::Add;
+    std::size_t begin = 0;  // первый токен t0
+    std::size_t end = 0;    // последний op цепочки
+    std::vector<std::size_t> first;
+    std::vector<std::size_t> last;
+
+    std::size_t terms() const { return first.size(); }
+};
+
+class ChainFinder {
+public:
+    // Короче - последовательно: запуск потоков дороже самой свёртки.
+    static constexpr std::size_t kMinTerms = std::size_t(1) << 16;
+
+    // Внешние цепочки из операторов, для которых accept(op) == true, не
+    // короче minTerms, по возрастанию begin. Цепочки внутри термов не ищутся:
+    // терм считается последовательно. Для RPN с нехваткой операндов - пусто,
+    // ошибку найдёт обычный проход.
+    template <typename Accept>
+    static std::vector<OperatorChain> find(const std::vector<Token> &rpn, Accept accept,
+                                           std::size_t minTerms = kMinTerms) {
+        std::vector<OperatorChain> chains;
+        if (minTerms < 2 || rpn.size() < 2 * minTerms - 1) return chains;
+
+        // start[i] - первый токен поддерева, которое кончается на i;
+        // у бинарного оператора split[i] - первый токен правого операнда.
+        std::size_t n = rpn.size();
+        std::vector<std::size_t> start(n), split(n, 0), open;
+        for (std::size_t i = 0; i < n; ++i) {
+            const Token &t = rpn[i];
+            if (t.type != TokenType::Op) {
+                open.push_back(i);
+            } else if (operandCount(t.op) == 1) {
+                if (open.empty()) return chains;
+            } else {
+                if (open.size() < 2) return chains;
+                split[i] = open.back();
+                open.pop_back();
+            }
+            start[i] = t.type == TokenType::Op ? open.back() : i;
+        }
+
+        // Сверху вниз: первый найденный оператор цепочки - её вершина. Всю
+        // левую ветвь вершины (и короткой цепочки тоже) второй раз не обходим.
+        std::vector<char> seen(n, 0);
+        for (std::size_t i = n; i-- > 0;) {
+            const Token &t = rpn[i];
+            if (seen[i] || t.type != TokenType::Op || operandCount(t.op) != 2 || !accept(t.op)) continue;
+
+            OperatorChain c;
+            c.op = t.op;
+            c.end = i;
+            std::size_t j = i;
+            while (rpn[j].type == TokenType::Op && rpn[j].op == c.op) {
+                seen[j] = 1;
+                c.first.push_back(split[j]);
+                c.last.push_back(j - 1);
+                j = split[j] - 1;
+            }
+            c.first.push_back(start[j]);
+            c.last.push_back(j);
+            if (c.terms() < minTerms) continue;
+
+            std::reverse(c.first.begin(), c.first.end());
+            std::reverse(c.last.begin(), c.last.end());
+            c.begin = c.first[0];
+            i = c.begin;
+            chains.push_back(std::move(c));
+        }
+        std::reverse(chains.begin(), chains.end());
+        return chains;
+    }
+};
+
+// Ошибка терма при свёртке. Последовательный проход ((t0 op t1) op t2) ...
+// вычисляет терм k и сразу применяет op, поэтому первой он встретит ошибку
+// с наименьшим rank(): ошибка вычисления терма k - (k, 0), недопустимый для
+// op операнд k - (max(k, 1), 1), ведь t0 проверяется вместе с t1.
+struct ChainFault {
+    std::size_t term = 0;
+    bool operand = false;
+
+    std::size_t rank() const { return 2 * std::max<std::size_t>(term, operand ? 1 : 0) + (operand ? 1 : 0); }
+    bool before(const ChainFault &o) const { return rank() < o.rank(); }
+};
+
+class ChainReducer {
+private:
+    static std::atomic<unsigned> &limit() {
+        static std::atomic<unsigned> threads{0};
+        return threads;
+    }
+
+public:
+    static constexpr std::size_t kMinBlock = std::size_t(1) << 12;
+
+    // Потоков на одну свёртку; 0 - по числу ядер.
+    static void setThreads(unsigned n) { limit().store(n, std::memory_order_relaxed); }
+
+    // Термы 0..count-1 делятся на подряд идущие блоки, work(lo, hi, part)
+    // сворачивает блок в part в своём потоке. Частичные результаты - по
+    // порядку блоков; их склеивает вызывающий, тоже по порядку.
+    template <typename Part, typename Work>
+    static std::vector<Part> blocks(std::size_t count, Work work) {
+        std::size_t threads = limit().load(std::memory_order_relaxed);
+        if (threads == 0) threads = std::thread::hardware_concurrency();
+        threads = std::max<std::size_t>(1, std::min(threads, count / kMinBlock));
+        std::vector<Part> parts(threads);
+        std::vector<std::thread> pool;
+        for (std::size_t b = 1; b < threads; ++b) {
+            pool.emplace_back([&, b] { work(count * b / threads, count * (b + 1) / threads, parts[b]); });
+        }
+        work(0, count / threads, parts[0]);
+        for (std::thread &t : pool) t.join();
+        return parts;
+    }
+};
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef COLUMNAR_GUARD
+#define COLUMNAR_GUARD
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "bytecode.h"
+
+// Колоночное вычисление: одно выражение компилируется один раз, переменные
+// (плейсхолдеры) привязываются к массивам uint64_t/double, и каждая операция
+// проходит сразу по куску из kChunk строк. Строки с ошибкой (деление на ноль,
+// сдвиг вне диапазона...) не прерывают пакет: в errors[row] пишется
+// ErrorCode первой ошибки строки (None - ошибки нет), текст - errorText(code).
+// Значения uint64_t больше 2^53 в double не помещаются точно: такие строки
+// получают ColumnInexact, а не округлённый ответ.
+
+enum class ColumnType : std::uint8_t { U64, F64 };
+
+class ColumnProgram {
+public:
+    struct Step {
+        enum Kind : std::uint8_t { Load, Const, Neg, Unary, Binary } kind = Const;
+        OpKind op = OpKind::Add;
+        std::uint32_t dst = 0;
+        std::uint32_t var = 0;
+        double value = 0.0;
+    };
+
+    std::vector<Step> steps;
+    std::vector<std::string> placeholders;
+    std::size_t depth = 0;
+    bool isBitwiseResult = false;
+
+    // Ошибки разбора и арности - сразу, как у BytecodeCompiler (для всего пакета).
+    static bool compile(const std::string &expr, ColumnProgram &out, std::string &err) {
+        ParseResult pr = InfixParser::toRpn(expr);
+        if (!pr.ok) { err = pr.error; return false; }
+        Program p = BytecodeCompiler::fromRpn(pr.rpn, expr);
+        for (const Instr &in : p.code) {
+            if (in.code == OpCode::Fail) { err = errorText(static_cast<ErrorCode>(in.arg)); return false; }
+        }
+
+        out = ColumnProgram();
+        out.placeholders = p.vars;
+        out.isBitwiseResult = p.isBitwiseResult;
+        std::uint32_t depth = 0;
+        for (const Token &t : pr.rpn) {
+            Step s;
+            if (t.type == TokenType::Number) {
+                s.kind = Step::Const;
+                s.value = t.number.toDouble();
+                s.dst = depth++;
+            } else if (t.type == TokenType::Ident) {
+                std::string_view name = t.text(expr);
+                s.kind = Step::Load;
+                while (out.placeholders[s.var] != name) ++s.var;
+                s.dst = depth++;
+            } else if (Evaluator::isUnary(t.op)) {
+                s.kind = t.op == OpKind::UnaryMinus ? Step::Neg : Step::Unary;
+                s.op = t.op;
+                s.dst = depth - 1;
+            } else {
+                s.kind = Step::Binary;
+                s.op = t.op;
+                s.dst = --depth - 1;
+            }
+            out.steps.push_back(s);
+            if (depth > out.depth) out.depth = depth;
+        }
+        return true;
+    }
+};
+
+class ColumnEvaluator {
+public:
+    static constexpr std::size_t kChunk = 1024;
+
+private:
+    struct Binding {
+        const void *data = nullptr;
+        ColumnType type = ColumnType::F64;
+    };
+
+    std::unordered_map<std::string, Binding> bindings;
+    std::vector<double> regs;
+
+    static void fail(std::uint8_t &err, ErrorCode code) {
+        if (err == 0) err = static_cast<std::uint8_t>(code);
+    }
+
+    // Строка, которую быстрый путь не взял: считаем ядром Evaluator.
+    static void scalar(BinaryKernel k, double a, double b, double &r, std::uint8_t &err) {
+        const char *fault = nullptr;
+        if (!k(a, b, r, fault)) fail(err, codeOf(fault));
+    }
+
+    static void load(const Binding &b, std::size_t from, std::size_t n, double *dst, std::uint8_t *err) {
+        if (b.type == ColumnType::F64) {
+            std::memcpy(dst, static_cast<const double *>(b.data) + from, n * sizeof(double));
+            return;
+        }
+        const std::uint64_t *src = static_cast<const std::uint64_t *>(b.data) + from;
+        for (std::size_t i = 0; i < n; ++i) {
+            dst[i] = static_cast<double>(src[i]);
+            if (src[i] > (std::uint64_t(1) << 53)) fail(err[i], ErrorCode::ColumnInexact);
+        }
+    }
+
+#if defined(__AVX2__)
+    // x - точное целое 0 <= x < 2^52: тогда x + 2^52 хранит его в младших битах мантиссы.
+    static __m256i exactInt(__m256d x, __m256d &ok) {
+        const __m256d magic = _mm256_set1_pd(4503599627370496.0);
+        __m256d t = _mm256_add_pd(x, magic);
+        ok = _mm256_and_pd(ok, _mm256_cmp_pd(_mm256_sub_pd(t, magic), x, _CMP_EQ_OQ));
+        ok = _mm256_and_pd(ok, _mm256_cmp_pd(x, _mm256_setzero_pd(), _CMP_GE_OQ));
+        ok = _mm256_and_pd(ok, _mm256_cmp_pd(x, magic, _CMP_LT_OQ));
+        return _mm256_and_si256(_mm256_castpd_si256(t), _mm256_set1_epi64x((1LL << 52) - 1));
+    }
+
+    static __m256d fromInt(__m256i v) {
+        const __m256d magic = _mm256_set1_pd(4503599627370496.0);
+        return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(v, _mm256_castpd_si256(magic))), magic);
+    }
+
+    // Четыре строки; false - хотя бы одну надо досчитать скалярно (маска в slow).
+    template <OpKind op>
+    static bool vector4(const double *a, const double *b, double *r, int &slow) {
+        __m256d x = _mm256_loadu_pd(a), y = _mm256_loadu_pd(b);
+        __m256d ok = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        __m256d res;
+        if constexpr (op == OpKind::Add) {
+            res = _mm256_add_pd(x, y);
+        } else if constexpr (op == OpKind::Sub) {
+            res = _mm256_sub_pd(x, y);
+        } else if constexpr (op == OpKind::Mul) {
+            res = _mm256_mul_pd(x, y);
+        } else if constexpr (op == OpKind::Div) {
+            __m256d absY = _mm256_andnot_pd(_mm256_set1_pd(-0.0), y);
+            ok = _mm256_cmp_pd(absY, _mm256_set1_pd(1e-12), _CMP_GE_OQ);
+            res = _mm256_div_pd(x, y);
+        } else {
+            __m256i ix = exactInt(x, ok), iy = exactInt(y, ok);
+            __m256i ir;
+            if constexpr (op == OpKind::And) ir = _mm256_and_si256(ix, iy);
+            else if constexpr (op == OpKind::Or) ir = _mm256_or_si256(ix, iy);
+            else if constexpr (op == OpKind::Xor) ir = _mm256_xor_si256(ix, iy);
+            else if constexpr (op == OpKind::Shr) {
+                ok = _mm256_andnot_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(iy, _mm256_set1_epi64x(63))), ok);
+                ir = _mm256_srlv_epi64(ix, iy);
+            } else {
+                // Результат << должен остаться < 2^52: сдвиг <= 52 и x < 2^(52 - n).
+                __m256i big = _mm256_cmpgt_epi64(iy, _mm256_set1_epi64x(52));
+                __m256i lost = _mm256_srlv_epi64(ix, _mm256_sub_epi64(_mm256_set1_epi64x(52), iy));
+                big = _mm256_or_si256(big, _mm256_xor_si256(_mm256_cmpeq_epi64(lost, _mm256_setzero_si256()),
+                                                             _mm256_set1_epi64x(-1)));
+                ok = _mm256_andnot_pd(_mm256_castsi256_pd(big), ok);
+                ir = _mm256_sllv_epi64(ix, iy);
+            }
+            res = fromInt(ir);
+        }
+        _mm256_storeu_pd(r, res);
+        slow = ~_mm256_movemask_pd(ok) & 0xF;
+        return slow == 0;
+    }
+#endif
+
+    template <OpKind op>
+    static void binaryLoop(double *a, const double *b, std::uint8_t *err, std::size_t n) {
+        BinaryKernel k = Evaluator::binaryKernel(op);
+        std::size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + 4 <= n; i += 4) {
+            int slow = 0;
+            double x[4];
+            std::memcpy(x, a + i, sizeof(x));
+            if (vector4<op>(x, b + i, a + i, slow)) continue;
+            for (int l = 0; l < 4; ++l) {
+                if (slow & (1 << l)) scalar(k, x[l], b[i + l], a[i + l], err[i + l]);
+            }
+        }
+#else
+        if (op == OpKind::Add) { for (; i < n; ++i) a[i] += b[i]; return; }
+        if (op == OpKind::Sub) { for (; i < n; ++i) a[i] -= b[i]; return; }
+        if (op == OpKind::Mul) { for (; i < n; ++i) a[i] *= b[i]; return; }
+#endif
+        for (; i < n; ++i) scalar(k, a[i], b[i], a[i], err[i]);
+    }
+
+    static void binary(OpKind op, double *a, const double *b, std::uint8_t *err, std::size_t n) {
+        switch (op) {
+            case OpKind::Add: binaryLoop<OpKind::Add>(a, b, err, n); break;
+            case OpKind::Sub: binaryLoop<OpKind::Sub>(a, b, err, n); break;
+            case OpKind::Mul: binaryLoop<OpKind::Mul>(a, b, err, n); break;
+            case OpKind::Div: binaryLoop<OpKind::Div>(a, b, err, n); break;
+            case OpKind::Shl: binaryLoop<OpKind::Shl>(a, b, err, n); break;
+            case OpKind::Shr: binaryLoop<OpKind::Shr>(a, b, err, n); break;
+            case OpKind::And: binaryLoop<OpKind::And>(a, b, err, n); break;
+            case OpKind::Or:  binaryLoop<OpKind::Or>(a, b, err, n); break;
+            case OpKind::Xor: binaryLoop<OpKind::Xor>(a, b, err, n); break;
+            default:
+                // Функции (rotl, pdep, ...) - построчно ядром Evaluator.
+                for (std::size_t i = 0; i < n; ++i) scalar(Evaluator::binaryKernel(op), a[i], b[i], a[i], err[i]);
+                break;
+        }
+    }
+
+public:
+    void bind(const std::string &name, const std::uint64_t *data) { bindings[name] = {data, ColumnType::U64}; }
+    void bind(const std::string &name, const double *data) { bindings[name] = {data, ColumnType::F64}; }
+    void unbindAll() { bindings.clear(); }
+
+    // out и errors - по rows элементов. false - не привязан плейсхолдер.
+    bool run(const ColumnProgram &p, std::size_t rows, double *out, std::uint8_t *errors,
+             std::size_t &failedRows, std::string &err) {
+        std::vector<const Binding *> cols(p.placeholders.size());
+        for (std::size_t k = 0; k < cols.size(); ++k) {
+            auto it = bindings.find(p.placeholders[k]);
+            if (it == bindings.end()) {
+                err = unknownVariableError(p.placeholders[k]);
+                return false;
+            }
+            cols[k] = &it->second;
+        }
+
+        if (regs.size() < p.depth * kChunk) regs.resize(p.depth * kChunk);
+        std::memset(errors, 0, rows);
+        for (std::size_t from = 0; from < rows; from += kChunk) {
+            std::size_t n = rows - from < kChunk ? rows - from : kChunk;
+            std::uint8_t *e = errors + from;
+            for (const ColumnProgram::Step &s : p.steps) {
+                double *dst = regs.data() + s.dst * kChunk;
+                switch (s.kind) {
+                    case ColumnProgram::Step::Load:
+                        load(*cols[s.var], from, n, dst, e);
+                        break;
+                    case ColumnProgram::Step::Const:
+                        for (std::size_t i = 0; i < n; ++i) dst[i] = s.value;
+                        break;
+                    case ColumnProgram::Step::Neg:
+                        for (std::size_t i = 0; i < n; ++i) dst[i] = -dst[i];
+                        break;
+                    case ColumnProgram::Step::Unary: {
+                        UnaryKernel k = Evaluator::unaryKernel(s.op);
+                        for (std::size_t i = 0; i < n; ++i) {
+                            const char *fault = nullptr;
+                            if (!k(dst[i], dst[i], fault)) fail(e[i], codeOf(fault));
+                        }
+                        break;
+                    }
+                    case ColumnProgram::Step::Binary:
+                        binary(s.op, dst, dst + kChunk, e, n);
+                        break;
+                }
+            }
+            std::memcpy(out + from, regs.data(), n * sizeof(double));
+        }
+
+        failedRows = 0;
+        for (std::size_t i = 0; i < rows; ++i) failedRows += errors[i] != 0;
+        return true;
+    }
+};
+
+#endif
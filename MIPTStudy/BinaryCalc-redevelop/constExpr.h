@@ -0,0 +1,347 @@
+#ifndef CONST_EXPR_GUARD
+#define CONST_EXPR_GUARD
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+#include "bitOps.h"
+#include "lexer.h"
+#include "status.h"
+
+// Вычисление выражения при компиляции: "(1011 << 100) | 11"_bexpr.
+// Лексер, приоритеты, ключевые слова и число операндов - те же, что у
+// InfixParser (lexer.h), функции - из BitOps. Значения - 64-битные целые
+// со знаком: там, где double во время работы точен (до 2^53), результат
+// совпадает; дробь, деление с остатком и переполнение - ошибки компиляции.
+
+struct ConstResult {
+    ErrorCode error = ErrorCode::None;
+    std::uint32_t pos = 0;  // фрагмент, как у Status
+    std::uint32_t len = 0;
+    std::int64_t value = 0;
+
+    constexpr bool ok() const { return error == ErrorCode::None; }
+};
+
+// Сортировочная станция, как InfixParser::toRpn, но оператор применяется
+// сразу, а не пишется в RPN; стеки - массивы фиксированной глубины. Ошибка
+// вычисления запоминается и разбор идёт дальше: как во время работы, ошибка
+// разбора важнее, а из ошибок вычисления - первая в порядке RPN.
+class ConstExpr {
+public:
+    static constexpr std::size_t kMaxDepth = 64;
+
+private:
+    std::array<std::int64_t, kMaxDepth> values{};
+    std::array<Token, kMaxDepth> ops{};
+    std::size_t valueCount = 0;
+    std::size_t opCount = 0;
+    ErrorCode evalError = ErrorCode::None;
+    ConstResult result;
+
+    constexpr bool fail(ErrorCode code, const Token &at = Token()) {
+        result.error = code;
+        result.pos = hasSpan(code) ? at.pos : 0;
+        result.len = hasSpan(code) ? at.len : 0;
+        return false;
+    }
+
+    constexpr bool evalFail(ErrorCode code, const Token &at = Token()) {
+        if (evalError != ErrorCode::None) return false;
+        evalError = code;
+        return fail(code, at);
+    }
+
+    constexpr bool pushValue(std::int64_t v) {
+        if (valueCount == kMaxDepth) return fail(ErrorCode::NestingTooDeep);
+        values[valueCount++] = v;
+        return true;
+    }
+
+    constexpr bool pushOp(const Token &t) {
+        if (opCount == kMaxDepth) return fail(ErrorCode::NestingTooDeep);
+        ops[opCount++] = t;
+        return true;
+    }
+
+    // Двоичное целое без точки, не больше 63 значащих бит.
+    constexpr bool number(const Token &t, std::string_view digits) {
+        if (digits.front() == '.' || digits.back() == '.') return fail(ErrorCode::UnknownToken, t);
+        std::uint64_t v = 0;
+        for (char c : digits) {
+            if (c == '.' || v >> 62) {
+                evalFail(c == '.' ? ErrorCode::ConstFraction : ErrorCode::ConstRange);
+                return pushValue(0);
+            }
+            v = (v << 1) | static_cast<std::uint64_t>(c - '0');
+        }
+        return pushValue(static_cast<std::int64_t>(v));
+    }
+
+    constexpr bool word(std::int64_t a, ErrorCode code, std::uint64_t &out) {
+        if (a < 0) return evalFail(code);
+        out = static_cast<std::uint64_t>(a);
+        return true;
+    }
+
+    constexpr bool fits(std::uint64_t v, std::int64_t &out) {
+        if (v > static_cast<std::uint64_t>(INT64_MAX)) return evalFail(ErrorCode::ConstRange);
+        out = static_cast<std::int64_t>(v);
+        return true;
+    }
+
+    constexpr bool unary(OpKind op, std::int64_t a, std::int64_t &out) {
+        std::uint64_t x = 0;
+        switch (op) {
+            case OpKind::UnaryMinus:
+                if (a == INT64_MIN) return evalFail(ErrorCode::ConstRange);
+                out = -a;
+                return true;
+            case OpKind::Not: {
+                // Как Evaluator: в пределах длины операнда в битах.
+                if (!word(a, ErrorCode::NotOperands, x)) return false;
+                unsigned width = x == 0 ? 1 : 64 - BitOps::clz(x);
+                out = static_cast<std::int64_t>(~x & ((std::uint64_t(1) << width) - 1));
+                return true;
+            }
+            default:
+                break;
+        }
+        if (!word(a, ErrorCode::FunctionOperands, x)) return false;
+        switch (op) {
+            case OpKind::Popcount: out = BitOps::popcountPortable(x); return true;
+            case OpKind::Clz:      out = BitOps::clz(x); return true;
+            case OpKind::Ctz:      out = BitOps::ctz(x); return true;
+            case OpKind::Parity:   out = BitOps::popcountPortable(x) & 1u; return true;
+            default:               return evalFail(ErrorCode::UnknownOperator);
+        }
+    }
+
+    constexpr bool binary(OpKind op, std::int64_t a, std::int64_t b, std::int64_t &out) {
+        std::uint64_t x = 0, y = 0;
+        switch (op) {
+            case OpKind::Add:
+                if (__builtin_add_overflow(a, b, &out)) return evalFail(ErrorCode::ConstRange);
+                return true;
+            case OpKind::Sub:
+                if (__builtin_sub_overflow(a, b, &out)) return evalFail(ErrorCode::ConstRange);
+                return true;
+            case OpKind::Mul:
+                if (__builtin_mul_overflow(a, b, &out)) return evalFail(ErrorCode::ConstRange);
+                return true;
+            case OpKind::Div:
+                if (b == 0) return evalFail(ErrorCode::DivisionByZero);
+                // INT64_MIN % -1 - такое же UB, как и деление: проверка до остатка.
+                if (a == INT64_MIN && b == -1) return evalFail(ErrorCode::ConstRange);
+                if (a % b != 0) return evalFail(ErrorCode::ConstFraction);
+                out = a / b;
+                return true;
+            case OpKind::And:
+            case OpKind::Or:
+            case OpKind::Xor:
+                if (!word(a, ErrorCode::LogicOperands, x) || !word(b, ErrorCode::LogicOperands, y)) return false;
+                out = static_cast<std::int64_t>(op == OpKind::And ? x & y : op == OpKind::Or ? x | y : x ^ y);
+                return true;
+            case OpKind::Shl:
+            case OpKind::Shr:
+                // Как Evaluator: сдвиг 64-битного слова, результат - целое со знаком.
+                if (!word(a, ErrorCode::ShiftOperands, x) || !word(b, ErrorCode::ShiftOperands, y)) return false;
+                if (y > 63) return evalFail(ErrorCode::ShiftRange);
+                out = static_cast<std::int64_t>(op == OpKind::Shl ? x << y : x >> y);
+                return true;
+            default:
+                break;
+        }
+        if (!word(a, ErrorCode::FunctionOperands, x) || !word(b, ErrorCode::FunctionOperands, y)) return false;
+        switch (op) {
+            case OpKind::Rotl: return fits(BitOps::rotl(x, y), out);
+            case OpKind::Rotr: return fits(BitOps::rotr(x, y), out);
+            case OpKind::Pdep: return fits(BitOps::pdepPortable(x, y), out);
+            case OpKind::Pext: return fits(BitOps::pextPortable(x, y), out);
+            default:           return evalFail(ErrorCode::UnknownOperator);
+        }
+    }
+
+    // То, что InfixParser записал бы в RPN, сразу вычисляется над стеком
+    // значений - с теми же ошибками, что у Evaluator::evalRpn.
+    constexpr void apply(const Token &t) {
+        if (operandCount(t.op) == 1) {
+            if (valueCount == 0) {
+                evalFail(t.op == OpKind::Not ? ErrorCode::NotNoArg : ErrorCode::UnaryNoArg);
+                return;
+            }
+            unary(t.op, values[valueCount - 1], values[valueCount - 1]);
+            return;
+        }
+        if (valueCount < 2) {
+            evalFail(ErrorCode::BinaryNoArgs);
+            return;
+        }
+        --valueCount;
+        binary(t.op, values[valueCount - 1], values[valueCount], values[valueCount - 1]);
+    }
+
+    constexpr bool run(std::string_view expr) {
+        Lexer lex(expr);
+        bool expectUnary = true;
+        bool expectCall = false;
+
+        while (true) {
+            Token t = lex.scan();
+            if (expectCall && t.type != TokenType::LParen) return fail(ErrorCode::FunctionCall, ops[opCount - 1]);
+            if (t.type == TokenType::End) {
+                if (t.len != 0) return fail(ErrorCode::UnknownToken, t);
+                break;
+            }
+
+            if (t.type == TokenType::Number) {
+                if (!number(t, t.text(expr))) return false;
+                expectUnary = false;
+                continue;
+            }
+            if (t.type == TokenType::Ident) {
+                evalFail(ErrorCode::UnknownVariable, t);
+                if (!pushValue(0)) return false;
+                expectUnary = false;
+                continue;
+            }
+
+            if (t.type == TokenType::LParen) {
+                if (!pushOp(t)) return false;
+                expectUnary = true;
+                expectCall = false;
+                continue;
+            }
+
+            if (t.type == TokenType::Comma) {
+                while (opCount > 0 && ops[opCount - 1].type != TokenType::LParen) {
+                    apply(ops[--opCount]);
+                }
+                if (expectUnary || opCount < 2 || ops[opCount - 2].type != TokenType::Op ||
+                    !isFunction(ops[opCount - 2].op)) {
+                    return fail(ErrorCode::UnexpectedToken, t);
+                }
+                const Token &name = ops[opCount - 2];
+                if (++ops[opCount - 1].commas >= functionArity(name.op)) return fail(ErrorCode::FunctionArity, name);
+                expectUnary = true;
+                continue;
+            }
+
+            if (t.type == TokenType::RParen) {
+                bool found = false;
+                std::uint8_t commas = 0;
+                while (opCount > 0) {
+                    const Token &top = ops[--opCount];
+                    if (top.type == TokenType::LParen) {
+                        commas = top.commas;
+                        found = true;
+                        break;
+                    }
+                    apply(top);
+                }
+                if (!found) return fail(ErrorCode::ExtraRParen);
+                if (opCount > 0 && ops[opCount - 1].type == TokenType::Op && isFunction(ops[opCount - 1].op)) {
+                    const Token &name = ops[opCount - 1];
+                    if (expectUnary || commas + 1 != functionArity(name.op)) {
+                        return fail(ErrorCode::FunctionArity, name);
+                    }
+                    --opCount;
+                    apply(name);
+                }
+                expectUnary = false;
+                continue;
+            }
+
+            if (t.type == TokenType::Op) {
+                if (isFunction(t.op)) {
+                    if (!expectUnary) return fail(ErrorCode::UnexpectedToken, t);
+                    if (!pushOp(t)) return false;
+                    expectCall = true;
+                    continue;
+                }
+                if (t.op == OpKind::Sub && expectUnary) t.op = OpKind::UnaryMinus;
+
+                while (opCount > 0 && ops[opCount - 1].type == TokenType::Op) {
+                    int pTop = precedence(ops[opCount - 1].op);
+                    int pCur = precedence(t.op);
+                    if (pTop > pCur || (pTop == pCur && !isRightAssociative(t.op))) {
+                        apply(ops[--opCount]);
+                    } else {
+                        break;
+                    }
+                }
+
+                if (!pushOp(t)) return false;
+                expectUnary = true;
+                continue;
+            }
+
+            return fail(ErrorCode::UnexpectedToken, t);
+        }
+
+        while (opCount > 0) {
+            const Token &top = ops[--opCount];
+            if (top.type == TokenType::LParen) return fail(ErrorCode::UnclosedLParen);
+            apply(top);
+        }
+        if (valueCount != 1) evalFail(ErrorCode::NotReduced);
+        if (evalError != ErrorCode::None) return false;
+        result.value = values[0];
+        return true;
+    }
+
+public:
+    static constexpr ConstResult evaluate(std::string_view expr) {
+        ConstExpr e;
+        e.run(expr);
+        return e.result;
+    }
+};
+
+// Ошибка в _bexpr видна в тексте диагностики как параметры шаблона:
+// ConstExprCheck<ErrorCode::DivisionByZero, 0>.
+template <ErrorCode code, std::uint32_t pos>
+struct ConstExprCheck {
+    static_assert(code == ErrorCode::None, "_bexpr: выражение не вычисляется, код ошибки и позиция - в ConstExprCheck<...>");
+    static constexpr bool ok = true;
+};
+
+template <char... text>
+struct ConstExprText {
+    static constexpr char data[] = {text..., '\0'};
+};
+
+#if defined(__GNUC__)
+// Шаблонный строковый литерал (расширение GCC/Clang): текст - параметр
+// шаблона, поэтому выражение вычисляется при компиляции всегда, а не только
+// в constexpr-контексте, и во время работы от него остаётся константа.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#if defined(__clang__)
+#pragma GCC diagnostic ignored "-Wgnu-string-literal-operator-template"
+#endif
+template <typename Char, Char... text>
+constexpr std::int64_t operator""_bexpr() {
+    static_assert(std::is_same<Char, char>::value, "_bexpr: только обычные строковые литералы");
+    constexpr ConstResult r = ConstExpr::evaluate(std::string_view(ConstExprText<text...>::data, sizeof...(text)));
+    static_assert(ConstExprCheck<r.error, r.pos>::ok, "");
+    return r.value;
+}
+#pragma GCC diagnostic pop
+#else
+// Без расширения: в constexpr-контексте ошибка - вызов не-constexpr функции.
+inline void constExprFailed(ErrorCode) {}
+
+constexpr std::int64_t operator""_bexpr(const char *text, std::size_t len) {
+    ConstResult r = ConstExpr::evaluate(std::string_view(text, len));
+    if (!r.ok()) constExprFailed(r.error);
+    return r.value;
+}
+#endif
+
+static_assert("(1011 << 100) | 11"_bexpr == 0b10110011, "_bexpr");
+static_assert("rotl(1, 11) + popcount(1111) - ~101"_bexpr == 0b1010, "_bexpr");
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef DYADIC_GUARD
+#define DYADIC_GUARD
+
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "bigBinary.h"
+#include "bitText.h"
+
+// Двоично-рациональное число mant * 2^exp. Любая конечная двоичная дробь
+// представима точно. Мантисса нормализована (нечётна или ноль, тогда exp = 0).
+// Пока мантисса помещается в long long, арифметика идёт без BigBinary.
+class Dyadic {
+private:
+    bool isSmall = true;
+    long long small = 0;
+    BigBinary big;
+    long long exp = 0;
+
+    static Dyadic fromBig(BigBinary m, long long e) {
+        Dyadic d;
+        long long v = 0;
+        if (m.fitsInt64(v)) {
+            d.small = v;
+        } else {
+            d.isSmall = false;
+            d.big = std::move(m);
+        }
+        d.exp = e;
+        d.normalize();
+        return d;
+    }
+
+    static Dyadic fromSmall(long long m, long long e) {
+        Dyadic d;
+        d.small = m;
+        d.exp = e;
+        d.normalize();
+        return d;
+    }
+
+    void normalize() {
+        if (isSmall) {
+            if (small == 0) { exp = 0; return; }
+            int tz = __builtin_ctzll(static_cast<unsigned long long>(small));
+            small >>= tz;
+            exp += tz;
+            return;
+        }
+        if (big.isZero()) { *this = Dyadic(); return; }
+        std::size_t tz = big.trailingZeros();
+        if (tz != 0) {
+            big = big.shiftedRight(tz);
+            exp += static_cast<long long>(tz);
+        }
+        long long v = 0;
+        if (big.fitsInt64(v)) {
+            isSmall = true;
+            small = v;
+            big = BigBinary();
+        }
+    }
+
+    BigBinary mantissa() const {
+        return isSmall ? BigBinary::fromInt(small) : big;
+    }
+
+    // Мантисса, выровненная к меньшему показателю e <= exp.
+    BigBinary alignedBig(long long e) const {
+        return mantissa().shiftedLeft(static_cast<std::size_t>(exp - e));
+    }
+
+    bool alignedSmall(long long e, long long &out) const {
+        if (!isSmall) return false;
+        long long sh = exp - e;
+        if (sh >= 63) return small == 0 ? (out = 0, true) : false;
+        long long limit = LLONG_MAX >> sh;
+        if (small > limit || small < -limit) return false;
+        out = small * (1LL << sh);
+        return true;
+    }
+
+    static long long umag(long long v) { return v < 0 ? -v : v; }
+
+public:
+    Dyadic() = default;
+
+    static Dyadic fromInt(long long v) { return fromSmall(v, 0); }
+
+    // Двоичный литерал: [-]цифры[.цифры].
+    static bool fromBinaryString(std::string_view text, Dyadic &out) {
+        if (text.empty()) return false;
+        bool negative = text[0] == '-';
+        std::string_view body = text.substr(negative ? 1 : 0);
+        std::size_t dot = body.find('.');
+        std::string_view ip = body.substr(0, dot);
+        std::string_view fp = dot == std::string_view::npos ? std::string_view() : body.substr(dot + 1);
+        if (ip.empty() || (dot != std::string_view::npos && fp.empty())) return false;
+
+        long long e = -static_cast<long long>(fp.size());
+        if (ip.size() + fp.size() <= 62) {
+            std::uint64_t a = 0, b = 0;
+            if (!packBinaryDigits(ip.data(), ip.size(), &a)) return false;
+            if (!fp.empty() && !packBinaryDigits(fp.data(), fp.size(), &b)) return false;
+            long long m = static_cast<long long>((a << fp.size()) | b);
+            out = fromSmall(negative ? -m : m, e);
+            return true;
+        }
+
+        BigBinary a, b;
+        if (!BigBinary::fromBinaryString(ip, a)) return false;
+        if (!fp.empty() && !BigBinary::fromBinaryString(fp, b)) return false;
+        BigBinary m = a.shiftedLeft(fp.size()) | b;
+        out = fromBig(negative ? -m : m, e);
+        return true;
+    }
+
+    bool isZero() const { return isSmall && small == 0; }
+    bool isNegative() const { return isSmall ? small < 0 : big.isNegative(); }
+    bool isInteger() const { return exp >= 0; }
+
+    // Неотрицательное целое < 2^64.
+    bool toUint64(std::uint64_t &out) const {
+        if (isNegative() || !isInteger()) return false;
+        if (isZero()) { out = 0; return true; }
+        if (exp >= 64) return false;
+        BigBinary v = mantissa().shiftedLeft(static_cast<std::size_t>(exp));
+        if (!v.fitsUint64()) return false;
+        out = v.lowUint64();
+        return true;
+    }
+
+    // Целое значение как BigBinary (только для isInteger()).
+    BigBinary toBigInteger() const {
+        return mantissa().shiftedLeft(static_cast<std::size_t>(exp));
+    }
+
+    static Dyadic fromBigInteger(BigBinary v) { return fromBig(std::move(v), 0); }
+
+    // m * 2^e.
+    static Dyadic fromScaled(BigBinary m, long long e) { return fromBig(std::move(m), e); }
+
+    static Dyadic fromUint64(std::uint64_t v) {
+        if (v <= static_cast<std::uint64_t>(LLONG_MAX)) return fromSmall(static_cast<long long>(v), 0);
+        return fromBig(BigBinary::fromUint(v), 0);
+    }
+
+    Dyadic operator-() const {
+        if (isSmall && small != LLONG_MIN) return fromSmall(-small, exp);
+        return fromBig(-mantissa(), exp);
+    }
+
+    friend Dyadic operator+(const Dyadic &a, const Dyadic &b) {
+        long long e = a.exp < b.exp ? a.exp : b.exp;
+        long long x = 0, y = 0, r = 0;
+        if (a.alignedSmall(e, x) && b.alignedSmall(e, y) && !__builtin_add_overflow(x, y, &r)) {
+            return fromSmall(r, e);
+        }
+        return fromBig(a.alignedBig(e) + b.alignedBig(e), e);
+    }
+
+    friend Dyadic operator-(const Dyadic &a, const Dyadic &b) {
+        return a + (-b);
+    }
+
+    friend Dyadic operator*(const Dyadic &a, const Dyadic &b) {
+        long long r = 0;
+        if (a.isSmall && b.isSmall && !__builtin_mul_overflow(a.small, b.small, &r)) {
+            return fromSmall(r, a.exp + b.exp);
+        }
+        return fromBig(a.mantissa() * b.mantissa(), a.exp + b.exp);
+    }
+
+    // a / b с отбрасыванием после fracBits двоичных знаков после точки. b != 0.
+    static Dyadic divide(const Dyadic &a, const Dyadic &b, std::size_t fracBits) {
+        long long s = a.exp - b.exp + static_cast<long long>(fracBits);
+        if (a.isSmall && b.isSmall && s >= 0 && s < 63 && b.small != LLONG_MIN) {
+            long long limit = LLONG_MAX >> s;
+            if (a.small <= limit && a.small >= -limit) {
+                return fromSmall((a.small * (1LL << s)) / b.small, -static_cast<long long>(fracBits));
+            }
+        }
+
+        BigBinary num = a.mantissa(), den = b.mantissa();
+        if (s >= 0) num = num.shiftedLeft(static_cast<std::size_t>(s));
+        else den = den.shiftedLeft(static_cast<std::size_t>(-s));
+        BigBinary q, r;
+        BigBinary::divMod(num, den, q, r);
+        return fromBig(std::move(q), -static_cast<long long>(fracBits));
+    }
+
+    // Сдвиги определены для неотрицательных целых.
+    Dyadic shiftedLeft(std::size_t n) const {
+        if (isZero()) return *this;
+        Dyadic d = *this;
+        d.exp += static_cast<long long>(n);
+        return d;
+    }
+
+    Dyadic shiftedRight(std::size_t n) const {
+        long long sn = static_cast<long long>(n);
+        if (exp >= sn) {
+            Dyadic d = *this;
+            d.exp -= sn;
+            return d;
+        }
+        std::size_t drop = static_cast<std::size_t>(sn - exp);
+        if (isSmall) return fromSmall(drop >= 63 ? 0 : (small >> drop), 0);
+        return fromBig(big.shiftedRight(drop), 0);
+    }
+
+    std::string toBinaryString() const {
+        if (isZero()) return "0";
+        std::string digits;
+        if (isSmall) {
+            std::uint64_t m = static_cast<std::uint64_t>(umag(small));
+            std::size_t bits = 64 - static_cast<std::size_t>(__builtin_clzll(m));
+            digits.assign(bits, '0');
+            unpackBinaryDigits(&m, bits, &digits[0]);
+        } else {
+            digits = big.toBinaryString();
+            if (digits[0] == '-') digits.erase(0, 1);
+        }
+
+        std::string res = isNegative() ? "-" : "";
+        if (exp >= 0) {
+            res += digits;
+            res.append(static_cast<std::size_t>(exp), '0');
+            return res;
+        }
+
+        std::size_t k = static_cast<std::size_t>(-exp);
+        if (digits.size() <= k) digits.insert(0, k + 1 - digits.size(), '0');
+        res.append(digits, 0, digits.size() - k);
+        res.push_back('.');
+        res.append(digits, digits.size() - k, k);
+        return res;
+    }
+
+    // m / 2^k = m * 5^k / 10^k: десятичная запись конечна и точна.
+    std::string toDecimalString() const {
+        if (exp >= 0) return toBigInteger().toDecimalString();
+
+        std::size_t k = static_cast<std::size_t>(-exp);
+        BigBinary m = mantissa();
+        bool negative = m.isNegative();
+        if (negative) m = -m;
+        std::string digits = (m * BigBinary::pow5(k)).toDecimalString();
+        if (digits.size() <= k) digits.insert(0, k + 1 - digits.size(), '0');
+
+        std::string res = negative ? "-" : "";
+        res.append(digits, 0, digits.size() - k);
+        res.push_back('.');
+        res.append(digits, digits.size() - k, k);
+        return res;
+    }
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef ENVIRONMENT_GUARD
+#define ENVIRONMENT_GUARD
+
+#include <string>
+#include <string_view>
+
+#include "dyadic.h"
+#include "status.h"
+
+// Источник значений переменных для вычислителей. false + err (код и полный
+// текст), если имя не определено или его определение не вычисляется.
+class Environment {
+public:
+    virtual ~Environment() = default;
+    virtual bool lookupDouble(std::string_view name, double &out, Fault &err) = 0;
+    virtual bool lookupExact(std::string_view name, Dyadic &out, Fault &err) = 0;
+};
+
+inline std::string unknownVariableError(std::string_view name) {
+    return "Неизвестная переменная: '" + std::string(name) + "'";
+}
+
+inline Fault unknownVariable(std::string_view name) {
+    return {ErrorCode::UnknownVariable, unknownVariableError(name)};
+}
+
+#endif
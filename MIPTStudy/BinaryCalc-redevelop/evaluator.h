@@ -0,0 +1,354 @@
+#ifndef EVALUATOR_GUARD
+#define EVALUATOR_GUARD
+
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "bitOps.h"
+#include "chainReduce.h"
+#include "parser.h"
+
+struct EvalResult {
+    bool ok = false;
+    std::string error;
+    BinaryNumber value;
+    bool isBitwiseResult = false;
+    ErrorCode code = ErrorCode::None;  // для --stats; None - ошибка без кода
+};
+
+// Ядро одной операции: false + err при ошибке. Общие для Evaluator и байткод-VM.
+using UnaryKernel = bool (*)(double a, double &out, const char *&err);
+using BinaryKernel = bool (*)(double a, double b, double &out, const char *&err);
+
+class Evaluator {
+private:
+    static bool isZero(const BinaryNumber &b) {
+        return std::fabs(b.toDouble()) < 1e-12;
+    }
+
+    static bool toNonNegInt(const BinaryNumber& x, long long& out) {
+        bool ok = false;
+        out = x.toIntChecked(ok);
+        if (!ok) return false;
+        if (out < 0) return false;
+        return true;
+    }
+
+    static bool negKernel(double a, double &out, const char *&) {
+        out = -a;
+        return true;
+    }
+
+    // NOT в пределах ширины операнда - его длины в битах (не меньше 1):
+    // ~101 = 10, а не 64-битное дополнение.
+    static bool notKernel(double a, double &out, const char *&err) {
+        long long ia = 0;
+        if (!toNonNegInt(BinaryNumber(a), ia)) {
+            err = errorText(ErrorCode::NotOperands);
+            return false;
+        }
+
+        unsigned long long ua = static_cast<unsigned long long>(ia);
+        int width = ua == 0 ? 1 : 64 - __builtin_clzll(ua);
+        unsigned long long mask = (1ULL << width) - 1;
+
+        out = static_cast<double>(~ua & mask);
+        return true;
+    }
+
+    static bool addKernel(double a, double b, double &out, const char *&) { out = a + b; return true; }
+    static bool subKernel(double a, double b, double &out, const char *&) { out = a - b; return true; }
+    static bool mulKernel(double a, double b, double &out, const char *&) { out = a * b; return true; }
+
+    static bool divKernel(double a, double b, double &out, const char *&err) {
+        if (isZero(BinaryNumber(b))) { err = errorText(ErrorCode::DivisionByZero); return false; }
+        out = a / b;
+        return true;
+    }
+
+    static bool logicArgs(double a, double b, long long &ia, long long &ib, const char *&err) {
+        if (!toNonNegInt(BinaryNumber(a), ia) || !toNonNegInt(BinaryNumber(b), ib)) {
+            err = errorText(ErrorCode::LogicOperands);
+            return false;
+        }
+        return true;
+    }
+
+    static bool andKernel(double a, double b, double &out, const char *&err) {
+        long long ia = 0, ib = 0;
+        if (!logicArgs(a, b, ia, ib, err)) return false;
+        out = static_cast<double>(ia & ib);
+        return true;
+    }
+
+    static bool orKernel(double a, double b, double &out, const char *&err) {
+        long long ia = 0, ib = 0;
+        if (!logicArgs(a, b, ia, ib, err)) return false;
+        out = static_cast<double>(ia | ib);
+        return true;
+    }
+
+    static bool xorKernel(double a, double b, double &out, const char *&err) {
+        long long ia = 0, ib = 0;
+        if (!logicArgs(a, b, ia, ib, err)) return false;
+        out = static_cast<double>(ia ^ ib);
+        return true;
+    }
+
+    static bool shiftArgs(double a, double b, unsigned long long &ua, long long &ib, const char *&err) {
+        long long ia = 0;
+        if (!toNonNegInt(BinaryNumber(a), ia) || !toNonNegInt(BinaryNumber(b), ib)) {
+            err = errorText(ErrorCode::ShiftOperands);
+            return false;
+        }
+        if (ib < 0 || ib > 63) {
+            err = errorText(ErrorCode::ShiftRange);
+            return false;
+        }
+        ua = static_cast<unsigned long long>(ia);
+        return true;
+    }
+
+    static bool shlKernel(double a, double b, double &out, const char *&err) {
+        unsigned long long ua = 0;
+        long long ib = 0;
+        if (!shiftArgs(a, b, ua, ib, err)) return false;
+        out = static_cast<double>(static_cast<long long>(ua << ib));
+        return true;
+    }
+
+    static bool shrKernel(double a, double b, double &out, const char *&err) {
+        unsigned long long ua = 0;
+        long long ib = 0;
+        if (!shiftArgs(a, b, ua, ib, err)) return false;
+        out = static_cast<double>(static_cast<long long>(ua >> ib));
+        return true;
+    }
+
+    // Функции считаются над 64-битным словом: rotl/rotr - поворот на n mod 64,
+    // clz(0) = ctz(0) = 64. Аргументы - как у логики, неотрицательные целые.
+    static bool functionArg(double a, std::uint64_t &out, const char *&err) {
+        long long ia = 0;
+        if (!toNonNegInt(BinaryNumber(a), ia)) {
+            err = errorText(ErrorCode::FunctionOperands);
+            return false;
+        }
+        out = static_cast<std::uint64_t>(ia);
+        return true;
+    }
+
+    template <unsigned (*F)(std::uint64_t)>
+    static bool countKernel(double a, double &out, const char *&err) {
+        std::uint64_t x = 0;
+        if (!functionArg(a, x, err)) return false;
+        out = static_cast<double>(F(x));
+        return true;
+    }
+
+    template <std::uint64_t (*F)(std::uint64_t, std::uint64_t)>
+    static bool wordKernel(double a, double b, double &out, const char *&err) {
+        std::uint64_t x = 0, y = 0;
+        if (!functionArg(a, x, err) || !functionArg(b, y, err)) return false;
+        out = static_cast<double>(F(x, y));
+        return true;
+    }
+
+    static bool isLogic(OpKind op) { return op == OpKind::And || op == OpKind::Or || op == OpKind::Xor; }
+
+    // Один токен RPN над стеком значений.
+    static bool step(const Token &t, std::vector<double> &st, bool &lastWasBitwise, Status &status) {
+        const char *err = nullptr;
+        if (t.type == TokenType::Number) {
+            st.push_back(t.number.toDouble());
+            return true;
+        }
+        if (t.type == TokenType::Op) {
+            if (isUnary(t.op)) {
+                if (st.empty()) { status.fail(missingArgument(t.op)); return false; }
+                if (!unaryKernel(t.op)(st.back(), st.back(), err)) { status.fail(codeOf(err)); return false; }
+            } else {
+                if (st.size() < 2) { status.fail(ErrorCode::BinaryNoArgs); return false; }
+                BinaryKernel k = binaryKernel(t.op);
+                if (!k) { status.fail(ErrorCode::UnknownOperator); return false; }
+                double b = st.back();
+                st.pop_back();
+                if (!k(st.back(), b, st.back(), err)) { status.fail(codeOf(err)); return false; }
+            }
+            lastWasBitwise = isBitwise(t.op);
+            return true;
+        }
+        status.fail(ErrorCode::EvalUnexpectedToken);
+        return false;
+    }
+
+    struct LogicPart {
+        std::uint64_t acc = 0;
+        bool exact = true;  // все термы < 2^53: double их складывает без округлений
+        bool failed = false;
+        ChainFault fault;
+        Status status;
+    };
+
+    // Цепочка &, |, ^ блоками в несколько потоков. Термы - неотрицательные
+    // целые меньше 2^53, и double во всех промежуточных значениях точен,
+    // так что порядок свёртки не важен. Иначе false без ошибки в status -
+    // цепочку считает обычный проход.
+    static bool reduceLogic(const std::vector<Token> &rpn, const OperatorChain &c, double &value, bool &done,
+                            Status &status) {
+        auto fold = [op = c.op](std::uint64_t a, std::uint64_t b) {
+            return op == OpKind::And ? a & b : op == OpKind::Or ? a | b : a ^ b;
+        };
+        std::vector<LogicPart> parts = ChainReducer::blocks<LogicPart>(c.terms(), [&](std::size_t lo, std::size_t hi,
+                                                                                        LogicPart &part) {
+            std::vector<double> st;
+            bool bitwise = false;
+            for (std::size_t k = lo; k < hi; ++k) {
+                st.clear();
+                Status term;
+                ChainFault fault{k, false};
+                for (std::size_t i = c.first[k]; i <= c.last[k] && term.ok(); ++i) step(rpn[i], st, bitwise, term);
+                if (term.ok()) {
+                    double v = st.back();
+                    if (v >= 9007199254740992.0) { part.exact = false; return; }
+                    long long iv = 0;
+                    if (toNonNegInt(BinaryNumber(v), iv)) {
+                        std::uint64_t u = static_cast<std::uint64_t>(iv);
+                        part.acc = k == lo ? u : fold(part.acc, u);
+                        continue;
+                    }
+                    term.fail(ErrorCode::LogicOperands);
+                    fault.operand = true;
+                }
+                if (!part.failed || fault.before(part.fault)) {
+                    part.failed = true;
+                    part.fault = fault;
+                    part.status = term;
+                }
+                // У t0 ошибка операнда всплывает только вместе с t1.
+                if (k > 0) return;
+            }
+        });
+
+        done = false;
+        const LogicPart *first = nullptr;
+        for (const LogicPart &p : parts) {
+            if (!p.exact) return false;
+            if (p.failed && (!first || p.fault.before(first->fault))) first = &p;
+        }
+        done = true;
+        if (first) {
+            status = first->status;
+            return false;
+        }
+        std::uint64_t acc = parts[0].acc;
+        for (std::size_t b = 1; b < parts.size(); ++b) acc = fold(acc, parts[b].acc);
+        value = static_cast<double>(acc);
+        return true;
+    }
+
+public:
+    static UnaryKernel unaryKernel(OpKind op) {
+        switch (op) {
+            case OpKind::UnaryMinus: return &negKernel;
+            case OpKind::Not:        return &notKernel;
+            case OpKind::Popcount:   return &countKernel<&BitOps::popcount>;
+            case OpKind::Clz:        return &countKernel<&BitOps::clz>;
+            case OpKind::Ctz:        return &countKernel<&BitOps::ctz>;
+            case OpKind::Parity:     return &countKernel<&BitOps::parity>;
+            default:                 return nullptr;
+        }
+    }
+
+    static BinaryKernel binaryKernel(OpKind op) {
+        switch (op) {
+            case OpKind::Add: return &addKernel;
+            case OpKind::Sub: return &subKernel;
+            case OpKind::Mul: return &mulKernel;
+            case OpKind::Div: return &divKernel;
+            case OpKind::And: return &andKernel;
+            case OpKind::Or:  return &orKernel;
+            case OpKind::Xor: return &xorKernel;
+            case OpKind::Shl: return &shlKernel;
+            case OpKind::Shr: return &shrKernel;
+            case OpKind::Rotl: return &wordKernel<&BitOps::rotl>;
+            case OpKind::Rotr: return &wordKernel<&BitOps::rotr>;
+            case OpKind::Pdep: return &wordKernel<&BitOps::pdep>;
+            case OpKind::Pext: return &wordKernel<&BitOps::pext>;
+            default:          return nullptr;
+        }
+    }
+
+    static bool isUnary(OpKind op) {
+        return operandCount(op) == 1;
+    }
+
+    static ErrorCode missingArgument(OpKind op) {
+        return op == OpKind::Not ? ErrorCode::NotNoArg : ErrorCode::UnaryNoArg;
+    }
+
+    static bool isBitwise(OpKind op) {
+        return op == OpKind::And || op == OpKind::Or || op == OpKind::Xor ||
+               op == OpKind::Shl || op == OpKind::Shr || op == OpKind::Not || isFunction(op);
+    }
+
+    // Без выделений памяти после прогрева: стек значений - буфер вызывающего.
+    // Длинные цепочки &, |, ^ (ChainFinder::kMinTerms термов и больше)
+    // сворачиваются параллельно, с тем же результатом и той же ошибкой.
+    static bool evalRpn(const std::vector<Token> &rpn, std::vector<double> &st, double &value, bool &bitwise,
+                        Status &status) {
+        st.clear();
+        status = Status();
+        bool lastWasBitwise = false;
+
+        std::vector<OperatorChain> chains = ChainFinder::find(rpn, &isLogic);
+        std::size_t next = 0;
+        for (std::size_t i = 0; i < rpn.size(); ++i) {
+            if (next < chains.size() && chains[next].begin == i) {
+                const OperatorChain &c = chains[next++];
+                double v = 0.0;
+                bool done = false;
+                if (reduceLogic(rpn, c, v, done, status)) {
+                    st.push_back(v);
+                    lastWasBitwise = true;
+                    i = c.end;
+                    continue;
+                }
+                if (done) return false;
+            }
+            if (!step(rpn[i], st, lastWasBitwise, status)) return false;
+        }
+
+        if (st.size() != 1) { status.fail(ErrorCode::NotReduced); return false; }
+        value = st.back();
+        bitwise = lastWasBitwise;
+        return true;
+    }
+
+    static EvalResult evalRpn(const std::vector<Token> &rpn) {
+        std::vector<double> st;
+        double value = 0.0;
+        bool bitwise = false;
+        Status status;
+        if (!evalRpn(rpn, st, value, bitwise, status)) return {false, status.render({}), BinaryNumber(), false, status.code};
+        return {true, "", BinaryNumber(value), bitwise};
+    }
+};
+
+// Разбор и вычисление одного выражения без выделений памяти: буферы токенов,
+// операторов и значений живут в объекте и растут только при прогреве.
+// Один объект на поток.
+class ScratchEvaluator {
+private:
+    std::vector<Token> rpn;
+    std::vector<Token> ops;
+    std::vector<double> stack;
+
+public:
+    bool evaluate(std::string_view expr, double &value, bool &bitwise, Status &status) {
+        if (!InfixParser::toRpn(expr, rpn, ops, status)) return false;
+        return Evaluator::evalRpn(rpn, stack, value, bitwise, status);
+    }
+};
+
+#endif
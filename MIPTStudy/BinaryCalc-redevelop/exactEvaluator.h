@@ -0,0 +1,282 @@
+#ifndef EXACT_EVALUATOR_GUARD
+#define EXACT_EVALUATOR_GUARD
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "chainReduce.h"
+#include "dyadic.h"
+#include "environment.h"
+#include "evaluator.h"
+#include "parser.h"
+#include "status.h"
+
+struct ExactResult {
+    bool ok = false;
+    std::string error;
+    Dyadic value;
+    bool isBitwiseResult = false;
+    ErrorCode code = ErrorCode::None;
+};
+
+// Точный режим: тот же RPN, что и у Evaluator, но значения - двоично-рациональные
+// Dyadic без ограничения разрядности. Сложение, вычитание, умножение и сдвиги
+// точны; деление отбрасывает знаки после fracBits-го после точки.
+class ExactEvaluator {
+public:
+    static constexpr std::size_t kMaxShift = std::size_t(1) << 24;
+    static constexpr std::size_t kDefaultFracBits = 64;
+
+private:
+    // Пустой text - текст кода.
+    static ExactResult failure(ErrorCode code, std::string text = {}) {
+        if (text.empty()) text = errorText(code);
+        return {false, std::move(text), Dyadic(), false, code};
+    }
+
+    static ExactResult failure(Fault &&f) { return failure(f.code, std::move(f.message)); }
+
+    static bool literal(const Token &t, std::string_view source, Dyadic &out, Fault &err) {
+        if (!Dyadic::fromBinaryString(t.text(source), out)) {
+            Status st;
+            st.fail(ErrorCode::UnknownToken, t.pos, t.len);
+            err = {st.code, st.render(source)};
+            return false;
+        }
+        return true;
+    }
+
+    static bool bitwiseOp(OpKind op, const Dyadic &a, const Dyadic &b, Dyadic &out) {
+        std::uint64_t x = 0, y = 0;
+        if (a.toUint64(x) && b.toUint64(y)) {
+            if (op == OpKind::And) out = Dyadic::fromUint64(x & y);
+            if (op == OpKind::Or)  out = Dyadic::fromUint64(x | y);
+            if (op == OpKind::Xor) out = Dyadic::fromUint64(x ^ y);
+            return true;
+        }
+        BigBinary p = a.toBigInteger(), q = b.toBigInteger();
+        if (op == OpKind::And) out = Dyadic::fromBigInteger(p & q);
+        if (op == OpKind::Or)  out = Dyadic::fromBigInteger(p | q);
+        if (op == OpKind::Xor) out = Dyadic::fromBigInteger(p ^ q);
+        return true;
+    }
+
+public:
+    // Ядра над значениями, для вычислителей вне RPN (streamEvaluator.h).
+
+    // NOT в пределах ширины операнда (не меньше одного бита), как в Evaluator.
+    static ExactResult applyNot(const Dyadic &a) {
+        if (a.isNegative() || !a.isInteger()) return failure(ErrorCode::NotOperands);
+        std::uint64_t x = 0;
+        if (a.toUint64(x)) {
+            int width = x == 0 ? 1 : 64 - __builtin_clzll(x);
+            std::uint64_t mask = width == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << width) - 1;
+            return {true, "", Dyadic::fromUint64(~x & mask), true};
+        }
+        BigBinary v = a.toBigInteger();
+        BigBinary mask = BigBinary::fromUint(1).shiftedLeft(v.bitLength()) - BigBinary::fromUint(1);
+        return {true, "", Dyadic::fromBigInteger(v ^ mask), true};
+    }
+
+    // Функции - над 64-битным словом, как в Evaluator; у одноаргументных b = 0.
+    static ExactResult applyFunction(OpKind op, const Dyadic &a, const Dyadic &b) {
+        if (a.isNegative() || b.isNegative() || !a.isInteger() || !b.isInteger()) {
+            return failure(ErrorCode::FunctionOperands);
+        }
+        std::uint64_t x = 0, y = 0;
+        if (!a.toUint64(x) || !b.toUint64(y)) return failure(ErrorCode::None, "Функции считаются над 64-битным словом: аргумент длиннее 64 бит.");
+        std::uint64_t r = 0;
+        switch (op) {
+            case OpKind::Popcount: r = BitOps::popcount(x); break;
+            case OpKind::Clz:      r = BitOps::clz(x); break;
+            case OpKind::Ctz:      r = BitOps::ctz(x); break;
+            case OpKind::Parity:   r = BitOps::parity(x); break;
+            case OpKind::Rotl:     r = BitOps::rotl(x, y); break;
+            case OpKind::Rotr:     r = BitOps::rotr(x, y); break;
+            case OpKind::Pdep:     r = BitOps::pdep(x, y); break;
+            case OpKind::Pext:     r = BitOps::pext(x, y); break;
+            default:               return failure(ErrorCode::UnknownOperator);
+        }
+        return {true, "", Dyadic::fromUint64(r), true};
+    }
+
+    static ExactResult applyBinary(OpKind op, const Dyadic &a, const Dyadic &b, std::size_t fracBits) {
+        if (op == OpKind::Add) return {true, "", a + b, false};
+        if (op == OpKind::Sub) return {true, "", a - b, false};
+        if (op == OpKind::Mul) return {true, "", a * b, false};
+        if (op == OpKind::Div) {
+            if (b.isZero()) return failure(ErrorCode::DivisionByZero);
+            return {true, "", Dyadic::divide(a, b, fracBits), false};
+        }
+
+        if (op == OpKind::And || op == OpKind::Or || op == OpKind::Xor) {
+            if (a.isNegative() || b.isNegative() || !a.isInteger() || !b.isInteger()) {
+                return failure(ErrorCode::LogicOperands);
+            }
+            Dyadic r;
+            bitwiseOp(op, a, b, r);
+            return {true, "", r, true};
+        }
+
+        if (op == OpKind::Shl || op == OpKind::Shr) {
+            if (a.isNegative() || b.isNegative() || !a.isInteger() || !b.isInteger()) {
+                return failure(ErrorCode::ShiftOperands);
+            }
+            std::uint64_t n = 0;
+            if (!b.toUint64(n) || n > kMaxShift) {
+                return failure(ErrorCode::ShiftRange, "Сдвиг должен быть в диапазоне 0.." + std::to_string(kMaxShift) + ".");
+            }
+            if (op == OpKind::Shl) return {true, "", a.shiftedLeft(static_cast<std::size_t>(n)), true};
+            return {true, "", a.shiftedRight(static_cast<std::size_t>(n)), true};
+        }
+
+        if (isFunction(op)) return applyFunction(op, a, b);
+        return failure(ErrorCode::UnknownOperator);
+    }
+
+private:
+    // Один токен RPN над стеком значений; false - ошибка в err.
+    static bool step(const Token &t, std::string_view source, std::size_t fracBits, Environment *env,
+                     std::vector<Dyadic> &st, bool &lastWasBitwise, Fault &err) {
+        if (t.type == TokenType::Number) {
+            Dyadic v;
+            if (!literal(t, source, v, err)) return false;
+            st.push_back(std::move(v));
+            return true;
+        }
+        if (t.type == TokenType::Ident) {
+            Dyadic v;
+            if (!env) { err = unknownVariable(t.text(source)); return false; }
+            if (!env->lookupExact(t.text(source), v, err)) return false;
+            st.push_back(std::move(v));
+            return true;
+        }
+        if (t.type == TokenType::Op) {
+            if (Evaluator::isUnary(t.op)) {
+                if (st.empty()) { err.code = Evaluator::missingArgument(t.op); return false; }
+                if (t.op == OpKind::UnaryMinus) {
+                    st.back() = -st.back();
+                    lastWasBitwise = false;
+                } else {
+                    ExactResult r = t.op == OpKind::Not ? applyNot(st.back())
+                                                        : applyFunction(t.op, st.back(), Dyadic());
+                    if (!r.ok) { err = {r.code, std::move(r.error)}; return false; }
+                    st.back() = std::move(r.value);
+                    lastWasBitwise = true;
+                }
+            } else {
+                if (st.size() < 2) { err.code = ErrorCode::BinaryNoArgs; return false; }
+                Dyadic b = std::move(st.back()); st.pop_back();
+                Dyadic a = std::move(st.back()); st.pop_back();
+                ExactResult r = applyBinary(t.op, a, b, fracBits);
+                if (!r.ok) { err = {r.code, std::move(r.error)}; return false; }
+                st.push_back(std::move(r.value));
+                lastWasBitwise = r.isBitwiseResult;
+            }
+            return true;
+        }
+        err.code = ErrorCode::EvalUnexpectedToken;
+        return false;
+    }
+
+    // В точном режиме ассоциативны и сложение с умножением.
+    static bool isAssociative(OpKind op) {
+        return op == OpKind::Add || op == OpKind::Mul || op == OpKind::And || op == OpKind::Or || op == OpKind::Xor;
+    }
+
+    struct ChainPart {
+        Dyadic acc;
+        bool failed = false;
+        ChainFault fault;
+        Fault error;
+    };
+
+    // Цепочка блоками в несколько потоков; значение и первая ошибка - как у
+    // последовательного прохода. Переменные Environment читает не
+    // потокобезопасно, поэтому цепочку с ними считает обычный проход (false
+    // без ошибки).
+    static bool reduceChain(const std::vector<Token> &rpn, std::string_view source, std::size_t fracBits,
+                            const OperatorChain &c, ExactResult &out) {
+        for (std::size_t i = c.begin; i < c.end; ++i) {
+            if (rpn[i].type == TokenType::Ident) return false;
+        }
+        bool logic = c.op != OpKind::Add && c.op != OpKind::Mul;
+        std::vector<ChainPart> parts = ChainReducer::blocks<ChainPart>(c.terms(), [&](std::size_t lo, std::size_t hi,
+                                                                                        ChainPart &part) {
+            std::vector<Dyadic> st;
+            bool bitwise = false;
+            for (std::size_t k = lo; k < hi; ++k) {
+                st.clear();
+                Fault err;
+                ChainFault fault{k, false};
+                bool ok = true;
+                for (std::size_t i = c.first[k]; i <= c.last[k] && ok; ++i) {
+                    ok = step(rpn[i], source, fracBits, nullptr, st, bitwise, err);
+                }
+                if (ok && logic && (st.back().isNegative() || !st.back().isInteger())) {
+                    err.code = ErrorCode::LogicOperands;
+                    fault.operand = true;
+                    ok = false;
+                }
+                if (ok) {
+                    if (k == lo) part.acc = std::move(st.back());
+                    else part.acc = applyBinary(c.op, part.acc, st.back(), fracBits).value;
+                    continue;
+                }
+                if (!part.failed || fault.before(part.fault)) {
+                    part.failed = true;
+                    part.fault = fault;
+                    part.error = std::move(err);
+                }
+                // У t0 ошибка операнда всплывает только вместе с t1.
+                if (k > 0) break;
+            }
+        });
+
+        const ChainPart *first = nullptr;
+        for (const ChainPart &p : parts) {
+            if (p.failed && (!first || p.fault.before(first->fault))) first = &p;
+        }
+        if (first) {
+            out = failure(Fault(first->error));
+            return true;
+        }
+        Dyadic acc = std::move(parts[0].acc);
+        for (std::size_t b = 1; b < parts.size(); ++b) acc = applyBinary(c.op, acc, parts[b].acc, fracBits).value;
+        out = {true, "", std::move(acc), logic};
+        return true;
+    }
+
+public:
+    // source - текст, по которому построен rpn (из него читаются литералы).
+    // Длинные цепочки +, *, &, |, ^ сворачиваются параллельно (ChainFinder).
+    static ExactResult evalRpn(const std::vector<Token> &rpn, std::string_view source,
+                               std::size_t fracBits = kDefaultFracBits, Environment *env = nullptr) {
+        std::vector<Dyadic> st;
+        bool lastWasBitwise = false;
+        Fault err;
+
+        std::vector<OperatorChain> chains = ChainFinder::find(rpn, &isAssociative);
+        std::size_t next = 0;
+        for (std::size_t i = 0; i < rpn.size(); ++i) {
+            if (next < chains.size() && chains[next].begin == i) {
+                const OperatorChain &c = chains[next++];
+                ExactResult r;
+                if (reduceChain(rpn, source, fracBits, c, r)) {
+                    if (!r.ok) return r;
+                    st.push_back(std::move(r.value));
+                    lastWasBitwise = r.isBitwiseResult;
+                    i = c.end;
+                    continue;
+                }
+            }
+            if (!step(rpn[i], source, fracBits, env, st, lastWasBitwise, err)) return failure(std::move(err));
+        }
+
+        if (st.size() != 1) return failure(ErrorCode::NotReduced);
+        return {true, "", st.back(), lastWasBitwise};
+    }
+};
+
+#endif
@@ -0,0 +1,305 @@
+#ifndef INT_EVALUATOR_GUARD
+#define INT_EVALUATOR_GUARD
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "bitOps.h"
+#include "lexer.h"
+#include "status.h"
+
+// Целые фиксированной ширины: u8..u64 и i8..i64. Значения - родные целые
+// своей ширины, без double: результат точен во всём диапазоне типа, в том
+// числе выше 2^53. Литерал - целое двоичное, берутся его младшие N бит как
+// битовый шаблон (11111111 в i8 = -1).
+// Переполнение + - * << и унарного минуса по модулю 2^N (wrap) или ошибка
+// (trap); деление - целое, с отбрасыванием дробной части.
+enum class IntKind : std::uint8_t { U8, U16, U32, U64, I8, I16, I32, I64 };
+
+enum class Overflow : std::uint8_t { Wrap, Trap };
+
+constexpr const char *intKindName(IntKind kind) {
+    switch (kind) {
+        case IntKind::U8:  return "u8";
+        case IntKind::U16: return "u16";
+        case IntKind::U32: return "u32";
+        case IntKind::U64: return "u64";
+        case IntKind::I8:  return "i8";
+        case IntKind::I16: return "i16";
+        case IntKind::I32: return "i32";
+        case IntKind::I64: return "i64";
+    }
+    return "";
+}
+
+inline bool parseIntKind(std::string_view name, IntKind &out) {
+    for (std::uint8_t k = 0; k <= static_cast<std::uint8_t>(IntKind::I64); ++k) {
+        if (name == intKindName(static_cast<IntKind>(k))) {
+            out = static_cast<IntKind>(k);
+            return true;
+        }
+    }
+    return false;
+}
+
+struct IntResult {
+    bool ok = false;
+    std::string error;
+    std::uint64_t bits = 0;  // у знаковых - с расширением знака до 64 бит
+    bool isSigned = false;
+    ErrorCode code = ErrorCode::None;
+
+    // Двоичная запись (со знаком у отрицательных) и десятичная.
+    std::string toBinaryString() const {
+        bool neg = isSigned && static_cast<std::int64_t>(bits) < 0;
+        std::uint64_t mag = neg ? 0 - bits : bits;
+        std::string s = neg ? "-" : "";
+        int top = mag == 0 ? 0 : 63 - static_cast<int>(BitOps::clz(mag));
+        for (int b = top; b >= 0; --b) s += (mag >> b) & 1 ? '1' : '0';
+        return s;
+    }
+
+    std::string toDecimalString() const {
+        return isSigned ? std::to_string(static_cast<std::int64_t>(bits)) : std::to_string(bits);
+    }
+};
+
+// Ядра одного типа T и политики P. Всё считается в беззнаковом U (или в
+// unsigned для u8/u16, чтобы не было переполнения int после продвижения);
+// знаковый результат - приведение обратно, дополнительный код.
+template <typename T, Overflow P>
+class IntKernels {
+public:
+    enum class Fault { None, Overflow, DivisionByZero, ShiftRange };
+
+    static constexpr unsigned kBits = sizeof(T) * 8;
+
+private:
+    using U = std::make_unsigned_t<T>;
+    using W = std::conditional_t<(sizeof(U) < sizeof(unsigned)), unsigned, U>;
+
+    static constexpr std::uint64_t kMask = kBits == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << kBits) - 1;
+
+    static constexpr T wrap(W x) { return static_cast<T>(static_cast<U>(x)); }
+    static constexpr std::uint64_t raw(T a) { return static_cast<U>(a); }
+
+    static bool shiftCount(T b, unsigned &n) {
+        if (std::is_signed<T>::value && b < 0) return false;
+        if (raw(b) >= kBits) return false;
+        n = static_cast<unsigned>(raw(b));
+        return true;
+    }
+
+public:
+    // Целый двоичный литерал (101 или 101.00); в trap значащих бит не
+    // больше kBits. До 53 цифр лексер уже разобрал его в double без потерь.
+    static bool literal(const Token &t, std::string_view source, T &out, bool &fraction) {
+        std::uint64_t v = 0;
+        unsigned significant = 0;
+        fraction = false;
+        if (t.len <= 53) {
+            double d = t.number.toDouble();
+            v = static_cast<std::uint64_t>(d);
+            fraction = static_cast<double>(v) != d;
+            if (fraction) return false;
+            significant = v == 0 ? 0 : 64 - BitOps::clz(v);
+        } else {
+            bool point = false;
+            for (char c : t.text(source)) {
+                if (c == '.') point = true;
+                else if (point) fraction = fraction || c == '1';
+                else {
+                    if (significant != 0 || c == '1') ++significant;
+                    v = (v << 1) | static_cast<std::uint64_t>(c == '1');
+                }
+            }
+            if (fraction) return false;
+        }
+        if (P == Overflow::Trap && significant > kBits) return false;
+        out = wrap(static_cast<W>(v & kMask));
+        return true;
+    }
+
+    static Fault unary(OpKind op, T &a) {
+        switch (op) {
+            case OpKind::UnaryMinus:
+                if (P == Overflow::Trap) {
+                    if (std::is_signed<T>::value ? a == std::numeric_limits<T>::min() : a != 0) return Fault::Overflow;
+                }
+                a = wrap(W(0) - W(static_cast<U>(a)));
+                return Fault::None;
+            case OpKind::Not:      a = wrap(~W(static_cast<U>(a))); return Fault::None;
+            case OpKind::Popcount: a = static_cast<T>(BitOps::popcount(raw(a))); return Fault::None;
+            case OpKind::Parity:   a = static_cast<T>(BitOps::parity(raw(a))); return Fault::None;
+            case OpKind::Clz:      a = static_cast<T>(BitOps::clz(raw(a)) - (64 - kBits)); return Fault::None;
+            case OpKind::Ctz:      a = static_cast<T>(a == 0 ? kBits : BitOps::ctz(raw(a))); return Fault::None;
+            default:               return Fault::None;
+        }
+    }
+
+    // Результат в a. op - только бинарные операторы и функции.
+    static Fault binary(OpKind op, T &a, T b) {
+        unsigned n = 0;
+        switch (op) {
+            case OpKind::Add:
+                if (P == Overflow::Trap) return __builtin_add_overflow(a, b, &a) ? Fault::Overflow : Fault::None;
+                a = wrap(W(static_cast<U>(a)) + W(static_cast<U>(b)));
+                return Fault::None;
+            case OpKind::Sub:
+                if (P == Overflow::Trap) return __builtin_sub_overflow(a, b, &a) ? Fault::Overflow : Fault::None;
+                a = wrap(W(static_cast<U>(a)) - W(static_cast<U>(b)));
+                return Fault::None;
+            case OpKind::Mul:
+                if (P == Overflow::Trap) return __builtin_mul_overflow(a, b, &a) ? Fault::Overflow : Fault::None;
+                a = wrap(W(static_cast<U>(a)) * W(static_cast<U>(b)));
+                return Fault::None;
+            case OpKind::Div:
+                if (b == 0) return Fault::DivisionByZero;
+                // min / -1 - единственное переполнение деления.
+                if (std::is_signed<T>::value && a == std::numeric_limits<T>::min() && b == static_cast<T>(-1)) {
+                    if (P == Overflow::Trap) return Fault::Overflow;
+                    return Fault::None;
+                }
+                a = static_cast<T>(a / b);
+                return Fault::None;
+            case OpKind::Shl: {
+                if (!shiftCount(b, n)) return Fault::ShiftRange;
+                T r = wrap(W(static_cast<U>(a)) << n);
+                if (P == Overflow::Trap && static_cast<T>(r >> n) != a) return Fault::Overflow;
+                a = r;
+                return Fault::None;
+            }
+            case OpKind::Shr:
+                if (!shiftCount(b, n)) return Fault::ShiftRange;
+                a = static_cast<T>(a >> n);  // у знаковых - арифметический
+                return Fault::None;
+            case OpKind::And: a = static_cast<T>(a & b); return Fault::None;
+            case OpKind::Or:  a = static_cast<T>(a | b); return Fault::None;
+            case OpKind::Xor: a = static_cast<T>(a ^ b); return Fault::None;
+            case OpKind::Rotl:
+            case OpKind::Rotr: {
+                n = static_cast<unsigned>(raw(b) % kBits);
+                if (op == OpKind::Rotr) n = (kBits - n) % kBits;
+                std::uint64_t x = raw(a);
+                a = wrap(static_cast<W>(((x << n) | (x >> ((kBits - n) % kBits))) & kMask));
+                return Fault::None;
+            }
+            case OpKind::Pdep: a = wrap(static_cast<W>(BitOps::pdep(raw(a), raw(b)))); return Fault::None;
+            case OpKind::Pext: a = wrap(static_cast<W>(BitOps::pext(raw(a), raw(b)))); return Fault::None;
+            default:           return Fault::None;
+        }
+    }
+};
+
+// Тот же RPN, что у остальных режимов; цикл вычисления свой для каждого
+// типа и политики, выбор - один раз на выражение.
+class IntEvaluator {
+private:
+    static IntResult failure(const std::string &err) {
+        return {false, err, 0, false};
+    }
+
+    // Пустой text - текст кода.
+    static IntResult failure(ErrorCode code, std::string text = {}) {
+        if (text.empty()) text = errorText(code);
+        return {false, std::move(text), 0, false, code};
+    }
+
+    // Стек - слова по 64 бита, общий для всех типов: вызывающий держит один.
+    template <typename T, Overflow P>
+    static IntResult run(const std::vector<Token> &rpn, std::string_view source, IntKind kind,
+                         std::vector<std::uint64_t> &stack) {
+        using K = IntKernels<T, P>;
+        if (stack.size() < rpn.size()) stack.resize(rpn.size());
+        std::uint64_t *st = stack.data();
+        std::size_t depth = 0;
+
+        for (const Token &t : rpn) {
+            if (t.type == TokenType::Number) {
+                T v = 0;
+                bool fraction = false;
+                if (!K::literal(t, source, v, fraction)) {
+                    if (fraction) {
+                        return failure(std::string("В режиме ") + intKindName(kind) +
+                                       " числа - только целые двоичные литералы: '" + std::string(t.text(source)) + "'");
+                    }
+                    return failure(std::string("Литерал не помещается в ") + intKindName(kind) + ": '" +
+                                   std::string(t.text(source)) + "'");
+                }
+                st[depth++] = static_cast<std::uint64_t>(v);
+                continue;
+            }
+            if (t.type == TokenType::Ident) {
+                return failure(std::string("Переменные недоступны в режиме ") + intKindName(kind) + ": '" +
+                               std::string(t.text(source)) + "'");
+            }
+            if (t.type != TokenType::Op) return failure(ErrorCode::EvalUnexpectedToken);
+
+            typename K::Fault f = K::Fault::None;
+            if (operandCount(t.op) == 1) {
+                if (depth == 0) {
+                    return failure(t.op == OpKind::Not ? ErrorCode::NotNoArg : ErrorCode::UnaryNoArg);
+                }
+                T a = static_cast<T>(st[depth - 1]);
+                f = K::unary(t.op, a);
+                st[depth - 1] = static_cast<std::uint64_t>(a);
+            } else {
+                if (depth < 2 || t.op == OpKind::Call) return failure(ErrorCode::BinaryNoArgs);
+                --depth;
+                T a = static_cast<T>(st[depth - 1]);
+                f = K::binary(t.op, a, static_cast<T>(st[depth]));
+                st[depth - 1] = static_cast<std::uint64_t>(a);
+            }
+            switch (f) {
+                case K::Fault::None:
+                    break;
+                case K::Fault::Overflow:
+                    return failure(std::string("Переполнение: результат не помещается в ") + intKindName(kind));
+                case K::Fault::DivisionByZero:
+                    return failure(ErrorCode::DivisionByZero);
+                case K::Fault::ShiftRange:
+                    return failure(ErrorCode::ShiftRange, "Сдвиг должен быть в диапазоне 0.." + std::to_string(K::kBits - 1) + ".");
+            }
+        }
+
+        if (depth != 1) return failure(ErrorCode::NotReduced);
+        T v = static_cast<T>(st[0]);
+        return {true, "", static_cast<std::uint64_t>(static_cast<std::int64_t>(v)), std::is_signed<T>::value};
+    }
+
+    template <typename T>
+    static IntResult runAs(const std::vector<Token> &rpn, std::string_view source, IntKind kind, Overflow overflow,
+                           std::vector<std::uint64_t> &stack) {
+        if (overflow == Overflow::Trap) return run<T, Overflow::Trap>(rpn, source, kind, stack);
+        return run<T, Overflow::Wrap>(rpn, source, kind, stack);
+    }
+
+public:
+    // После прогрева stack память не выделяется (кроме текста ошибки).
+    static IntResult evalRpn(const std::vector<Token> &rpn, std::string_view source, IntKind kind, Overflow overflow,
+                             std::vector<std::uint64_t> &stack) {
+        switch (kind) {
+            case IntKind::U8:  return runAs<std::uint8_t>(rpn, source, kind, overflow, stack);
+            case IntKind::U16: return runAs<std::uint16_t>(rpn, source, kind, overflow, stack);
+            case IntKind::U32: return runAs<std::uint32_t>(rpn, source, kind, overflow, stack);
+            case IntKind::U64: return runAs<std::uint64_t>(rpn, source, kind, overflow, stack);
+            case IntKind::I8:  return runAs<std::int8_t>(rpn, source, kind, overflow, stack);
+            case IntKind::I16: return runAs<std::int16_t>(rpn, source, kind, overflow, stack);
+            case IntKind::I32: return runAs<std::int32_t>(rpn, source, kind, overflow, stack);
+            case IntKind::I64: return runAs<std::int64_t>(rpn, source, kind, overflow, stack);
+        }
+        return failure(ErrorCode::UnknownOperator);
+    }
+
+    static IntResult evalRpn(const std::vector<Token> &rpn, std::string_view source, IntKind kind,
+                             Overflow overflow = Overflow::Wrap) {
+        std::vector<std::uint64_t> stack;
+        return evalRpn(rpn, source, kind, overflow, stack);
+    }
+};
+
+#endif
@@ -0,0 +1,331 @@
+#ifndef JIT_GUARD
+#define JIT_GUARD
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define BINCALC_JIT 1
+#else
+#define BINCALC_JIT 0
+#endif
+
+#include "bytecode.h"
+
+// Необязательный уровень JIT: горячее выражение (после threshold запусков
+// из кэша планов) переводится из RPN в прямолинейный x86-64 код.
+// Значения - те же double, что у VM: + - * / считаются инструкциями SSE2,
+// логика и сдвиги - целыми инструкциями, если оба аргумента точные
+// неотрицательные целые (и сдвиг 0..63). Иначе, и для проверки деления на
+// ноль, вызывается ядро Evaluator - поэтому результаты и тексты ошибок
+// совпадают с интерпретатором. Всё, что JIT не умеет, остаётся на VM.
+
+// Аргумент скомпилированного кода (смещения полей зашиты в код).
+struct JitFrame {
+    const double *consts;  // +0
+    const double *vars;    // +8
+    double *stack;         // +16
+    const char *err;       // +24
+};
+
+class JitCode {
+private:
+    void *mem = nullptr;
+    std::size_t size = 0;
+
+public:
+    std::vector<double> pool;
+    std::size_t depth = 0;
+
+    JitCode() = default;
+    JitCode(const JitCode &) = delete;
+    JitCode &operator=(const JitCode &) = delete;
+
+    ~JitCode() {
+#if BINCALC_JIT
+        if (mem) munmap(mem, size);
+#endif
+    }
+
+    // Копирует код в свежие страницы и делает их исполняемыми (без записи).
+    bool load(const std::vector<std::uint8_t> &code) {
+#if BINCALC_JIT
+        long page = sysconf(_SC_PAGESIZE);
+        size = (code.size() + page - 1) / page * page;
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return false;
+        std::memcpy(p, code.data(), code.size());
+        if (mprotect(p, size, PROT_READ | PROT_EXEC) != 0) {
+            munmap(p, size);
+            return false;
+        }
+        mem = p;
+        return true;
+#else
+        (void)code;
+        return false;
+#endif
+    }
+
+    bool run(JitFrame &frame) const {
+        using Entry = int (*)(JitFrame *);
+        return reinterpret_cast<Entry>(mem)(&frame) != 0;
+    }
+};
+
+class JitCompiler {
+private:
+    // Регистры: rbx - JitFrame*, r12 - стек значений, r13 - пул констант.
+    enum Reg : std::uint8_t { Rax = 0, Rcx = 1, Rbx = 3, R12 = 12, R13 = 13 };
+
+    struct Asm {
+        std::vector<std::uint8_t> b;
+
+        void bytes(std::initializer_list<std::uint8_t> v) { b.insert(b.end(), v); }
+
+        void imm32(std::uint32_t v) {
+            for (int k = 0; k < 4; ++k) b.push_back(static_cast<std::uint8_t>(v >> (8 * k)));
+        }
+
+        void imm64(std::uint64_t v) {
+            for (int k = 0; k < 8; ++k) b.push_back(static_cast<std::uint8_t>(v >> (8 * k)));
+        }
+
+        // [prefix] [REX] opcode... modrm(reg, [base + disp32])
+        void mem(std::uint8_t prefix, bool wide, std::initializer_list<std::uint8_t> op,
+                 std::uint8_t reg, std::uint8_t base, std::int32_t disp) {
+            if (prefix) b.push_back(prefix);
+            std::uint8_t rex = static_cast<std::uint8_t>((wide ? 8 : 0) | (reg >= 8 ? 4 : 0) | (base >= 8 ? 1 : 0));
+            if (rex) b.push_back(static_cast<std::uint8_t>(0x40 | rex));
+            b.insert(b.end(), op);
+            b.push_back(static_cast<std::uint8_t>(0x80 | ((reg & 7) << 3) | (base & 7)));
+            if ((base & 7) == 4) b.push_back(0x24);
+            imm32(static_cast<std::uint32_t>(disp));
+        }
+
+        void loadSd(std::uint8_t xmm, std::uint8_t base, std::int32_t disp) { mem(0xF2, false, {0x0F, 0x10}, xmm, base, disp); }
+        void storeSd(std::uint8_t xmm, std::uint8_t base, std::int32_t disp) { mem(0xF2, false, {0x0F, 0x11}, xmm, base, disp); }
+        void ucomisdMem(std::uint8_t xmm, std::uint8_t base, std::int32_t disp) { mem(0x66, false, {0x0F, 0x2E}, xmm, base, disp); }
+
+        // Переход rel32 вперёд; возвращает место для patch().
+        std::size_t jump(std::initializer_list<std::uint8_t> op) {
+            bytes(op);
+            imm32(0);
+            return b.size() - 4;
+        }
+
+        void patch(std::size_t at) {
+            std::uint32_t rel = static_cast<std::uint32_t>(b.size() - (at + 4));
+            std::memcpy(&b[at], &rel, 4);
+        }
+    };
+
+    static std::int32_t slot(std::size_t k) { return static_cast<std::int32_t>(8 * k); }
+
+    // cvttsd2si; должно быть >= 0 и обратно давать то же double (xmm2 - рабочий).
+    static void exactNonNeg(Asm &a, std::uint8_t gpr, std::uint8_t xmm, std::vector<std::size_t> &slow) {
+        a.bytes({0xF2, 0x48, 0x0F, 0x2C, static_cast<std::uint8_t>(0xC0 | (gpr << 3) | xmm)});
+        a.bytes({0x48, 0x85, static_cast<std::uint8_t>(0xC0 | (gpr << 3) | gpr)});
+        slow.push_back(a.jump({0x0F, 0x88}));  // js
+        a.bytes({0xF2, 0x48, 0x0F, 0x2A, static_cast<std::uint8_t>(0xD0 | gpr)});
+        a.bytes({0x66, 0x0F, 0x2E, static_cast<std::uint8_t>(0xD0 | xmm)});
+        slow.push_back(a.jump({0x0F, 0x85}));  // jne
+        slow.push_back(a.jump({0x0F, 0x8A}));  // jp
+    }
+
+    // Вызов ядра Evaluator: kernel(xmm0, xmm1, stack[k], frame->err).
+    static void callKernel(Asm &a, BinaryKernel k, std::size_t at, std::vector<std::size_t> &fails) {
+        a.mem(0, true, {0x8D}, 7, R12, slot(at));     // lea rdi, [r12 + 8k]
+        a.bytes({0x48, 0x8D, 0x73, 0x18});            // lea rsi, [rbx + 24]
+        a.bytes({0x48, 0xB8});                        // mov rax, imm64
+        a.imm64(reinterpret_cast<std::uint64_t>(k));
+        a.bytes({0xFF, 0xD0});                        // call rax
+        a.bytes({0x84, 0xC0});                        // test al, al
+        fails.push_back(a.jump({0x0F, 0x84}));        // jz fail
+    }
+
+    // То же для NOT и функций одного аргумента: kernel(stack[k], stack[k], frame->err).
+    static void callUnary(Asm &a, UnaryKernel k, std::size_t at, std::vector<std::size_t> &fails) {
+        a.loadSd(0, R12, slot(at));
+        a.mem(0, true, {0x8D}, 7, R12, slot(at));     // lea rdi, [r12 + 8k]
+        a.bytes({0x48, 0x8D, 0x73, 0x18});            // lea rsi, [rbx + 24]
+        a.bytes({0x48, 0xB8});                        // mov rax, imm64
+        a.imm64(reinterpret_cast<std::uint64_t>(k));
+        a.bytes({0xFF, 0xD0});                        // call rax
+        a.bytes({0x84, 0xC0});                        // test al, al
+        fails.push_back(a.jump({0x0F, 0x84}));        // jz fail
+    }
+
+    static void integerOp(Asm &a, OpKind op, std::size_t at, std::vector<std::size_t> &fails) {
+        std::vector<std::size_t> slow;
+        exactNonNeg(a, Rax, 0, slow);
+        exactNonNeg(a, Rcx, 1, slow);
+        switch (op) {
+            case OpKind::And: a.bytes({0x48, 0x21, 0xC8}); break;
+            case OpKind::Or:  a.bytes({0x48, 0x09, 0xC8}); break;
+            case OpKind::Xor: a.bytes({0x48, 0x31, 0xC8}); break;
+            case OpKind::Shl:
+            case OpKind::Shr:
+                a.bytes({0x48, 0x83, 0xF9, 0x3F});    // cmp rcx, 63
+                slow.push_back(a.jump({0x0F, 0x87}));  // ja
+                a.bytes({0x48, 0xD3, static_cast<std::uint8_t>(op == OpKind::Shl ? 0xE0 : 0xE8)});
+                break;
+            default: break;
+        }
+        a.bytes({0xF2, 0x48, 0x0F, 0x2A, 0xC0});      // cvtsi2sd xmm0, rax
+        a.storeSd(0, R12, slot(at));
+        std::size_t done = a.jump({0xE9});
+        for (std::size_t s : slow) a.patch(s);
+        callKernel(a, Evaluator::binaryKernel(op), at, fails);
+        a.patch(done);
+    }
+
+    static void divide(Asm &a, std::size_t at, std::size_t epsIndex, std::vector<std::size_t> &fails) {
+        // |b| >= 1e-12 - делим сразу; иначе (и для NaN) решает divKernel.
+        a.ucomisdMem(1, R13, slot(epsIndex));
+        std::size_t fast1 = a.jump({0x0F, 0x83});     // jae
+        a.loadSd(2, R13, slot(epsIndex + 1));
+        a.bytes({0x66, 0x0F, 0x2E, 0xD1});            // ucomisd xmm2, xmm1
+        std::size_t fast2 = a.jump({0x0F, 0x83});     // jae
+        callKernel(a, Evaluator::binaryKernel(OpKind::Div), at, fails);
+        std::size_t done = a.jump({0xE9});
+        a.patch(fast1);
+        a.patch(fast2);
+        a.bytes({0xF2, 0x0F, 0x5E, 0xC1});            // divsd xmm0, xmm1
+        a.storeSd(0, R12, slot(at));
+        a.patch(done);
+    }
+
+public:
+    static bool available() { return BINCALC_JIT != 0; }
+
+    // nullptr, если выражение (или платформа) не поддерживается.
+    // functions - те же, что при компиляции p в байткод.
+    static std::unique_ptr<JitCode> compile(const std::string &expr, const Program &p,
+                                            const FunctionLibrary *functions = nullptr) {
+        if (!available() || !p.parsed) return nullptr;
+        for (const Instr &in : p.code) {
+            if (in.code == OpCode::Fail) return nullptr;
+        }
+        ParseResult pr = parseWithFunctions(functions, expr);
+        if (!pr.ok) return nullptr;
+        std::string_view source = pr.source(expr);
+
+        auto code = std::make_unique<JitCode>();
+        Asm a;
+        std::vector<std::size_t> fails;
+
+        a.bytes({0x53, 0x41, 0x54, 0x41, 0x55});      // push rbx; push r12; push r13
+        a.bytes({0x48, 0x89, 0xFB});                  // mov rbx, rdi
+        a.bytes({0x4C, 0x8B, 0x63, 0x10});            // mov r12, [rbx + 16]
+        a.bytes({0x4C, 0x8B, 0x6B, 0x00});            // mov r13, [rbx]
+
+        // Пул: сначала пороги для проверки деления, потом литералы.
+        code->pool = {1e-12, -1e-12};
+        std::size_t depth = 0;
+        for (const Token &t : pr.rpn) {
+            if (t.type == TokenType::Number) {
+                code->pool.push_back(t.number.toDouble());
+                a.loadSd(0, R13, slot(code->pool.size() - 1));
+                a.storeSd(0, R12, slot(depth++));
+            } else if (t.type == TokenType::Ident) {
+                std::string_view name = t.text(source);
+                std::size_t k = 0;
+                while (k < p.vars.size() && p.vars[k] != name) ++k;
+                if (k == p.vars.size()) return nullptr;
+                a.bytes({0x48, 0x8B, 0x43, 0x08});    // mov rax, [rbx + 8]
+                a.loadSd(0, Rax, slot(k));
+                a.storeSd(0, R12, slot(depth++));
+            } else if (t.type == TokenType::Op && t.op == OpKind::UnaryMinus) {
+                if (depth < 1) return nullptr;
+                a.mem(0, true, {0x8B}, Rax, R12, slot(depth - 1));  // mov rax, [slot]
+                a.bytes({0x48, 0x0F, 0xBA, 0xF8, 0x3F});           // btc rax, 63
+                a.mem(0, true, {0x89}, Rax, R12, slot(depth - 1));  // mov [slot], rax
+            } else if (t.type == TokenType::Op && Evaluator::isUnary(t.op)) {
+                // NOT, popcount, clz, ctz, parity - всегда через ядро.
+                UnaryKernel k = Evaluator::unaryKernel(t.op);
+                if (depth < 1 || !k) return nullptr;
+                callUnary(a, k, depth - 1, fails);
+            } else if (t.type == TokenType::Op) {
+                if (depth < 2 || !Evaluator::binaryKernel(t.op)) return nullptr;
+                std::size_t at = depth - 2;
+                a.loadSd(0, R12, slot(at));
+                a.loadSd(1, R12, slot(at + 1));
+                switch (t.op) {
+                    case OpKind::Add: a.bytes({0xF2, 0x0F, 0x58, 0xC1}); a.storeSd(0, R12, slot(at)); break;
+                    case OpKind::Sub: a.bytes({0xF2, 0x0F, 0x5C, 0xC1}); a.storeSd(0, R12, slot(at)); break;
+                    case OpKind::Mul: a.bytes({0xF2, 0x0F, 0x59, 0xC1}); a.storeSd(0, R12, slot(at)); break;
+                    case OpKind::Div: divide(a, at, 0, fails); break;
+                    case OpKind::And:
+                    case OpKind::Or:
+                    case OpKind::Xor:
+                    case OpKind::Shl:
+                    case OpKind::Shr: integerOp(a, t.op, at, fails); break;
+                    default: callKernel(a, Evaluator::binaryKernel(t.op), at, fails); break;  // rotl, pdep, ...
+                }
+                --depth;
+            } else {
+                return nullptr;
+            }
+            if (depth > code->depth) code->depth = depth;
+        }
+        if (depth != 1) return nullptr;
+
+        a.bytes({0xB8, 0x01, 0x00, 0x00, 0x00});      // mov eax, 1
+        std::size_t out = a.jump({0xE9});
+        for (std::size_t f : fails) a.patch(f);
+        a.bytes({0x31, 0xC0});                        // xor eax, eax
+        a.patch(out);
+        a.bytes({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3}); // pop r13; pop r12; pop rbx; ret
+
+        if (!code->load(a.b)) return nullptr;
+        return code;
+    }
+};
+
+// Счётчик запусков и переключение с VM на машинный код. Если компиляция не
+// удалась, программа помечается и дальше всегда идёт через VM.
+class JitTier {
+private:
+    std::size_t threshold;
+    std::vector<double> stack;
+    std::size_t compiledCount = 0;
+    std::size_t nativeRuns = 0;
+
+public:
+    explicit JitTier(std::size_t hits = 0) : threshold(hits) {}
+
+    void setThreshold(std::size_t hits) { threshold = hits; }
+    std::size_t hitThreshold() const { return threshold; }
+    std::size_t compiled() const { return compiledCount; }
+    std::size_t runs() const { return nativeRuns; }
+
+    EvalResult run(Program &p, const std::string &expr, BytecodeVm &vm, Environment *env,
+                   const FunctionLibrary *functions = nullptr) {
+        if (!p.native) {
+            if (threshold == 0 || p.jitFailed || ++p.hits < threshold) return vm.run(p, env);
+            p.native = JitCompiler::compile(expr, p, functions);
+            if (!p.native) {
+                p.jitFailed = true;
+                return vm.run(p, env);
+            }
+            ++compiledCount;
+        }
+
+        EvalResult fail;
+        if (!vm.loadVariables(p, env, fail)) return fail;
+        if (stack.size() < p.native->depth) stack.resize(p.native->depth);
+
+        JitFrame frame{p.native->pool.data(), vm.variables(), stack.data(), nullptr};
+        ++nativeRuns;
+        if (!p.native->run(frame)) return {false, frame.err, BinaryNumber(), false, codeOf(frame.err)};
+        return {true, "", BinaryNumber(stack[0]), p.isBitwiseResult};
+    }
+};
+
+#endif
@@ -0,0 +1,336 @@
+#ifndef LEXER_GUARD
+#define LEXER_GUARD
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include "binaryNumber.h"
+
+enum class TokenType {
+    Number,
+    Ident,
+    Param,  // параметр в теле функции пользователя, pos - номер параметра
+    Op,
+    LParen,
+    RParen,
+    Comma,
+    End
+};
+
+enum class OpKind {
+    Add, Sub, Mul, Div,
+    Shl, Shr,
+    And, Or, Xor,
+    Not,
+    UnaryMinus,
+    // Встроенные функции, записываются как имя(аргументы).
+    Popcount, Clz, Ctz, Parity,
+    Rotl, Rotr, Pdep, Pext,
+    // Вызов функции пользователя: имя - в pos/len, число аргументов - в commas.
+    // До вычислителей не доходит, FunctionLibrary подставляет тело.
+    Call
+};
+
+// Число аргументов функции; 0 - не функция.
+constexpr int functionArity(OpKind op) {
+    switch (op) {
+        case OpKind::Popcount:
+        case OpKind::Clz:
+        case OpKind::Ctz:
+        case OpKind::Parity: return 1;
+        case OpKind::Rotl:
+        case OpKind::Rotr:
+        case OpKind::Pdep:
+        case OpKind::Pext:   return 2;
+        default:             return 0;
+    }
+}
+
+constexpr bool isFunction(OpKind op) { return functionArity(op) != 0; }
+
+constexpr const char *functionName(OpKind op) {
+    switch (op) {
+        case OpKind::Popcount: return "popcount";
+        case OpKind::Clz:      return "clz";
+        case OpKind::Ctz:      return "ctz";
+        case OpKind::Parity:   return "parity";
+        case OpKind::Rotl:     return "rotl";
+        case OpKind::Rotr:     return "rotr";
+        case OpKind::Pdep:     return "pdep";
+        case OpKind::Pext:     return "pext";
+        default:               return "";
+    }
+}
+
+// Операндов у оператора или функции.
+constexpr int operandCount(OpKind op) {
+    if (op == OpKind::UnaryMinus || op == OpKind::Not) return 1;
+    return isFunction(op) ? functionArity(op) : 2;
+}
+
+constexpr int precedence(OpKind op) {
+    switch (op) {
+        // Функция в стеке всегда лежит под своей '(' и снимается по ')',
+        // так что с операторами её приоритет не сравнивается.
+        case OpKind::Popcount:
+        case OpKind::Clz:
+        case OpKind::Ctz:
+        case OpKind::Parity:
+        case OpKind::Rotl:
+        case OpKind::Rotr:
+        case OpKind::Pdep:
+        case OpKind::Pext:
+        case OpKind::Call:       return 7;
+
+        case OpKind::UnaryMinus: return 6;
+        case OpKind::Not:        return 6;
+
+        case OpKind::Mul:
+        case OpKind::Div:        return 5;
+
+        case OpKind::Add:
+        case OpKind::Sub:        return 4;
+
+        case OpKind::Shl:
+        case OpKind::Shr:        return 3;
+
+        case OpKind::And:        return 2;
+        case OpKind::Xor:        return 1;
+        case OpKind::Or:         return 0;
+    }
+    return -1;
+}
+
+
+constexpr bool isRightAssociative(OpKind op) {
+    return op == OpKind::UnaryMinus || op == OpKind::Not;
+}
+
+// Токен не владеет текстом: pos/len указывают в исходную строку выражения.
+// End с len > 0 означает нераспознанный фрагмент.
+struct Token {
+    TokenType type = TokenType::End;
+    BinaryNumber number;
+    OpKind op = OpKind::Add;
+    std::uint32_t pos = 0;
+    std::uint32_t len = 0;
+    std::uint8_t commas = 0;  // у '(' вызова функции в стеке парсера - запятые внутри
+
+    constexpr std::string_view text(std::string_view source) const { return source.substr(pos, len); }
+};
+
+enum class CharClass : std::uint8_t {
+    Other,
+    Space,
+    Bit,      // 0 1
+    Digit,    // 2..9, только внутри имён
+    Dot,
+    Alpha,    // буквы и '_'
+    OpChar,   // + - * / & | ^ ~
+    Less,
+    Greater,
+    LParen,
+    RParen,
+    Comma
+};
+
+struct CharTables {
+    std::array<CharClass, 256> cls{};
+    std::array<OpKind, 256> op{};
+};
+
+constexpr CharTables makeCharTables() {
+    CharTables t{};
+    for (int c = 0; c < 256; ++c) {
+        t.cls[c] = CharClass::Other;
+        t.op[c] = OpKind::Add;
+    }
+    for (int c = 'a'; c <= 'z'; ++c) t.cls[c] = CharClass::Alpha;
+    for (int c = 'A'; c <= 'Z'; ++c) t.cls[c] = CharClass::Alpha;
+    for (int c = '2'; c <= '9'; ++c) t.cls[c] = CharClass::Digit;
+    t.cls['_'] = CharClass::Alpha;
+    for (char c : {' ', '\t', '\n', '\v', '\f', '\r'}) t.cls[static_cast<unsigned char>(c)] = CharClass::Space;
+    t.cls['0'] = t.cls['1'] = CharClass::Bit;
+    t.cls['.'] = CharClass::Dot;
+    t.cls['<'] = CharClass::Less;
+    t.cls['>'] = CharClass::Greater;
+    t.cls['('] = CharClass::LParen;
+    t.cls[')'] = CharClass::RParen;
+    t.cls[','] = CharClass::Comma;
+
+    const char ops[] = {'+', '-', '*', '/', '&', '|', '^', '~'};
+    const OpKind kinds[] = {OpKind::Add, OpKind::Sub, OpKind::Mul, OpKind::Div,
+                            OpKind::And, OpKind::Or, OpKind::Xor, OpKind::Not};
+    for (int k = 0; k < 8; ++k) {
+        t.cls[static_cast<unsigned char>(ops[k])] = CharClass::OpChar;
+        t.op[static_cast<unsigned char>(ops[k])] = kinds[k];
+    }
+    return t;
+}
+
+inline constexpr CharTables kCharTables = makeCharTables();
+
+struct KeywordEntry {
+    const char *word;
+    std::uint8_t len;
+    OpKind op;
+};
+
+// and/or/xor/not по совершенному хэшу (2 * первая буква + длина) & 7.
+inline constexpr KeywordEntry kOperatorWords[8] = {
+    {"or", 2, OpKind::Or}, {nullptr, 0, OpKind::Add}, {nullptr, 0, OpKind::Add}, {"xor", 3, OpKind::Xor},
+    {nullptr, 0, OpKind::Add}, {"and", 3, OpKind::And}, {nullptr, 0, OpKind::Add}, {"not", 3, OpKind::Not},
+};
+
+// Имена функций - короткий список, ищется перебором по длине и словам.
+inline constexpr KeywordEntry kFunctionWords[] = {
+    {"popcount", 8, OpKind::Popcount}, {"clz", 3, OpKind::Clz},   {"ctz", 3, OpKind::Ctz},
+    {"parity", 6, OpKind::Parity},     {"rotl", 4, OpKind::Rotl}, {"rotr", 4, OpKind::Rotr},
+    {"pdep", 4, OpKind::Pdep},         {"pext", 4, OpKind::Pext},
+};
+
+class Lexer {
+private:
+    std::string_view s;
+    std::size_t i = 0;
+
+    static constexpr CharClass classOf(char c) { return kCharTables.cls[static_cast<unsigned char>(c)]; }
+
+    static constexpr bool isNameChar(char c) {
+        CharClass k = classOf(c);
+        return k == CharClass::Alpha || k == CharClass::Bit || k == CharClass::Digit;
+    }
+
+    // Длина буквенного начала слова. Ключевое слово кончается на первой
+    // цифре: "1and1" - это 1 and 1, как и до появления переменных.
+    static constexpr std::size_t letters(std::string_view w) {
+        std::size_t n = 0;
+        while (n < w.size() && classOf(w[n]) == CharClass::Alpha) ++n;
+        return n;
+    }
+
+    // Сравнение без учёта регистра без копирования слова.
+    static constexpr bool sameWord(std::string_view w, const char *word) {
+        for (std::size_t j = 0; j < w.size(); ++j) {
+            if (static_cast<char>(w[j] | 0x20) != word[j]) return false;
+        }
+        return true;
+    }
+
+    static constexpr bool function(std::string_view w, OpKind &op) {
+        for (const KeywordEntry &k : kFunctionWords) {
+            if (k.len == w.size() && sameWord(w, k.word)) {
+                op = k.op;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static constexpr bool keyword(std::string_view w, OpKind &op) {
+        if (w.size() >= 2 && w.size() <= 3) {
+            unsigned h = (2u * static_cast<unsigned char>(w[0] | 0x20) + static_cast<unsigned>(w.size())) & 7u;
+            const KeywordEntry &k = kOperatorWords[h];
+            if (k.len == w.size() && sameWord(w, k.word)) {
+                op = k.op;
+                return true;
+            }
+        }
+        return function(w, op);
+    }
+
+    constexpr Token make(TokenType type, std::size_t start, OpKind op = OpKind::Add) const {
+        Token t;
+        t.type = type;
+        t.op = op;
+        t.pos = static_cast<std::uint32_t>(start);
+        t.len = static_cast<std::uint32_t>(i - start);
+        return t;
+    }
+
+public:
+    explicit constexpr Lexer(std::string_view input) : s(input) {}
+
+    // Имя переменной: буква или '_', дальше буквы, цифры, '_'; буквенное
+    // начало - не ключевое слово (иначе лексер разобьёт имя).
+    static constexpr bool isIdentifier(std::string_view w) {
+        if (w.empty() || classOf(w[0]) != CharClass::Alpha) return false;
+        for (char c : w) {
+            if (!isNameChar(c)) return false;
+        }
+        OpKind op = OpKind::Add;
+        return !keyword(w.substr(0, letters(w)), op);
+    }
+
+    // and/or/xor/not и имена функций без учёта регистра.
+    static constexpr bool isKeyword(std::string_view w, OpKind &op) { return keyword(w, op); }
+
+    Token nextToken() {
+        Token t = scan();
+        if (t.type == TokenType::Number && !BinaryNumber::fromBinaryString(t.text(s), t.number)) {
+            t.type = TokenType::End;
+        }
+        return t;
+    }
+
+    // Следующий токен без значения числа: у Number только pos/len. Годится
+    // для вычисления при компиляции (constExpr.h), nextToken - поверх него.
+    constexpr Token scan() {
+        while (i < s.size() && classOf(s[i]) == CharClass::Space) ++i;
+        if (i >= s.size()) return make(TokenType::End, i);
+
+        std::size_t start = i;
+        char c = s[i];
+
+        switch (classOf(c)) {
+            case CharClass::LParen:
+                ++i;
+                return make(TokenType::LParen, start);
+            case CharClass::RParen:
+                ++i;
+                return make(TokenType::RParen, start);
+            case CharClass::Comma:
+                ++i;
+                return make(TokenType::Comma, start);
+            case CharClass::Less:
+                ++i;
+                if (i < s.size() && s[i] == '<') { ++i; return make(TokenType::Op, start, OpKind::Shl); }
+                return make(TokenType::End, start);
+            case CharClass::Greater:
+                ++i;
+                if (i < s.size() && s[i] == '>') { ++i; return make(TokenType::Op, start, OpKind::Shr); }
+                return make(TokenType::End, start);
+            case CharClass::OpChar:
+                ++i;
+                return make(TokenType::Op, start, kCharTables.op[static_cast<unsigned char>(c)]);
+            case CharClass::Alpha: {
+                i = start + letters(s.substr(start));
+                OpKind op = OpKind::Add;
+                if (keyword(s.substr(start, i - start), op)) return make(TokenType::Op, start, op);
+                while (i < s.size() && isNameChar(s[i])) ++i;
+                return make(TokenType::Ident, start);
+            }
+            case CharClass::Bit:
+            case CharClass::Dot: {
+                int dotCount = 0;
+                while (i < s.size()) {
+                    CharClass k = classOf(s[i]);
+                    if (k == CharClass::Bit) { ++i; continue; }
+                    if (k == CharClass::Dot) {
+                        ++dotCount;
+                        if (dotCount > 1) break;
+                        ++i; continue;
+                    }
+                    break;
+                }
+                return make(TokenType::Number, start);
+            }
+            default:
+                ++i;
+                return make(TokenType::End, start);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,308 @@
+#ifndef OPTIMIZER_GUARD
+#define OPTIMIZER_GUARD
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "environment.h"
+#include "evaluator.h"
+
+// Оптимизация строки из нескольких выражений через ';' перед вычислением:
+// все RPN сливаются в один DAG с хэш-консингом (общие подвыражения - один
+// узел), константные поддеревья сворачиваются, умножение и деление на
+// степень двойки заменяются сдвигом порядка (ldexp), что для double точно.
+// Поддеревья, свёртка которых даёт ошибку, не сворачиваются: ошибка
+// появится при вычислении в том же порядке, что и у evalRpn.
+
+enum class DagKind : std::uint8_t { Const, Var, Unary, Binary, Scale };
+
+struct DagNode {
+    DagKind kind = DagKind::Const;
+    OpKind op = OpKind::Add;
+    std::int32_t a = -1;
+    std::int32_t b = -1;
+    double value = 0.0;
+    int scale = 0;
+    std::string name;
+    bool bitwise = false;
+};
+
+struct OptimizerStats {
+    std::size_t lines = 0;
+    std::size_t inputNodes = 0;
+    std::size_t dagNodes = 0;
+    std::size_t folded = 0;
+    std::size_t shared = 0;
+    std::size_t reduced = 0;
+
+    std::size_t removed() const { return inputNodes > dagNodes ? inputNodes - dagNodes : 0; }
+};
+
+class LineDag {
+private:
+    struct Key {
+        DagKind kind;
+        OpKind op;
+        std::int32_t a, b;
+        std::uint64_t valueBits;
+        int scale;
+        bool bitwise;
+        std::string name;
+
+        bool operator==(const Key &o) const {
+            return kind == o.kind && op == o.op && a == o.a && b == o.b && valueBits == o.valueBits &&
+                   scale == o.scale && bitwise == o.bitwise && name == o.name;
+        }
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key &k) const {
+            std::size_t h = std::hash<std::uint64_t>()(k.valueBits);
+            auto mix = [&h](std::size_t v) { h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2); };
+            mix(static_cast<std::size_t>(k.kind));
+            mix(static_cast<std::size_t>(k.op));
+            mix(static_cast<std::size_t>(static_cast<std::uint32_t>(k.a)));
+            mix(static_cast<std::size_t>(static_cast<std::uint32_t>(k.b)));
+            mix(static_cast<std::size_t>(k.scale));
+            mix(static_cast<std::size_t>(k.bitwise));
+            if (!k.name.empty()) mix(std::hash<std::string>()(k.name));
+            return h;
+        }
+    };
+
+    std::vector<DagNode> nodeList;
+    std::unordered_map<Key, std::int32_t, KeyHash> index;
+    std::vector<std::int32_t> roots;
+    std::vector<std::vector<std::int32_t>> rootVars;
+    OptimizerStats stats;
+
+    std::int32_t intern(const DagNode &n) {
+        Key k{n.kind, n.op, n.a, n.b, 0, n.scale, n.bitwise, n.name};
+        std::memcpy(&k.valueBits, &n.value, sizeof(double));
+        auto it = index.find(k);
+        if (it != index.end()) {
+            ++stats.shared;
+            return it->second;
+        }
+        nodeList.push_back(n);
+        std::int32_t id = static_cast<std::int32_t>(nodeList.size() - 1);
+        index.emplace(std::move(k), id);
+        return id;
+    }
+
+    std::int32_t constant(double v, bool bitwise) {
+        DagNode n;
+        n.kind = DagKind::Const;
+        n.value = v;
+        n.bitwise = bitwise;
+        return intern(n);
+    }
+
+    // v = 2^k с целым k?
+    static bool powerOfTwo(double v, int &k) {
+        if (!(v > 0.0) || std::isinf(v)) return false;
+        int e = 0;
+        if (std::frexp(v, &e) != 0.5) return false;
+        k = e - 1;
+        return true;
+    }
+
+    std::int32_t unary(OpKind op, std::int32_t a) {
+        const DagNode &x = nodeList[a];
+        if (x.kind == DagKind::Const) {
+            double r = 0.0;
+            const char *err = nullptr;
+            if (Evaluator::unaryKernel(op)(x.value, r, err)) {
+                ++stats.folded;
+                return constant(r, Evaluator::isBitwise(op));
+            }
+        }
+        DagNode n;
+        n.kind = DagKind::Unary;
+        n.op = op;
+        n.a = a;
+        n.bitwise = Evaluator::isBitwise(op);
+        return intern(n);
+    }
+
+    std::int32_t binary(OpKind op, std::int32_t a, std::int32_t b) {
+        const DagNode &x = nodeList[a];
+        const DagNode &y = nodeList[b];
+        if (x.kind == DagKind::Const && y.kind == DagKind::Const) {
+            double r = 0.0;
+            const char *err = nullptr;
+            if (Evaluator::binaryKernel(op)(x.value, y.value, r, err)) {
+                ++stats.folded;
+                return constant(r, Evaluator::isBitwise(op));
+            }
+        }
+
+        int k = 0;
+        std::int32_t other = -1;
+        if (op == OpKind::Mul && y.kind == DagKind::Const && powerOfTwo(y.value, k)) other = a;
+        else if (op == OpKind::Mul && x.kind == DagKind::Const && powerOfTwo(x.value, k)) other = b;
+        else if (op == OpKind::Div && y.kind == DagKind::Const && y.value >= 1e-12 && powerOfTwo(y.value, k)) {
+            other = a;
+            k = -k;
+        }
+        if (other >= 0) {
+            ++stats.reduced;
+            DagNode n;
+            n.kind = DagKind::Scale;
+            n.a = other;
+            n.scale = k;
+            return intern(n);
+        }
+
+        DagNode n;
+        n.kind = DagKind::Binary;
+        n.op = op;
+        n.a = a;
+        n.b = b;
+        n.bitwise = Evaluator::isBitwise(op);
+        return intern(n);
+    }
+
+public:
+    // Добавляет выражение и возвращает его номер; -1, если RPN некорректен
+    // (тогда выражение надо считать обычным путём ради тех же сообщений об ошибках).
+    std::int32_t add(const std::vector<Token> &rpn, std::string_view source) {
+        std::vector<std::int32_t> st;
+        std::vector<std::int32_t> vars;
+        for (const Token &t : rpn) {
+            if (t.type == TokenType::Number) {
+                st.push_back(constant(t.number.toDouble(), false));
+            } else if (t.type == TokenType::Ident) {
+                DagNode n;
+                n.kind = DagKind::Var;
+                n.name = std::string(t.text(source));
+                std::int32_t id = intern(n);
+                bool known = false;
+                for (std::int32_t v : vars) known = known || v == id;
+                if (!known) vars.push_back(id);
+                st.push_back(id);
+            } else if (t.type == TokenType::Op && Evaluator::isUnary(t.op)) {
+                if (st.empty()) return -1;
+                st.back() = unary(t.op, st.back());
+            } else if (t.type == TokenType::Op) {
+                if (st.size() < 2 || !Evaluator::binaryKernel(t.op)) return -1;
+                std::int32_t b = st.back(); st.pop_back();
+                std::int32_t a = st.back(); st.pop_back();
+                st.push_back(binary(t.op, a, b));
+            } else {
+                return -1;
+            }
+        }
+        if (st.size() != 1) return -1;
+
+        stats.inputNodes += rpn.size();
+        roots.push_back(st.back());
+        rootVars.push_back(std::move(vars));
+        return static_cast<std::int32_t>(roots.size() - 1);
+    }
+
+    const std::vector<DagNode> &nodes() const { return nodeList; }
+    std::int32_t root(std::int32_t expr) const { return roots[expr]; }
+
+    // Переменные выражения в порядке первого появления, как слоты у VM.
+    const std::vector<std::int32_t> &variables(std::int32_t expr) const { return rootVars[expr]; }
+
+    // Итог по строке: сколько узлов осталось достижимыми из корней.
+    OptimizerStats finish() {
+        std::vector<char> seen(nodeList.size(), 0);
+        std::vector<std::int32_t> stack(roots.begin(), roots.end());
+        std::size_t live = 0;
+        while (!stack.empty()) {
+            std::int32_t id = stack.back();
+            stack.pop_back();
+            if (seen[id]) continue;
+            seen[id] = 1;
+            ++live;
+            if (nodeList[id].a >= 0) stack.push_back(nodeList[id].a);
+            if (nodeList[id].b >= 0) stack.push_back(nodeList[id].b);
+        }
+        stats.lines = 1;
+        stats.dagNodes = live;
+        return stats;
+    }
+};
+
+// Вычисление корней DAG с запоминанием: общий узел считается один раз на строку.
+class DagEvaluator {
+private:
+    const LineDag &dag;
+    Environment *env;
+    std::vector<std::uint8_t> state;  // 0 - не считали, 1 - значение, 2 - ошибка
+    std::vector<double> values;
+    std::vector<Fault> errors;
+
+    bool argsReady(std::int32_t id, std::vector<std::int32_t> &stack) {
+        const DagNode &n = dag.nodes()[id];
+        // Сначала левый аргумент, потом правый - порядок ошибок как в RPN.
+        if (n.a >= 0 && state[n.a] == 0) { stack.push_back(n.a); return false; }
+        if (n.a >= 0 && state[n.a] == 2) { state[id] = 2; errors[id] = errors[n.a]; return true; }
+        if (n.b >= 0 && state[n.b] == 0) { stack.push_back(n.b); return false; }
+        if (n.b >= 0 && state[n.b] == 2) { state[id] = 2; errors[id] = errors[n.b]; return true; }
+        return true;
+    }
+
+    void compute(std::int32_t id) {
+        const DagNode &n = dag.nodes()[id];
+        double r = 0.0;
+        const char *err = nullptr;
+        bool ok = true;
+        switch (n.kind) {
+            case DagKind::Const:
+                r = n.value;
+                break;
+            case DagKind::Var: {
+                if (!env) { ok = false; errors[id] = unknownVariable(n.name); }
+                else if (!env->lookupDouble(n.name, r, errors[id])) ok = false;
+                break;
+            }
+            case DagKind::Unary:
+                if (!Evaluator::unaryKernel(n.op)(values[n.a], r, err)) { ok = false; errors[id] = {codeOf(err), err}; }
+                break;
+            case DagKind::Binary:
+                if (!Evaluator::binaryKernel(n.op)(values[n.a], values[n.b], r, err)) { ok = false; errors[id] = {codeOf(err), err}; }
+                break;
+            case DagKind::Scale:
+                r = std::ldexp(values[n.a], n.scale);
+                break;
+        }
+        state[id] = ok ? 1 : 2;
+        values[id] = r;
+    }
+
+public:
+    DagEvaluator(const LineDag &d, Environment *e)
+        : dag(d), env(e), state(d.nodes().size(), 0), values(d.nodes().size(), 0.0), errors(d.nodes().size()) {}
+
+    // Как и VM, сначала читает все переменные выражения, потом считает.
+    EvalResult eval(std::int32_t expr) {
+        for (std::int32_t v : dag.variables(expr)) {
+            if (state[v] == 0) compute(v);
+            if (state[v] == 2) return {false, errors[v].message, BinaryNumber(), false, errors[v].code};
+        }
+
+        std::int32_t root = dag.root(expr);
+        std::vector<std::int32_t> stack{root};
+        while (!stack.empty()) {
+            std::int32_t id = stack.back();
+            if (state[id] != 0) { stack.pop_back(); continue; }
+            if (!argsReady(id, stack)) continue;
+            if (state[id] == 0) compute(id);
+            stack.pop_back();
+        }
+        if (state[root] == 2) return {false, errors[root].message, BinaryNumber(), false, errors[root].code};
+        return {true, "", BinaryNumber(values[root]), dag.nodes()[root].bitwise};
+    }
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef PARSER_GUARD
+#define PARSER_GUARD
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lexer.h"
+#include "stats.h"
+#include "status.h"
+
+struct ParseResult {
+    bool ok = false;
+    std::string error;
+    std::vector<Token> rpn;
+    // После подстановки функций пользователя токены rpn указывают не только в
+    // выражение, но и в тексты тел: тогда здесь выражение с дописанными телами.
+    std::string inlined;
+    ErrorCode code = ErrorCode::None;  // для --stats
+
+    std::string_view source(std::string_view expr) const {
+        return inlined.empty() ? expr : std::string_view(inlined);
+    }
+};
+
+class InfixParser {
+private:
+    // rec == nullptr, если статистика выключена: тогда лексер не замеряется.
+    // calls - разбирать имя(аргументы) как вызов функции пользователя.
+    static bool convert(std::string_view expr, std::vector<Token> &output, std::vector<Token> &ops, Status &st,
+                        StatsRecorder *rec, bool calls) {
+        Lexer lex(expr);
+        output.clear();
+        ops.clear();
+        st = Status();
+
+        bool expectUnary = true;
+        bool expectCall = false;  // после имени функции обязательна '('
+        std::uint32_t lastEnd = 0;  // конец предыдущего токена
+
+        while (true) {
+            Token t = Stats::timed(rec, Stage::Lex, [&] { return lex.nextToken(); });
+            std::uint32_t prevEnd = lastEnd;
+            lastEnd = t.pos + t.len;
+            if (expectCall && t.type != TokenType::LParen) {
+                const Token &name = ops.back();
+                st.fail(ErrorCode::FunctionCall, name.pos, name.len);
+                return false;
+            }
+            if (t.type == TokenType::End) {
+                if (t.len != 0) {
+                    st.fail(ErrorCode::UnknownToken, t.pos, t.len);
+                    return false;
+                }
+                break;
+            }
+
+            if (t.type == TokenType::Number || t.type == TokenType::Ident) {
+                output.push_back(t);
+                expectUnary = false;
+                continue;
+            }
+
+            if (t.type == TokenType::LParen) {
+                if (calls && !expectUnary && !output.empty() && output.back().type == TokenType::Ident &&
+                    output.back().pos + output.back().len == prevEnd) {
+                    Token call = output.back();
+                    output.pop_back();
+                    call.type = TokenType::Op;
+                    call.op = OpKind::Call;
+                    ops.push_back(call);
+                }
+                ops.push_back(t);
+                expectUnary = true;
+                expectCall = false;
+                continue;
+            }
+
+            if (t.type == TokenType::Comma) {
+                // Запятая закрывает первый аргумент двухаргументной функции.
+                while (!ops.empty() && ops.back().type != TokenType::LParen) {
+                    output.push_back(ops.back());
+                    ops.pop_back();
+                }
+                if (expectUnary || ops.size() < 2 || ops[ops.size() - 2].type != TokenType::Op ||
+                    !(isFunction(ops[ops.size() - 2].op) || ops[ops.size() - 2].op == OpKind::Call)) {
+                    st.fail(ErrorCode::UnexpectedToken, t.pos, t.len);
+                    return false;
+                }
+                const Token &name = ops[ops.size() - 2];
+                std::uint8_t limit = name.op == OpKind::Call ? kMaxArgs - 1 : functionArity(name.op);
+                if (++ops.back().commas >= limit) {
+                    st.fail(ErrorCode::FunctionArity, name.pos, name.len);
+                    return false;
+                }
+                expectUnary = true;
+                continue;
+            }
+
+            if (t.type == TokenType::RParen) {
+                bool found = false;
+                std::uint8_t commas = 0;
+                while (!ops.empty()) {
+                    if (ops.back().type == TokenType::LParen) {
+                        commas = ops.back().commas;
+                        ops.pop_back();
+                        found = true;
+                        break;
+                    }
+                    output.push_back(ops.back());
+                    ops.pop_back();
+                }
+                if (!found) {
+                    st.fail(ErrorCode::ExtraRParen);
+                    return false;
+                }
+                if (!ops.empty() && ops.back().type == TokenType::Op && ops.back().op == OpKind::Call) {
+                    // f() - без аргументов; f(x,) - ошибка.
+                    Token call = ops.back();
+                    if (expectUnary && commas != 0) {
+                        st.fail(ErrorCode::FunctionArity, call.pos, call.len);
+                        return false;
+                    }
+                    call.commas = expectUnary ? 0 : commas + 1;
+                    output.push_back(call);
+                    ops.pop_back();
+                } else if (!ops.empty() && ops.back().type == TokenType::Op && isFunction(ops.back().op)) {
+                    const Token &name = ops.back();
+                    if (expectUnary || commas + 1 != functionArity(name.op)) {
+                        st.fail(ErrorCode::FunctionArity, name.pos, name.len);
+                        return false;
+                    }
+                    output.push_back(name);
+                    ops.pop_back();
+                }
+                expectUnary = false;
+                continue;
+            }
+
+            if (t.type == TokenType::Op) {
+                if (isFunction(t.op)) {
+                    if (!expectUnary) {
+                        st.fail(ErrorCode::UnexpectedToken, t.pos, t.len);
+                        return false;
+                    }
+                    ops.push_back(t);
+                    expectCall = true;
+                    continue;
+                }
+                if (t.op == OpKind::Sub && expectUnary) {
+                    t.op = OpKind::UnaryMinus;
+                }
+
+                while (!ops.empty() && ops.back().type == TokenType::Op) {
+                    OpKind top = ops.back().op;
+                    int pTop = precedence(top);
+                    int pCur = precedence(t.op);
+
+                    if (pTop > pCur || (pTop == pCur && !isRightAssociative(t.op))) {
+                        output.push_back(ops.back());
+                        ops.pop_back();
+                    } else {
+                        break;
+                    }
+                }
+
+                ops.push_back(t);
+                expectUnary = true;
+                continue;
+            }
+
+            st.fail(ErrorCode::UnexpectedToken, t.pos, t.len);
+            return false;
+        }
+
+        while (!ops.empty()) {
+            if (ops.back().type == TokenType::LParen) {
+                st.fail(ErrorCode::UnclosedLParen);
+                return false;
+            }
+            output.push_back(ops.back());
+            ops.pop_back();
+        }
+        return true;
+    }
+
+public:
+    // Аргументов у вызова функции пользователя, не больше.
+    static constexpr std::uint8_t kMaxArgs = 16;
+
+    // Без выделений памяти после прогрева: output и ops принадлежат вызывающему
+    // и переиспользуются между выражениями. Ошибка - код и фрагмент в st.
+    static bool toRpn(std::string_view expr, std::vector<Token> &output, std::vector<Token> &ops, Status &st,
+                      bool calls = false) {
+        StatsRecorder *rec = Stats::recorder();
+        return Stats::timed(rec, Stage::ToRpn, [&] { return convert(expr, output, ops, st, rec, calls); });
+    }
+
+    static ParseResult toRpn(std::string_view expr, bool calls = false) {
+        ParseResult r;
+        std::vector<Token> ops;
+        Status st;
+        r.ok = toRpn(expr, r.rpn, ops, st, calls);
+        if (!r.ok) {
+            r.error = st.render(expr);
+            r.code = st.code;
+            r.rpn.clear();
+        }
+        return r;
+    }
+};
+
+#endif
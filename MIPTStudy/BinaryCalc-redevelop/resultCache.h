@@ -0,0 +1,280 @@
+#ifndef RESULT_CACHE_GUARD
+#define RESULT_CACHE_GUARD
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "lexer.h"
+
+// Кеш результатов (double) на диске, общий для всех процессов на машине:
+// файл отображается в память, внутри - хэш-таблица с открытой адресацией
+// фиксированного размера. Ключ - 128-битный хэш текста без лишних пробелов,
+// с and/or/xor/not, приведёнными к символам. Выражения с переменными не
+// кешируются (значение зависит от состояния), ошибки тоже.
+//
+// Слот защищён счётчиком версий (seqlock): писатель захватывает слот, делая
+// счётчик нечётным через CAS, читатель перечитывает, если счётчик нечётный или
+// изменился за время чтения. Блокировок нет, читателей и писателей сколько угодно,
+// в том числе из разных процессов; проигравший CAS писатель просто не пишет.
+// Вытеснение: ключ ищется в окне из kWindow слотов, новая запись занимает
+// пустой слот окна или слот, к которому дольше всех не обращались.
+class ResultCache {
+public:
+    struct Key {
+        std::uint64_t lo = 0;
+        std::uint64_t hi = 0;
+    };
+
+    static constexpr std::size_t kDefaultMinLength = 24;
+    static constexpr unsigned kDefaultSlotBits = 16;
+    static constexpr unsigned kMaxSlotBits = 26;
+
+private:
+    static constexpr std::uint64_t kMagic = 0x31454843436e6942ULL;  // "BinCCHE1"
+    static constexpr std::uint32_t kVersion = 1;
+    static constexpr std::size_t kWindow = 8;
+
+    struct Header {
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t slotBits;
+        std::atomic<std::uint64_t> clock;
+    };
+
+    struct Slot {
+        std::atomic<std::uint64_t> seq;    // нечётный - идёт запись
+        std::atomic<std::uint64_t> keyLo;
+        std::atomic<std::uint64_t> keyHi;  // 0 - слот пуст
+        std::atomic<std::uint64_t> value;  // биты double
+        std::atomic<std::uint64_t> flags;  // 1 - побитовый результат
+        std::atomic<std::uint64_t> used;   // clock последнего обращения, вне seqlock
+    };
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "ResultCache");
+
+    int fd = -1;
+    void *base = nullptr;
+    std::size_t length = 0;
+    Header *header = nullptr;
+    Slot *slots = nullptr;
+    std::uint64_t mask = 0;
+    std::size_t minLength;
+
+    std::atomic<std::uint64_t> hitCount{0};
+    std::atomic<std::uint64_t> missCount{0};
+    std::atomic<std::uint64_t> bypassCount{0};
+
+    static std::uint64_t mix(std::uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    // Два независимых 64-битных хэша, байты копятся по 8.
+    struct KeyHasher {
+        std::uint64_t a = 0x9e3779b97f4a7c15ULL;
+        std::uint64_t b = 0x6a09e667f3bcc908ULL;
+        std::uint64_t word = 0;
+        std::uint64_t length = 0;
+
+        void feed(char c) {
+            word = word << 8 | static_cast<unsigned char>(c);
+            if ((++length & 7) == 0) flush();
+        }
+
+        void flush() {
+            a = mix(a ^ word);
+            b = mix(b + word * 0xff51afd7ed558ccdULL);
+            word = 0;
+        }
+
+        void finish(Key &key) {
+            flush();
+            key.lo = mix(a ^ length);
+            key.hi = mix(b + length) | 1;  // 0 - признак пустого слота
+        }
+    };
+
+    void close() {
+        if (base) munmap(base, length);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+        base = nullptr;
+        header = nullptr;
+        slots = nullptr;
+    }
+
+public:
+    explicit ResultCache(std::size_t minExprLength = kDefaultMinLength) : minLength(minExprLength) {}
+    ResultCache(const ResultCache &) = delete;
+    ResultCache &operator=(const ResultCache &) = delete;
+    ~ResultCache() { close(); }
+
+    // Открывает или создаёт файл на 2^slotBits слотов. Размер уже созданного
+    // файла берётся из его заголовка.
+    bool open(const std::string &path, unsigned slotBits, std::string &error) {
+        close();
+        if (slotBits < 4 || slotBits > kMaxSlotBits) { error = "размер кеша: 4..26 бит"; return false; }
+
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) { error = "не удалось открыть кеш '" + path + "'"; return false; }
+
+        // Создание и проверка заголовка - под flock, чтобы два процесса не
+        // размечали новый файл одновременно.
+        flock(fd, LOCK_EX);
+        struct stat st {};
+        bool ok = fstat(fd, &st) == 0;
+        if (ok && st.st_size == 0) {
+            Header h{};
+            h.magic = kMagic;
+            h.version = kVersion;
+            h.slotBits = slotBits;
+            std::size_t size = sizeof(Slot) * (std::size_t(1) << slotBits) + sizeof(Slot);
+            ok = ftruncate(fd, static_cast<off_t>(size)) == 0 && pwrite(fd, &h, sizeof(h), 0) == sizeof(h);
+        }
+        Header h{};
+        ok = ok && pread(fd, &h, sizeof(h), 0) == sizeof(h) && fstat(fd, &st) == 0;
+        flock(fd, LOCK_UN);
+        if (!ok || h.magic != kMagic || h.version != kVersion || h.slotBits > kMaxSlotBits ||
+            static_cast<std::size_t>(st.st_size) != sizeof(Slot) * ((std::size_t(1) << h.slotBits) + 1)) {
+            error = "файл '" + path + "' - не кеш binCalc этой версии";
+            close();
+            return false;
+        }
+
+        length = static_cast<std::size_t>(st.st_size);
+        base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            base = nullptr;
+            error = "не удалось отобразить кеш '" + path + "' в память";
+            close();
+            return false;
+        }
+        // Заголовок занимает место одного слота, дальше - таблица.
+        header = static_cast<Header *>(base);
+        slots = reinterpret_cast<Slot *>(static_cast<char *>(base) + sizeof(Slot));
+        mask = (std::uint64_t(1) << h.slotBits) - 1;
+        return true;
+    }
+
+    bool isOpen() const { return slots != nullptr; }
+    std::size_t slotCount() const { return slots ? static_cast<std::size_t>(mask + 1) : 0; }
+
+    // Ключ выражения - хэш байтов с нормализацией: пробелы значимы только между
+    // двумя цифрами или словами ("1 0" - не "10"), and/or/xor/not - как &|^~,
+    // имена функций - в нижнем регистре.
+    // false - кешировать не нужно: кеш закрыт, выражение короче minLength
+    // (хэш дороже вычисления) или в нём есть переменные.
+    bool keyOf(std::string_view expr, Key &key) {
+        if (!slots) return false;
+        if (expr.size() < minLength) {
+            bypassCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        KeyHasher h;
+        bool space = false, lastWord = false;
+        for (std::size_t i = 0; i < expr.size();) {
+            char c = expr[i];
+            CharClass k = kCharTables.cls[static_cast<unsigned char>(c)];
+            if (k == CharClass::Space) {
+                space = true;
+                ++i;
+                continue;
+            }
+            if (k == CharClass::Alpha) {
+                std::size_t j = i;
+                // Как в Lexer: ключевое слово - только буквенное начало.
+                while (j < expr.size() && kCharTables.cls[static_cast<unsigned char>(expr[j])] == CharClass::Alpha) ++j;
+                OpKind op;
+                if (!Lexer::isKeyword(expr.substr(i, j - i), op)) {
+                    bypassCount.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                if (isFunction(op)) {
+                    for (const char *f = functionName(op); *f; ++f) h.feed(*f);
+                } else {
+                    h.feed(op == OpKind::And ? '&' : op == OpKind::Or ? '|' : op == OpKind::Xor ? '^' : '~');
+                }
+                space = lastWord = false;
+                i = j;
+                continue;
+            }
+            bool word = k == CharClass::Bit || k == CharClass::Dot || k == CharClass::Digit ||
+                        k == CharClass::Less || k == CharClass::Greater;
+            if (space && word && lastWord) h.feed(' ');
+            h.feed(c);
+            space = false;
+            lastWord = word;
+            ++i;
+        }
+        h.finish(key);
+        return true;
+    }
+
+    bool lookup(const Key &key, double &value, bool &bitwise) {
+        std::uint64_t home = key.lo & mask;
+        for (std::size_t k = 0; k < kWindow; ++k) {
+            Slot &s = slots[(home + k) & mask];
+            std::uint64_t s1 = s.seq.load(std::memory_order_acquire);
+            if (s1 & 1) continue;
+            std::uint64_t lo = s.keyLo.load(std::memory_order_relaxed);
+            std::uint64_t hi = s.keyHi.load(std::memory_order_relaxed);
+            std::uint64_t bits = s.value.load(std::memory_order_relaxed);
+            std::uint64_t flags = s.flags.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.seq.load(std::memory_order_relaxed) != s1) continue;
+            if (lo != key.lo || hi != key.hi) continue;
+
+            // Часы двигает только запись: попадание не трогает общую строку кеша.
+            s.used.store(header->clock.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            std::memcpy(&value, &bits, sizeof(value));
+            bitwise = (flags & 1) != 0;
+            hitCount.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        missCount.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void insert(const Key &key, double value, bool bitwise) {
+        std::uint64_t home = key.lo & mask;
+        Slot *victim = nullptr;
+        std::uint64_t oldest = ~std::uint64_t(0);
+        for (std::size_t k = 0; k < kWindow; ++k) {
+            Slot &s = slots[(home + k) & mask];
+            std::uint64_t hi = s.keyHi.load(std::memory_order_relaxed);
+            if (hi == key.hi && s.keyLo.load(std::memory_order_relaxed) == key.lo) return;
+            if (hi == 0) { victim = &s; break; }
+            std::uint64_t used = s.used.load(std::memory_order_relaxed);
+            if (used < oldest) { oldest = used; victim = &s; }
+        }
+
+        Slot &s = *victim;
+        std::uint64_t seq = s.seq.load(std::memory_order_relaxed);
+        if ((seq & 1) || !s.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire)) return;
+        std::atomic_thread_fence(std::memory_order_release);
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        s.keyLo.store(key.lo, std::memory_order_relaxed);
+        s.keyHi.store(key.hi, std::memory_order_relaxed);
+        s.value.store(bits, std::memory_order_relaxed);
+        s.flags.store(bitwise ? 1 : 0, std::memory_order_relaxed);
+        s.used.store(header->clock.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+        s.seq.store(seq + 2, std::memory_order_release);
+    }
+
+    std::uint64_t hits() const { return hitCount.load(); }
+    std::uint64_t misses() const { return missCount.load(); }
+    std::uint64_t bypassed() const { return bypassCount.load(); }
+};
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef SERVER_GUARD
+#define SERVER_GUARD
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "session.h"
+
+// Счётчики сервера, общие для всех потоков. Задержка - от получения строки
+// до готового ответа, гистограмма по степеням двойки наносекунд.
+class ServerStats {
+public:
+    static constexpr int kBuckets = 48;
+
+private:
+    std::atomic<std::uint64_t> requestCount{0};
+    std::atomic<std::uint64_t> expressionCount{0};
+    std::atomic<std::uint64_t> connectionCount{0};
+    std::atomic<std::int64_t> openCount{0};
+    std::atomic<std::uint64_t> latency[kBuckets] = {};
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+public:
+    void connected() { ++connectionCount; ++openCount; }
+    void disconnected() { --openCount; }
+
+    void request(std::size_t expressions, std::uint64_t ns) {
+        ++requestCount;
+        expressionCount += expressions;
+        int b = ns == 0 ? 0 : 64 - __builtin_clzll(ns);
+        if (b >= kBuckets) b = kBuckets - 1;
+        latency[b].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Верхняя граница корзины, в которую попал перцентиль q.
+    std::uint64_t percentileNs(double q) const {
+        std::uint64_t total = 0;
+        for (const auto &b : latency) total += b.load();
+        if (total == 0) return 0;
+        std::uint64_t want = static_cast<std::uint64_t>(q * static_cast<double>(total - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (int k = 0; k < kBuckets; ++k) {
+            seen += latency[k].load();
+            if (seen >= want) return k == 0 ? 0 : (1ULL << k) - 1;
+        }
+        return ~0ULL;
+    }
+
+    std::string json() const {
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::uint64_t req = requestCount.load();
+        char buf[512];
+        std::snprintf(buf, sizeof(buf),
+                      "{\"uptime_s\": %.3f, \"requests\": %llu, \"expressions\": %llu, \"qps\": %.1f, "
+                      "\"connections\": %llu, \"open\": %lld, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu}",
+                      secs, static_cast<unsigned long long>(req),
+                      static_cast<unsigned long long>(expressionCount.load()),
+                      secs > 0.0 ? static_cast<double>(req) / secs : 0.0,
+                      static_cast<unsigned long long>(connectionCount.load()),
+                      static_cast<long long>(openCount.load()),
+                      static_cast<unsigned long long>(percentileNs(0.50)),
+                      static_cast<unsigned long long>(percentileNs(0.99)),
+                      static_cast<unsigned long long>(percentileNs(0.999)));
+        return buf;
+    }
+};
+
+// Сервер на Unix-сокете. Протокол строчный: строка с выражением или группой
+// через ';' -> одна строка ответа (результаты группы через "; "). Клиент может
+// слать запросы не дожидаясь ответов - ответы идут в том же порядке.
+// ":stats" - счётчики в JSON, "q" - закрыть соединение.
+// Каждый поток - свой epoll и своя Session без состояния; слушающий сокет
+// есть во всех epoll с EPOLLEXCLUSIVE, так что accept будит один поток.
+class EvalServer {
+private:
+    static constexpr std::size_t kMaxLine = 1 << 20;
+    static constexpr std::size_t kReadChunk = 64 * 1024;
+    // Ответов в очереди больше этого - перестаём читать, пока клиент не заберёт.
+    static constexpr std::size_t kHighWater = 1 << 20;
+
+    struct Connection {
+        int fd = -1;
+        std::string in;
+        std::string out;
+        std::size_t sent = 0;  // out[0, sent) уже отправлено
+        std::uint32_t interest = EPOLLIN | EPOLLRDHUP;
+        bool closing = false;
+        bool paused = false;  // чтение остановлено на kHighWater
+
+        std::size_t pending() const { return out.size() - sent; }
+    };
+
+    std::string path;
+    NumberMode mode;
+    std::size_t jitThreshold;
+    int listenFd = -1;
+    ResultCache *cache = nullptr;
+    ServerStats stats;
+
+    static std::atomic<bool> &stopFlag() {
+        static std::atomic<bool> flag{false};
+        return flag;
+    }
+
+    static void onSignal(int) { stopFlag().store(true); }
+
+    static bool setNonBlocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    void answer(Session &session, std::string_view rawLine, std::string &out, bool &closing) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::string line = trim(std::string(rawLine));
+        std::size_t expressions = 0;
+
+        if (isQuitCommand(line)) {
+            closing = true;
+            return;
+        }
+        if (line == ":stats") {
+            out += stats.json();
+        } else if (!line.empty() && line[0] == ':') {
+            out += "Ошибка: в режиме сервера доступна только команда :stats";
+        } else {
+            std::ostringstream res;
+            expressions = session.evalLine(line, res);
+            // Результаты группы - в одну строку через "; ".
+            std::string s = res.str();
+            if (!s.empty() && s.back() == '\n') s.pop_back();
+            for (char ch : s) {
+                if (ch == '\n') out += "; ";
+                else out.push_back(ch);
+            }
+        }
+        out.push_back('\n');
+
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+        stats.request(expressions, static_cast<std::uint64_t>(ns));
+    }
+
+    // false - соединение надо закрыть. Отправленное сдвигает c.sent; начало
+    // буфера стирается, только когда отправлено больше половины, - иначе
+    // частичные записи копировали бы остаток каждый раз.
+    bool flush(Connection &c) {
+        while (c.pending() > 0) {
+            ssize_t w = ::send(c.fd, c.out.data() + c.sent, c.pending(), MSG_NOSIGNAL);
+            if (w < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+                if (errno == EINTR) continue;
+                return false;
+            }
+            c.sent += static_cast<std::size_t>(w);
+            if (c.sent == c.out.size()) {
+                c.out.clear();
+                c.sent = 0;
+            } else if (c.sent > c.out.size() / 2) {
+                c.out.erase(0, c.sent);
+                c.sent = 0;
+            }
+        }
+        return !c.closing;
+    }
+
+    // Полные строки из c.in по очереди, пока очередь ответов ниже kHighWater.
+    void answerLines(Connection &c, Session &session) {
+        std::size_t start = 0;
+        std::size_t nl;
+        while (!c.closing && c.pending() < kHighWater && (nl = c.in.find('\n', start)) != std::string::npos) {
+            answer(session, std::string_view(c.in).substr(start, nl - start), c.out, c.closing);
+            start = nl + 1;
+        }
+        c.in.erase(0, start);
+    }
+
+    // Читает и отвечает, ответы копятся в c.out. На kHighWater останавливается
+    // (c.paused): непрочитанное остаётся в сокете и в c.in. false - ошибка сокета.
+    bool readAll(Connection &c, Session &session) {
+        char buf[kReadChunk];
+        while (true) {
+            answerLines(c, session);
+            c.paused = !c.closing && c.pending() >= kHighWater;
+            if (c.closing || c.paused) break;
+            if (c.in.size() > kMaxLine) {
+                c.out += "Ошибка: слишком длинная строка\n";
+                c.closing = true;
+                break;
+            }
+            ssize_t r = ::recv(c.fd, buf, sizeof(buf), 0);
+            if (r == 0) {
+                // Клиент закрыл запись: последняя строка может быть без '\n'.
+                if (!c.in.empty()) answer(session, c.in, c.out, c.closing);
+                c.in.clear();
+                c.closing = true;
+                break;
+            }
+            if (r < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                if (errno == EINTR) continue;
+                return false;
+            }
+            c.in.append(buf, static_cast<std::size_t>(r));
+        }
+        return true;
+    }
+
+    // Пока клиент закрыл запись или чтение на паузе, ждём только EPOLLOUT:
+    // EPOLLIN/EPOLLRDHUP по уровню будили бы поток без дела.
+    void updateInterest(int ep, Connection &c) {
+        std::uint32_t want = EPOLLOUT;
+        if (!c.closing && !c.paused)
+            want = EPOLLIN | EPOLLRDHUP | (c.pending() == 0 ? 0u : static_cast<std::uint32_t>(EPOLLOUT));
+        if (want == c.interest) return;
+        c.interest = want;
+        epoll_event ev{};
+        ev.events = want;
+        ev.data.fd = c.fd;
+        epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &ev);
+    }
+
+    void loop() {
+        int ep = epoll_create1(EPOLL_CLOEXEC);
+        if (ep < 0) return;
+        epoll_event lev{};
+        lev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        lev.data.fd = listenFd;
+        epoll_ctl(ep, EPOLL_CTL_ADD, listenFd, &lev);
+
+        Session session(mode, 4096, false);
+        session.setJitThreshold(jitThreshold);
+        session.setCache(cache);
+        std::unordered_map<int, Connection> conns;
+        std::vector<epoll_event> events(256);
+
+        while (!stopFlag().load()) {
+            int n = epoll_wait(ep, events.data(), static_cast<int>(events.size()), 200);
+            for (int k = 0; k < n; ++k) {
+                int fd = events[k].data.fd;
+                if (fd == listenFd) {
+                    while (true) {
+                        int cfd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                        if (cfd < 0) break;
+                        epoll_event ev{};
+                        ev.events = EPOLLIN | EPOLLRDHUP;
+                        ev.data.fd = cfd;
+                        epoll_ctl(ep, EPOLL_CTL_ADD, cfd, &ev);
+                        conns[cfd].fd = cfd;
+                        stats.connected();
+                    }
+                    continue;
+                }
+
+                auto it = conns.find(fd);
+                if (it == conns.end()) continue;
+                Connection &c = it->second;
+                bool alive = true;
+                if (!c.closing && (events[k].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+                    alive = readAll(c, session);
+                // Ответы, накопленные до закрытия клиентом записи, всё равно отправляем.
+                bool flushed = flush(c);
+                // Очередь ушла ниже kHighWater - продолжаем с отложенного.
+                while (alive && flushed && c.paused && c.pending() < kHighWater) {
+                    alive = readAll(c, session);
+                    flushed = flush(c);
+                }
+                if (!alive || !flushed || (c.closing && c.pending() == 0)) {
+                    epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+                    ::close(fd);
+                    conns.erase(it);
+                    stats.disconnected();
+                    continue;
+                }
+                updateInterest(ep, c);
+            }
+        }
+
+        for (auto &kv : conns) ::close(kv.first);
+        ::close(ep);
+    }
+
+public:
+    EvalServer(std::string socketPath, NumberMode numberMode = NumberMode::Double, std::size_t jitHits = 0)
+        : path(std::move(socketPath)), mode(numberMode), jitThreshold(jitHits) {}
+
+    void setCache(ResultCache *resultCache) { cache = resultCache; }
+
+    const ServerStats &counters() const { return stats; }
+
+    // Работает до SIGINT/SIGTERM.
+    bool run(unsigned threads, std::string &error) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) { error = "слишком длинный путь сокета"; return false; }
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) { error = "не удалось создать сокет"; return false; }
+        // Старый сокет от прошлого запуска убираем, а чужой файл - не трогаем.
+        struct stat st;
+        if (::lstat(path.c_str(), &st) == 0) {
+            if (!S_ISSOCK(st.st_mode)) {
+                error = "'" + path + "' уже существует и это не сокет";
+                ::close(listenFd);
+                return false;
+            }
+            ::unlink(path.c_str());
+        }
+        if (bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+            listen(listenFd, SOMAXCONN) != 0 || !setNonBlocking(listenFd)) {
+            error = "не удалось слушать '" + path + "': " + std::strerror(errno);
+            ::close(listenFd);
+            return false;
+        }
+
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+
+        if (threads == 0) threads = 1;
+        std::vector<std::thread> pool;
+        for (unsigned t = 0; t < threads; ++t) pool.emplace_back([this] { loop(); });
+        for (std::thread &th : pool) th.join();
+
+        ::close(listenFd);
+        ::unlink(path.c_str());
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,677 @@
+#ifndef SESSION_GUARD
+#define SESSION_GUARD
+
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "evaluator.h"
+#include "bytecode.h"
+#include "exactEvaluator.h"
+#include "bitVector.h"
+#include "intEvaluator.h"
+#include "jit.h"
+#include "optimizer.h"
+#include "resultCache.h"
+#include "sheet.h"
+#include "truthTable.h"
+#include "userFunctions.h"
+
+inline std::vector<std::string> splitBySemicolon(const std::string &line) {
+    std::vector<std::string> parts;
+    std::string cur;
+    for (char c : line) {
+        if (c == ';') {
+            parts.push_back(cur);
+            cur.clear();
+        } else {
+            cur.push_back(c);
+        }
+    }
+    parts.push_back(cur);
+    return parts;
+}
+
+inline std::string trim(const std::string &s) {
+    std::size_t a = 0;
+    while (a < s.size() && std::isspace(static_cast<unsigned char>(s[a]))) ++a;
+    std::size_t b = s.size();
+    while (b > a && std::isspace(static_cast<unsigned char>(s[b - 1]))) --b;
+    return s.substr(a, b - a);
+}
+
+inline bool isQuitCommand(const std::string &line) {
+    return line == "q" || line == "Q";
+}
+
+// "имя = выражение" (но не "=="). name и rhs - без пробелов по краям.
+inline bool splitAssignment(const std::string &expr, std::string &name, std::string &rhs) {
+    std::size_t eq = expr.find('=');
+    if (eq == std::string::npos || (eq + 1 < expr.size() && expr[eq + 1] == '=')) return false;
+    name = trim(expr.substr(0, eq));
+    if (!Lexer::isIdentifier(name)) return false;
+    rhs = trim(expr.substr(eq + 1));
+    return true;
+}
+
+// "def имя(a, b) = тело". Строка с "def " в начале - всегда определение:
+// false значит, что оно записано неверно.
+inline bool isDefinition(const std::string &expr) {
+    return expr.size() > 3 && expr.compare(0, 3, "def") == 0 && std::isspace(static_cast<unsigned char>(expr[3]));
+}
+
+inline bool splitDefinition(const std::string &expr, std::string &name, std::vector<std::string> &params,
+                            std::string &body) {
+    std::size_t open = expr.find('(');
+    std::size_t close = expr.find(')');
+    if (open == std::string::npos || close == std::string::npos || close < open) return false;
+    std::size_t eq = close + 1;
+    while (eq < expr.size() && std::isspace(static_cast<unsigned char>(expr[eq]))) ++eq;
+    if (eq >= expr.size() || expr[eq] != '=') return false;
+
+    name = trim(expr.substr(3, open - 3));
+    if (!Lexer::isIdentifier(name)) return false;
+    params.clear();
+    std::string list = trim(expr.substr(open + 1, close - open - 1));
+    std::size_t from = 0;
+    while (!list.empty()) {
+        std::size_t comma = list.find(',', from);
+        std::string p = trim(list.substr(from, comma == std::string::npos ? std::string::npos : comma - from));
+        if (!Lexer::isIdentifier(p)) return false;
+        params.push_back(p);
+        if (comma == std::string::npos) break;
+        from = comma + 1;
+    }
+    body = trim(expr.substr(eq + 1));
+    return !body.empty();
+}
+
+enum class NumberMode {
+    Double,   // double, как было всегда
+    Exact,    // Dyadic: точные двоичные дроби произвольной длины
+    Bits,     // BitVector: битовые векторы фиксированной ширины, только & | ^ ~ << >>
+    // Целые фиксированной ширины (intEvaluator.h), в порядке IntKind.
+    U8, U16, U32, U64, I8, I16, I32, I64
+};
+
+inline bool intKindOf(NumberMode mode, IntKind &out) {
+    if (static_cast<int>(mode) < static_cast<int>(NumberMode::U8)) return false;
+    out = static_cast<IntKind>(static_cast<int>(mode) - static_cast<int>(NumberMode::U8));
+    return true;
+}
+
+inline bool parseNumberMode(const std::string &name, NumberMode &out) {
+    if (name == "double") { out = NumberMode::Double; return true; }
+    if (name == "exact")  { out = NumberMode::Exact;  return true; }
+    if (name == "bits")   { out = NumberMode::Bits;   return true; }
+    IntKind kind;
+    if (!parseIntKind(name, kind)) return false;
+    out = static_cast<NumberMode>(static_cast<int>(NumberMode::U8) + static_cast<int>(kind));
+    return true;
+}
+
+inline const char *numberModeName(NumberMode mode) {
+    IntKind kind;
+    if (intKindOf(mode, kind)) return intKindName(kind);
+    return mode == NumberMode::Exact ? "exact" : mode == NumberMode::Bits ? "bits" : "double";
+}
+
+inline bool parseOverflow(const std::string &name, Overflow &out) {
+    if (name == "wrap") { out = Overflow::Wrap; return true; }
+    if (name == "trap") { out = Overflow::Trap; return true; }
+    return false;
+}
+
+// "[u32] выражение" или "[i64 trap] выражение": тип только для этого
+// выражения. false - префикса нет; ok == false - он записан неверно.
+inline bool splitIntPrefix(const std::string &expr, IntKind &kind, Overflow &overflow, std::string &rest, bool &ok) {
+    if (expr.empty() || expr[0] != '[') return false;
+    ok = false;
+    std::size_t close = expr.find(']');
+    if (close == std::string::npos) return true;
+    std::string spec = trim(expr.substr(1, close - 1));
+    std::size_t space = spec.find(' ');
+    if (!parseIntKind(spec.substr(0, space), kind)) return true;
+    if (space != std::string::npos && !parseOverflow(trim(spec.substr(space)), overflow)) return true;
+    rest = trim(expr.substr(close + 1));
+    ok = !rest.empty();
+    return true;
+}
+
+// Состояние вычислений одного потока: кэш планов, VM и лист переменных.
+// Не потокобезопасно, каждому потоку нужна своя Session. Без stateful
+// (пакетный режим) присваивания и ans недоступны: строки независимы.
+class Session {
+private:
+    PlanCache plans;
+    BytecodeVm vm;
+    JitTier jit;
+    FunctionLibrary functions;
+    Sheet sheet;
+    NumberMode numberMode;
+    std::size_t divisionFracBits = ExactEvaluator::kDefaultFracBits;
+    std::size_t bitsWidth = 0;  // минимальная ширина литерала в режиме bits
+    Overflow overflow = Overflow::Wrap;  // для целых режимов u8..i64
+    std::vector<std::uint64_t> intStack;
+    bool stateful;
+    OptimizerStats optStats;
+    ResultCache *cache = nullptr;
+
+    void syncSheet() {
+        sheet.setExact(numberMode == NumberMode::Exact, divisionFracBits);
+    }
+
+    // Сообщения об ошибках; с --stats ещё и счётчик по коду ошибки.
+    static void parseError(ErrorCode code, const std::string &err, std::ostream &out) {
+        Stats::error(code);
+        out << "Ошибка разбора: " << err << "\n";
+    }
+
+    static void evalError(ErrorCode code, const std::string &err, std::ostream &out) {
+        Stats::error(code);
+        out << "Ошибка вычисления: " << err << "\n";
+    }
+
+    void evalExact(const std::string &expr, std::ostream &out) {
+        ParseResult pr = functions.parse(expr);
+        if (!pr.ok) {
+            parseError(pr.code, pr.error, out);
+            return;
+        }
+
+        ExactResult er = Stats::timed(Stage::Eval, [&] {
+            return ExactEvaluator::evalRpn(pr.rpn, pr.source(expr), divisionFracBits, &sheet);
+        });
+        if (!er.ok) {
+            evalError(er.code, er.error, out);
+            return;
+        }
+        if (stateful) sheet.setAns(er.value);
+        printExact(er.value, out);
+    }
+
+    void evalBits(const std::string &expr, std::ostream &out) {
+        ParseResult pr = functions.parse(expr);
+        if (!pr.ok) {
+            parseError(pr.code, pr.error, out);
+            return;
+        }
+
+        StatsRecorder *rec = Stats::recorder();
+        BitsResult br = Stats::timed(rec, Stage::Eval, [&] { return BitsEvaluator::evalRpn(pr.rpn, pr.source(expr), bitsWidth); });
+        if (!br.ok) {
+            evalError(br.code, br.error, out);
+            return;
+        }
+        out << Stats::timed(rec, Stage::Format, [&] { return br.value.toBinaryString(); })
+            << "   (ширина: " << br.value.width << ")\n";
+    }
+
+    void evalTruth(const std::string &expr, std::ostream &out) {
+        ParseResult pr = functions.parse(expr);
+        if (!pr.ok) {
+            parseError(pr.code, pr.error, out);
+            return;
+        }
+
+        TruthProgram program;
+        Fault err;
+        if (!TruthTable::compile(pr.rpn, pr.source(expr), program, err)) {
+            evalError(err.code, err.message, out);
+            return;
+        }
+        TruthTable::print(program, out);
+    }
+
+    void evalInt(const std::string &expr, IntKind kind, Overflow policy, std::ostream &out) {
+        ParseResult pr = functions.parse(expr);
+        if (!pr.ok) {
+            parseError(pr.code, pr.error, out);
+            return;
+        }
+
+        StatsRecorder *rec = Stats::recorder();
+        IntResult ir = Stats::timed(rec, Stage::Eval, [&] {
+            return IntEvaluator::evalRpn(pr.rpn, pr.source(expr), kind, policy, intStack);
+        });
+        if (!ir.ok) {
+            evalError(ir.code, ir.error, out);
+            return;
+        }
+        out << Stats::timed(rec, Stage::Format, [&] {
+            return ir.toBinaryString() + "   (dec: " + ir.toDecimalString() + ")\n";
+        });
+    }
+
+    void assign(const std::string &name, const std::string &rhs, std::ostream &out) {
+        if (!stateful) {
+            out << "Ошибка: присваивания недоступны в пакетном режиме\n";
+            return;
+        }
+        if (name == Sheet::kAnsName) {
+            out << "Ошибка: '" << name << "' только для чтения\n";
+            return;
+        }
+        if (numberMode != NumberMode::Double && numberMode != NumberMode::Exact) {
+            out << "Ошибка: присваивания недоступны в режиме " << numberModeName(numberMode) << "\n";
+            return;
+        }
+
+        Fault err;
+        if (!sheet.define(name, rhs, err)) {
+            parseError(err.code, err.message, out);
+            return;
+        }
+
+        if (numberMode == NumberMode::Exact) {
+            Dyadic v;
+            if (!sheet.valueExact(name, v, err)) { evalError(err.code, err.message, out); return; }
+            out << name << " = ";
+            printExact(v, out);
+        } else {
+            double v = 0.0;
+            bool bitwise = false;
+            if (!sheet.valueDouble(name, v, bitwise, err)) { evalError(err.code, err.message, out); return; }
+            out << name << " = ";
+            printDouble({true, "", BinaryNumber(v), bitwise}, out);
+        }
+    }
+
+    // Планы и машинный код с подставленными старыми телами больше не годятся.
+    void defineFunction(const std::string &expr, std::ostream &out) {
+        if (!stateful) {
+            out << "Ошибка: определения функций недоступны в пакетном режиме\n";
+            return;
+        }
+        std::string name, body;
+        Fault err;
+        std::vector<std::string> params;
+        if (!splitDefinition(expr, name, params, body)) {
+            out << "Использование: def имя(a, b) = выражение\n";
+            return;
+        }
+        if (!functions.define(name, params, body, err)) {
+            parseError(err.code, err.message, out);
+            return;
+        }
+        plans.clear();
+        out << "Функция " << name << "(";
+        for (std::size_t k = 0; k < params.size(); ++k) out << (k ? ", " : "") << params[k];
+        out << ") определена\n";
+    }
+
+    void remember(bool keyed, const ResultCache::Key &key, const EvalResult &er) {
+        if (keyed && er.ok) cache->insert(key, er.value.toDouble(), er.isBitwiseResult);
+    }
+
+    void printResult(const EvalResult &er, std::ostream &out) {
+        if (!er.ok) {
+            evalError(er.code, er.error, out);
+            return;
+        }
+        if (stateful) sheet.setAns(er.value.toDouble(), er.isBitwiseResult);
+        printDouble(er, out);
+    }
+
+    // Выражение, в котором может найтись цепочка для параллельной свёртки
+    // (ChainFinder): без переменных оно идёт прямо в Evaluator::evalRpn, а не
+    // в кеш планов и VM. С переменными - false, его считает обычный путь.
+    bool evalLong(const std::string &expr, std::ostream &out) {
+        ParseResult pr = functions.parse(expr);
+        if (!pr.ok) {
+            parseError(pr.code, pr.error, out);
+            return true;
+        }
+        for (const Token &t : pr.rpn) {
+            if (t.type == TokenType::Ident) return false;
+        }
+        std::vector<double> stack;
+        double v = 0.0;
+        bool bitwise = false;
+        Status status;
+        bool ok = Stats::timed(Stage::Eval, [&] { return Evaluator::evalRpn(pr.rpn, stack, v, bitwise, status); });
+        if (!ok) {
+            evalError(status.code, status.render(pr.source(expr)), out);
+            return true;
+        }
+        printResult({true, "", BinaryNumber(v), bitwise}, out);
+        return true;
+    }
+
+    // Несколько выражений без присваиваний (double): общий DAG на всю строку.
+    // Если от ans что-то зависит, ans меняется посреди строки - тогда false,
+    // и строка считается по одному выражению.
+    bool evalOptimized(const std::vector<std::string> &exprs, std::ostream &out) {
+        std::vector<ParseResult> parsed;
+        parsed.reserve(exprs.size());
+        for (const std::string &e : exprs) {
+            parsed.push_back(functions.parse(e));
+            if (!stateful) continue;
+            std::string_view source = parsed.back().source(e);
+            for (const Token &t : parsed.back().rpn) {
+                if (t.type == TokenType::Ident && sheet.dependsOn(std::string(t.text(source)), Sheet::kAnsName)) {
+                    return false;
+                }
+            }
+        }
+
+        // Найденное в кеше в DAG не попадает.
+        std::vector<ResultCache::Key> keys(exprs.size());
+        std::vector<char> keyed(exprs.size(), 0);
+        std::vector<EvalResult> cached(exprs.size());
+        for (std::size_t k = 0; k < exprs.size(); ++k) {
+            if (!parsed[k].ok || !cache || !cache->keyOf(exprs[k], keys[k])) continue;
+            keyed[k] = 1;
+            double v = 0.0;
+            bool bitwise = false;
+            if (cache->lookup(keys[k], v, bitwise)) cached[k] = {true, "", BinaryNumber(v), bitwise};
+        }
+
+        LineDag dag;
+        std::vector<std::int32_t> roots(exprs.size(), -1);
+        for (std::size_t k = 0; k < exprs.size(); ++k) {
+            if (parsed[k].ok && !cached[k].ok) roots[k] = dag.add(parsed[k].rpn, parsed[k].source(exprs[k]));
+        }
+        OptimizerStats s = dag.finish();
+        optStats.lines += s.lines;
+        optStats.inputNodes += s.inputNodes;
+        optStats.dagNodes += s.dagNodes;
+        optStats.folded += s.folded;
+        optStats.shared += s.shared;
+        optStats.reduced += s.reduced;
+
+        DagEvaluator ev(dag, &sheet);
+        for (std::size_t k = 0; k < exprs.size(); ++k) {
+            if (!parsed[k].ok) {
+                parseError(parsed[k].code, parsed[k].error, out);
+                continue;
+            }
+            if (cached[k].ok) {
+                printResult(cached[k], out);
+                continue;
+            }
+            EvalResult er = Stats::timed(Stage::Eval, [&] {
+                return roots[k] < 0 ? vm.run(BytecodeCompiler::fromRpn(parsed[k].rpn, parsed[k].source(exprs[k])), &sheet)
+                                    : ev.eval(roots[k]);
+            });
+            remember(keyed[k], keys[k], er);
+            printResult(er, out);
+        }
+        return true;
+    }
+
+public:
+    static void printExact(const Dyadic &v, std::ostream &out) {
+        StatsRecorder *rec = Stats::recorder();
+        std::string text = Stats::timed(rec, Stage::Format, [&] {
+            return v.toBinaryString() + "   (dec: " + v.toDecimalString() + ")\n";
+        });
+        out << text;
+    }
+
+    // Десятичная часть - to_chars в формате %g с 6 знаками: тот же текст, что
+    // у operator<< по умолчанию, но без локали и форматирования потока.
+    static void printDouble(const EvalResult &er, std::ostream &out) {
+        StatsRecorder *rec = Stats::recorder();
+        if (rec) {
+            // Замеряется сборка текста, без записи в поток.
+            std::string text = Stats::timed(rec, Stage::Format, [&] { return formatDouble(er); });
+            out << text;
+            return;
+        }
+        char dec[32];
+        auto res = std::to_chars(dec, dec + sizeof(dec), er.value.toDouble(), std::chars_format::general, 6);
+        out << er.value.toBinaryString(er.isBitwiseResult ? 0 : 12) << "   (dec: ";
+        out.write(dec, res.ptr - dec);
+        out << ")\n";
+    }
+
+    static std::string formatDouble(const EvalResult &er) {
+        char dec[32];
+        auto res = std::to_chars(dec, dec + sizeof(dec), er.value.toDouble(), std::chars_format::general, 6);
+        std::string text = er.value.toBinaryString(er.isBitwiseResult ? 0 : 12);
+        text += "   (dec: ";
+        text.append(dec, res.ptr - dec);
+        text += ")\n";
+        return text;
+    }
+
+    explicit Session(NumberMode mode = NumberMode::Double, std::size_t planCapacity = 4096, bool isStateful = true)
+        : plans(planCapacity), numberMode(mode), stateful(isStateful) {
+        sheet.setFunctions(&functions);
+        syncSheet();
+    }
+
+    Session(const Session &) = delete;
+    Session &operator=(const Session &) = delete;
+
+    NumberMode mode() const { return numberMode; }
+    void setMode(NumberMode mode) { numberMode = mode; syncSheet(); }
+    void setDivisionFracBits(std::size_t bits) { divisionFracBits = bits; syncSheet(); }
+    const Sheet &variables() const { return sheet; }
+    const FunctionLibrary &userFunctions() const { return functions; }
+    const OptimizerStats &optimizerStats() const { return optStats; }
+    // 0 - JIT выключен, иначе выражение компилируется после стольких запусков.
+    void setJitThreshold(std::size_t hits) { jit.setThreshold(hits); }
+    // Общий кеш результатов (double), nullptr - без кеша. Объект кеша живёт
+    // дольше сессии и может быть общим для нескольких потоков.
+    void setCache(ResultCache *resultCache) { cache = resultCache; }
+
+    // Команды REPL начинаются с ':'. Возвращает false, если строка не команда.
+    bool command(const std::string &line, std::ostream &out) {
+        if (line.empty() || line[0] != ':') return false;
+
+        std::string body = trim(line.substr(1));
+        if (body.compare(0, 4, "mode") == 0) {
+            std::string name = trim(body.substr(4));
+            NumberMode m;
+            if (!parseNumberMode(name, m)) {
+                out << "Режимы: double, exact, bits, u8, u16, u32, u64, i8, i16, i32, i64\n";
+                return true;
+            }
+            setMode(m);
+            out << "Режим: " << name << "\n";
+            return true;
+        }
+
+        if (body.compare(0, 8, "fracbits") == 0) {
+            std::string arg = trim(body.substr(8));
+            char *end = nullptr;
+            unsigned long n = std::strtoul(arg.c_str(), &end, 10);
+            if (arg.empty() || *end != '\0' || n > ExactEvaluator::kMaxShift) {
+                out << "Использование: :fracbits N (0.." << ExactEvaluator::kMaxShift << ")\n";
+                return true;
+            }
+            setDivisionFracBits(n);
+            out << "Знаков после точки при делении (exact): " << n << "\n";
+            return true;
+        }
+
+        if (body.compare(0, 5, "width") == 0) {
+            std::string arg = trim(body.substr(5));
+            char *end = nullptr;
+            unsigned long n = std::strtoul(arg.c_str(), &end, 10);
+            if (arg.empty() || *end != '\0' || n > BitsEvaluator::kMaxWidth) {
+                out << "Использование: :width N (0.." << BitsEvaluator::kMaxWidth << ", 0 - по числу цифр)\n";
+                return true;
+            }
+            bitsWidth = n;
+            out << "Минимальная ширина литерала (bits): " << n << "\n";
+            return true;
+        }
+
+        if (body.compare(0, 8, "overflow") == 0) {
+            std::string arg = trim(body.substr(8));
+            if (!arg.empty() && !parseOverflow(arg, overflow)) {
+                out << "Использование: :overflow wrap | trap (для режимов u8..i64)\n";
+                return true;
+            }
+            out << "Переполнение целых: " << (overflow == Overflow::Trap ? "trap - ошибка" : "wrap - по модулю 2^N")
+                << "\n";
+            return true;
+        }
+
+        if (body.compare(0, 5, "truth") == 0) {
+            std::string expr = trim(body.substr(5));
+            if (expr.empty()) {
+                out << "Использование: :truth выражение (переменные - входы, до " << TruthTable::kMaxInputs
+                    << "; and or xor not, 0, 1)\n";
+                return true;
+            }
+            evalTruth(expr, out);
+            return true;
+        }
+
+        if (body == "vars") {
+            sheet.list(out);
+            return true;
+        }
+
+        if (body == "funcs") {
+            if (functions.empty()) out << "Функций нет (def имя(a, b) = выражение)\n";
+            functions.list(out);
+            return true;
+        }
+
+        if (body.compare(0, 3, "jit") == 0) {
+            std::string arg = trim(body.substr(3));
+            if (!arg.empty()) {
+                char *end = nullptr;
+                unsigned long n = std::strtoul(arg.c_str(), &end, 10);
+                if (arg == "off") n = 0;
+                else if (*end != '\0') {
+                    out << "Использование: :jit [N | off] (N - запусков до компиляции)\n";
+                    return true;
+                }
+                jit.setThreshold(n);
+            }
+            if (!JitCompiler::available()) out << "JIT недоступен на этой платформе\n";
+            out << "JIT: " << (jit.hitThreshold() == 0 ? std::string("выключен") : "после " + std::to_string(jit.hitThreshold()) + " запусков")
+                << ", скомпилировано: " << jit.compiled() << ", запусков машинного кода: " << jit.runs() << "\n";
+            return true;
+        }
+
+        if (body == "opt") {
+            out << "Оптимизировано строк: " << optStats.lines << ", узлов RPN: " << optStats.inputNodes
+                << ", узлов DAG: " << optStats.dagNodes << ", удалено: " << optStats.removed() << "\n";
+            out << "  свёрнуто констант: " << optStats.folded << ", общих подвыражений: " << optStats.shared
+                << ", умножений/делений на 2^k: " << optStats.reduced << "\n";
+            return true;
+        }
+
+        if (body == "stats") {
+            if (!Stats::enabled()) {
+                out << "Статистика выключена (--stats)\n";
+                return true;
+            }
+            Stats::print(out);
+            return true;
+        }
+
+        if (body == "cache") {
+            if (!cache) {
+                out << "Кеш результатов не подключён (--cache файл)\n";
+                return true;
+            }
+            out << "Кеш: слотов " << cache->slotCount() << ", попаданий " << cache->hits() << ", промахов "
+                << cache->misses() << ", без кеша (короткие, с переменными) " << cache->bypassed() << "\n";
+            return true;
+        }
+
+        out << "Неизвестная команда: '" << line << "'\n";
+        return true;
+    }
+
+    // Вычисляет строку (уже без пробелов по краям) из выражений через ';',
+    // печатает по строке результата на выражение. Возвращает число выражений.
+    std::size_t evalLine(const std::string &line, std::ostream &out) {
+        std::size_t count = 0;
+        auto parts = splitBySemicolon(line);
+
+        if (numberMode == NumberMode::Double) {
+            std::vector<std::string> exprs;
+            std::string name, rhs;
+            bool plain = true;
+            for (const std::string &part : parts) {
+                std::string expr = trim(part);
+                if (expr.empty()) continue;
+                if (expr[0] == '[' || isDefinition(expr) || splitAssignment(expr, name, rhs)) {
+                    plain = false;
+                    break;
+                }
+                exprs.push_back(std::move(expr));
+            }
+            if (plain && exprs.size() > 1 && evalOptimized(exprs, out)) return exprs.size();
+        }
+
+        for (std::size_t idx = 0; idx < parts.size(); ++idx) {
+            std::string expr = trim(parts[idx]);
+            if (expr.empty()) continue;
+            ++count;
+
+            IntKind kind;
+            Overflow policy = overflow;
+            std::string rest;
+            bool prefixOk = false;
+            if (splitIntPrefix(expr, kind, policy, rest, prefixOk)) {
+                if (prefixOk) evalInt(rest, kind, policy, out);
+                else out << "Использование: [u32] выражение или [i64 trap] выражение (типы u8..u64, i8..i64)\n";
+                continue;
+            }
+
+            if (isDefinition(expr)) {
+                defineFunction(expr, out);
+                continue;
+            }
+
+            std::string name, rhs;
+            if (splitAssignment(expr, name, rhs)) {
+                assign(name, rhs, out);
+                continue;
+            }
+
+            if (numberMode == NumberMode::Exact) {
+                evalExact(expr, out);
+                continue;
+            }
+            if (numberMode == NumberMode::Bits) {
+                evalBits(expr, out);
+                continue;
+            }
+            if (intKindOf(numberMode, kind)) {
+                evalInt(expr, kind, overflow, out);
+                continue;
+            }
+
+            if (expr.size() >= 2 * ChainFinder::kMinTerms && evalLong(expr, out)) continue;
+
+            // Дисковый кеш - только для того, чего нет среди скомпилированных:
+            // программа из plans считается быстрее, чем ищется ключ.
+            Program *hot = plans.find(expr);
+            ResultCache::Key key;
+            bool keyed = !hot && cache && cache->keyOf(expr, key);
+            double v = 0.0;
+            bool bitwise = false;
+            if (keyed && cache->lookup(key, v, bitwise)) {
+                printResult({true, "", BinaryNumber(v), bitwise}, out);
+                continue;
+            }
+
+            Program &prog = hot ? *hot : plans.get(expr, &functions);
+            if (!prog.parsed) {
+                parseError(prog.parseError.code, prog.parseError.message, out);
+                continue;
+            }
+
+            EvalResult er = Stats::timed(Stage::Eval, [&] { return jit.run(prog, expr, vm, &sheet, &functions); });
+            remember(keyed, key, er);
+            printResult(er, out);
+        }
+        return count;
+    }
+};
+
+#endif
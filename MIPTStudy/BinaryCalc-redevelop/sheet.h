@@ -0,0 +1,241 @@
+#ifndef SHEET_GUARD
+#define SHEET_GUARD
+
+#include <ostream>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "bytecode.h"
+#include "environment.h"
+#include "exactEvaluator.h"
+
+// Лист именованных определений (mask = 1111 << 100) с графом зависимостей.
+// При переопределении помечаются грязными только зависящие от имени
+// определения; пересчёт ленивый - при обращении, сначала зависимости.
+class Sheet : public Environment {
+public:
+    static constexpr const char *kAnsName = "ans";
+
+private:
+    struct Definition {
+        std::string text;
+        std::string source;  // текст для токенов rpn: text и тела функций пользователя
+        std::vector<Token> rpn;
+        Program program;
+        std::vector<std::string> deps;
+        bool isInput = false;
+        bool dirty = true;
+        bool ok = false;
+        Fault error;
+        double dvalue = 0.0;
+        bool bitwise = false;
+        Dyadic xvalue;
+    };
+
+    std::unordered_map<std::string, Definition> defs;
+    std::unordered_map<std::string, std::set<std::string>> users;
+    BytecodeVm vm;
+    const FunctionLibrary *functions = nullptr;
+    bool exact = false;
+    std::size_t fracBits = ExactEvaluator::kDefaultFracBits;
+    std::size_t recomputed = 0;
+
+    bool reaches(const std::string &from, const std::string &target) const {
+        std::vector<std::string> stack{from};
+        std::set<std::string> seen;
+        while (!stack.empty()) {
+            std::string cur = stack.back();
+            stack.pop_back();
+            if (cur == target) return true;
+            if (!seen.insert(cur).second) continue;
+            auto it = defs.find(cur);
+            if (it == defs.end()) continue;
+            for (const std::string &d : it->second.deps) stack.push_back(d);
+        }
+        return false;
+    }
+
+    // Грязность всегда распространяется вниз целиком, поэтому уже грязное
+    // определение можно не обходить повторно.
+    void invalidate(const std::string &name) {
+        std::vector<std::string> stack{name};
+        bool root = true;
+        while (!stack.empty()) {
+            std::string cur = stack.back();
+            stack.pop_back();
+            auto it = defs.find(cur);
+            if (it != defs.end()) {
+                if (it->second.dirty && !root) continue;
+                if (!it->second.isInput) it->second.dirty = true;
+            }
+            root = false;
+            auto u = users.find(cur);
+            if (u == users.end()) continue;
+            for (const std::string &next : u->second) stack.push_back(next);
+        }
+    }
+
+    void unlink(const std::string &name, const std::vector<std::string> &deps) {
+        for (const std::string &d : deps) {
+            auto u = users.find(d);
+            if (u != users.end()) u->second.erase(name);
+        }
+    }
+
+    void ensure(Definition &def) {
+        if (!def.dirty) return;
+        for (const std::string &d : def.deps) {
+            auto it = defs.find(d);
+            if (it != defs.end()) ensure(it->second);
+        }
+
+        if (exact) {
+            ExactResult r = ExactEvaluator::evalRpn(def.rpn, def.source, fracBits, this);
+            def.ok = r.ok;
+            def.error = {r.code, r.error};
+            def.xvalue = r.value;
+            def.bitwise = r.isBitwiseResult;
+        } else {
+            EvalResult r = vm.run(def.program, this);
+            def.ok = r.ok;
+            def.error = {r.code, r.error};
+            def.dvalue = r.value.toDouble();
+            def.bitwise = r.isBitwiseResult;
+        }
+        def.dirty = false;
+        ++recomputed;
+    }
+
+    Definition *resolve(std::string_view name, Fault &err, bool prefixed = true) {
+        auto it = defs.find(std::string(name));
+        if (it == defs.end()) {
+            err = unknownVariable(name);
+            return nullptr;
+        }
+        ensure(it->second);
+        if (!it->second.ok) {
+            err = it->second.error;
+            if (prefixed) err.message = "Переменная '" + std::string(name) + "': " + err.message;
+            return nullptr;
+        }
+        return &it->second;
+    }
+
+public:
+    // Режим вычислений; при смене все значения пересчитываются, ans забывается.
+    void setExact(bool isExact, std::size_t bits) {
+        if (isExact == exact && bits == fracBits) return;
+        exact = isExact;
+        fracBits = bits;
+        defs.erase(kAnsName);
+        for (auto &kv : defs) kv.second.dirty = true;
+    }
+
+    // Функции пользователя для новых определений; уже определённые не меняются.
+    void setFunctions(const FunctionLibrary *library) { functions = library; }
+
+    // Ошибка разбора или цикла - false + err, лист не меняется.
+    bool define(const std::string &name, const std::string &text, Fault &err) {
+        Definition def;
+        def.text = text;
+        ParseResult pr = parseWithFunctions(functions, def.text);
+        if (!pr.ok) {
+            err = {pr.code, pr.error};
+            return false;
+        }
+        def.source = pr.inlined.empty() ? def.text : std::move(pr.inlined);
+        def.rpn = std::move(pr.rpn);
+        def.program = BytecodeCompiler::fromRpn(def.rpn, def.source);
+
+        std::set<std::string> unique;
+        for (const Token &t : def.rpn) {
+            if (t.type == TokenType::Ident) unique.insert(std::string(t.text(def.source)));
+        }
+        def.deps.assign(unique.begin(), unique.end());
+        for (const std::string &d : def.deps) {
+            if (d == name || reaches(d, name)) {
+                err.message = "Циклическая зависимость: '" + name + "' зависит от самой себя через '" + d + "'";
+                return false;
+            }
+        }
+
+        auto old = defs.find(name);
+        if (old != defs.end()) unlink(name, old->second.deps);
+        for (const std::string &d : def.deps) users[d].insert(name);
+        defs[name] = std::move(def);
+        invalidate(name);
+        return true;
+    }
+
+    void setAns(double value, bool bitwise) {
+        Definition &def = defs[kAnsName];
+        def.isInput = true;
+        def.dirty = false;
+        def.ok = true;
+        def.dvalue = value;
+        def.bitwise = bitwise;
+        invalidate(kAnsName);
+    }
+
+    void setAns(const Dyadic &value) {
+        Definition &def = defs[kAnsName];
+        def.isInput = true;
+        def.dirty = false;
+        def.ok = true;
+        def.xvalue = value;
+        invalidate(kAnsName);
+    }
+
+    bool lookupDouble(std::string_view name, double &out, Fault &err) override {
+        Definition *d = resolve(name, err);
+        if (!d) return false;
+        out = d->dvalue;
+        return true;
+    }
+
+    bool lookupExact(std::string_view name, Dyadic &out, Fault &err) override {
+        Definition *d = resolve(name, err);
+        if (!d) return false;
+        out = d->xvalue;
+        return true;
+    }
+
+    // Значение определения для показа: ошибка - без префикса с именем.
+    bool valueDouble(const std::string &name, double &out, bool &bitwise, Fault &err) {
+        Definition *d = resolve(name, err, false);
+        if (!d) return false;
+        out = d->dvalue;
+        bitwise = d->bitwise;
+        return true;
+    }
+
+    bool valueExact(const std::string &name, Dyadic &out, Fault &err) {
+        Definition *d = resolve(name, err, false);
+        if (!d) return false;
+        out = d->xvalue;
+        return true;
+    }
+
+    // Зависит ли name (транзитивно) от target; для самого target - да.
+    bool dependsOn(const std::string &name, const std::string &target) const {
+        return reaches(name, target);
+    }
+
+    std::size_t recomputations() const { return recomputed; }
+
+    void list(std::ostream &out) const {
+        std::set<std::string> names;
+        for (const auto &kv : defs) names.insert(kv.first);
+        for (const std::string &n : names) {
+            const Definition &d = defs.at(n);
+            out << n << " = " << (d.isInput ? "<значение>" : d.text);
+            if (d.dirty) out << "   (не вычислено)";
+            out << "\n";
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,333 @@
+#ifndef STATS_GUARD
+#define STATS_GUARD
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "status.h"
+
+// Счётчики по этапам (--stats): число вызовов, суммарное время, гистограмма
+// задержек и ошибки по кодам. У каждого потока свой StatsRecorder, пишет в
+// него только этот поток, так что атомики - без lock-префиксов (load + store);
+// читатель (печать, JSON) складывает всех. Выключенная статистика на горячем
+// пути - одна relaxed-загрузка флага: Stats::recorder() возвращает nullptr.
+
+enum class Stage : std::uint8_t {
+    Lex,     // Lexer::nextToken
+    ToRpn,   // InfixParser::toRpn, вместе с лексером
+    Eval,    // вычисление: VM/JIT, DAG, exact, bits, поток
+    Format,  // печать результата (toBinaryString и десятичная часть)
+    Count
+};
+
+inline const char *stageName(Stage s) {
+    static const char *const names[] = {"lex", "toRpn", "eval", "format"};
+    static_assert(sizeof(names) / sizeof(names[0]) == static_cast<std::size_t>(Stage::Count), "stageName");
+    return names[static_cast<std::size_t>(s)];
+}
+
+// Имена кодов для JSON; ErrorCode::None - ошибки без своего кода (тексты
+// режимов bits и u8..i64, циклы листа переменных, параметры функций).
+inline const char *errorName(ErrorCode code) {
+    static const char *const names[] = {
+        "other", "unknownToken", "extraRParen", "unexpectedToken", "unclosedLParen", "unaryNoArg",
+        "binaryNoArgs", "unknownOperator", "evalUnexpectedToken", "notReduced", "divisionByZero",
+        "logicOperands", "shiftOperands", "shiftRange", "notOperands", "unknownVariable", "notNoArg",
+        "nestingTooDeep", "functionOperands", "functionCall", "functionArity",
+        "unknownFunction", "functionRecursion", "inlineTooLarge",
+        "constRange", "constFraction", "columnInexact",
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == static_cast<std::size_t>(ErrorCode::Count), "errorName");
+    return names[static_cast<std::size_t>(code)];
+}
+
+// Гистограмма в духе HDR: корзины по степеням двойки наносекунд, каждая
+// поделена ещё на 8 - перцентиль известен с точностью до 1/8 значения.
+class LatencyHistogram {
+public:
+    static constexpr int kSubBits = 3;
+    static constexpr int kSub = 1 << kSubBits;
+    static constexpr int kBuckets = (64 - kSubBits + 1) * kSub;
+
+    static int bucketOf(std::uint64_t ns) {
+        if (ns < kSub) return static_cast<int>(ns);
+        int e = 63 - __builtin_clzll(ns);
+        return (e - kSubBits + 1) * kSub + static_cast<int>((ns >> (e - kSubBits)) & (kSub - 1));
+    }
+
+    // Наибольшее значение, попадающее в корзину b.
+    static std::uint64_t upperBound(int b) {
+        if (b < kSub) return static_cast<std::uint64_t>(b);
+        int e = b / kSub + kSubBits - 1;
+        std::uint64_t low = (std::uint64_t(1) << e) | (static_cast<std::uint64_t>(b % kSub) << (e - kSubBits));
+        return low + (std::uint64_t(1) << (e - kSubBits)) - 1;
+    }
+
+    std::array<std::uint64_t, kBuckets> counts{};
+
+    std::uint64_t total() const {
+        std::uint64_t n = 0;
+        for (std::uint64_t c : counts) n += c;
+        return n;
+    }
+
+    std::uint64_t percentile(double q) const {
+        std::uint64_t n = total();
+        if (n == 0) return 0;
+        std::uint64_t want = static_cast<std::uint64_t>(q * static_cast<double>(n - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (int b = 0; b < kBuckets; ++b) {
+            seen += counts[b];
+            if (seen >= want) return upperBound(b);
+        }
+        return upperBound(kBuckets - 1);
+    }
+};
+
+// Счётчики одного потока.
+class StatsRecorder {
+private:
+    using Counter = std::atomic<std::uint64_t>;
+
+    struct StageCounters {
+        Counter calls{0};
+        Counter totalNs{0};
+        Counter maxNs{0};
+        std::array<Counter, LatencyHistogram::kBuckets> latency{};
+    };
+
+    std::array<StageCounters, static_cast<std::size_t>(Stage::Count)> stages;
+    std::array<Counter, static_cast<std::size_t>(ErrorCode::Count)> errors{};
+
+    // Пишет только владелец, поэтому без атомарного сложения.
+    static void add(Counter &c, std::uint64_t v) {
+        c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+
+    friend class Stats;
+
+public:
+    void record(Stage s, std::uint64_t ns) {
+        StageCounters &c = stages[static_cast<std::size_t>(s)];
+        add(c.calls, 1);
+        add(c.totalNs, ns);
+        if (ns > c.maxNs.load(std::memory_order_relaxed)) c.maxNs.store(ns, std::memory_order_relaxed);
+        add(c.latency[LatencyHistogram::bucketOf(ns)], 1);
+    }
+
+    void error(ErrorCode code) { add(errors[static_cast<std::size_t>(code)], 1); }
+};
+
+// Сумма по всем потокам на момент чтения.
+struct StatsSnapshot {
+    struct StageTotals {
+        std::uint64_t calls = 0;
+        std::uint64_t totalNs = 0;
+        std::uint64_t maxNs = 0;
+        LatencyHistogram latency;
+    };
+
+    std::array<StageTotals, static_cast<std::size_t>(Stage::Count)> stages;
+    std::array<std::uint64_t, static_cast<std::size_t>(ErrorCode::Count)> errors{};
+};
+
+class Stats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+private:
+    struct Registry {
+        std::mutex lock;
+        std::vector<std::unique_ptr<StatsRecorder>> recorders;
+    };
+
+    static Registry &registry() {
+        static Registry r;
+        return r;
+    }
+
+    static std::atomic<bool> &flag() {
+        static std::atomic<bool> on{false};
+        return on;
+    }
+
+    static std::uint64_t since(Clock::time_point t0) {
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+    }
+
+public:
+    // Включается один раз при старте, до запуска рабочих потоков.
+    static void enable() { flag().store(true); }
+    static bool enabled() { return flag().load(std::memory_order_relaxed); }
+
+    // Счётчики текущего потока; nullptr - статистика выключена.
+    static StatsRecorder *recorder() {
+        if (!enabled()) return nullptr;
+        thread_local StatsRecorder *mine = nullptr;
+        if (!mine) {
+            Registry &r = registry();
+            std::lock_guard<std::mutex> guard(r.lock);
+            r.recorders.push_back(std::make_unique<StatsRecorder>());
+            mine = r.recorders.back().get();
+        }
+        return mine;
+    }
+
+    // f() с замером этапа s; без статистики - просто f().
+    template <typename F>
+    static auto timed(StatsRecorder *rec, Stage s, F &&f) -> decltype(f()) {
+        if (!rec) return f();
+        Clock::time_point t0 = Clock::now();
+        auto r = f();
+        rec->record(s, since(t0));
+        return r;
+    }
+
+    template <typename F>
+    static auto timed(Stage s, F &&f) -> decltype(f()) {
+        return timed(recorder(), s, std::forward<F>(f));
+    }
+
+    static void error(ErrorCode code) {
+        if (StatsRecorder *rec = recorder()) rec->error(code);
+    }
+
+    static StatsSnapshot snapshot() {
+        StatsSnapshot s;
+        Registry &r = registry();
+        std::lock_guard<std::mutex> guard(r.lock);
+        for (const auto &rec : r.recorders) {
+            for (std::size_t k = 0; k < s.stages.size(); ++k) {
+                const StatsRecorder::StageCounters &c = rec->stages[k];
+                StatsSnapshot::StageTotals &t = s.stages[k];
+                t.calls += c.calls.load(std::memory_order_relaxed);
+                t.totalNs += c.totalNs.load(std::memory_order_relaxed);
+                std::uint64_t mx = c.maxNs.load(std::memory_order_relaxed);
+                if (mx > t.maxNs) t.maxNs = mx;
+                for (int b = 0; b < LatencyHistogram::kBuckets; ++b) {
+                    t.latency.counts[b] += c.latency[b].load(std::memory_order_relaxed);
+                }
+            }
+            for (std::size_t k = 0; k < s.errors.size(); ++k) s.errors[k] += rec->errors[k].load(std::memory_order_relaxed);
+        }
+        return s;
+    }
+
+    static std::string json() {
+        StatsSnapshot s = snapshot();
+        std::string out = "{\n  \"stages\": [\n";
+        for (std::size_t k = 0; k < s.stages.size(); ++k) {
+            const StatsSnapshot::StageTotals &t = s.stages[k];
+            char buf[320];
+            std::snprintf(buf, sizeof(buf),
+                          "    {\"stage\": \"%s\", \"calls\": %llu, \"total_ns\": %llu, \"mean_ns\": %.1f, "
+                          "\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu}%s\n",
+                          stageName(static_cast<Stage>(k)), static_cast<unsigned long long>(t.calls),
+                          static_cast<unsigned long long>(t.totalNs),
+                          t.calls ? static_cast<double>(t.totalNs) / static_cast<double>(t.calls) : 0.0,
+                          static_cast<unsigned long long>(t.latency.percentile(0.50)),
+                          static_cast<unsigned long long>(t.latency.percentile(0.90)),
+                          static_cast<unsigned long long>(t.latency.percentile(0.99)),
+                          static_cast<unsigned long long>(t.maxNs), k + 1 < s.stages.size() ? "," : "");
+            out += buf;
+        }
+        out += "  ],\n  \"errors\": {";
+        bool first = true;
+        for (std::size_t k = 0; k < s.errors.size(); ++k) {
+            if (s.errors[k] == 0) continue;
+            out += first ? "" : ", ";
+            out += "\"";
+            out += errorName(static_cast<ErrorCode>(k));
+            out += "\": " + std::to_string(s.errors[k]);
+            first = false;
+        }
+        out += "}\n}\n";
+        return out;
+    }
+
+    static void print(std::ostream &out) {
+        StatsSnapshot s = snapshot();
+        out << "Этап       вызовов     всего, мс   среднее, нс      p50      p90      p99      max\n";
+        for (std::size_t k = 0; k < s.stages.size(); ++k) {
+            const StatsSnapshot::StageTotals &t = s.stages[k];
+            char buf[192];
+            std::snprintf(buf, sizeof(buf), "%-8s %10llu %13.3f %13.1f %8llu %8llu %8llu %8llu\n",
+                          stageName(static_cast<Stage>(k)), static_cast<unsigned long long>(t.calls),
+                          static_cast<double>(t.totalNs) / 1e6,
+                          t.calls ? static_cast<double>(t.totalNs) / static_cast<double>(t.calls) : 0.0,
+                          static_cast<unsigned long long>(t.latency.percentile(0.50)),
+                          static_cast<unsigned long long>(t.latency.percentile(0.90)),
+                          static_cast<unsigned long long>(t.latency.percentile(0.99)),
+                          static_cast<unsigned long long>(t.maxNs));
+            out << buf;
+        }
+        out << "Ошибки:";
+        bool any = false;
+        for (std::size_t k = 0; k < s.errors.size(); ++k) {
+            if (s.errors[k] == 0) continue;
+            out << " " << errorName(static_cast<ErrorCode>(k)) << " " << s.errors[k];
+            any = true;
+        }
+        out << (any ? "\n" : " нет\n");
+    }
+};
+
+// Периодическая запись Stats::json() в файл (через временный файл и rename,
+// чтобы читатель не увидел половину). Последняя запись - в stop().
+class StatsDumper {
+private:
+    std::string path;
+    std::chrono::milliseconds period;
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void dump() {
+        std::string tmp = path + ".tmp";
+        std::FILE *f = std::fopen(tmp.c_str(), "w");
+        if (!f) return;
+        std::string s = Stats::json();
+        bool ok = std::fwrite(s.data(), 1, s.size(), f) == s.size();
+        ok = std::fclose(f) == 0 && ok;
+        if (ok) std::rename(tmp.c_str(), path.c_str());
+    }
+
+public:
+    // Пустой путь - ничего не пишет.
+    StatsDumper(std::string file, std::chrono::milliseconds every) : path(std::move(file)), period(every) {
+        if (path.empty()) return;
+        worker = std::thread([this] {
+            std::unique_lock<std::mutex> guard(lock);
+            while (!wake.wait_for(guard, period, [this] { return stopping; })) dump();
+        });
+    }
+
+    StatsDumper(const StatsDumper &) = delete;
+    StatsDumper &operator=(const StatsDumper &) = delete;
+    ~StatsDumper() { stop(); }
+
+    void stop() {
+        if (!worker.joinable()) return;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+        dump();
+    }
+};
+
+#endif
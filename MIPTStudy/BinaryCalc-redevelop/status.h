@@ -0,0 +1,123 @@
+#ifndef STATUS_GUARD
+#define STATUS_GUARD
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Коды ошибок разбора и вычисления. Status хранит код и позицию фрагмента
+// в исходной строке; текст собирается только при печати (render), так что
+// ни успех, ни ошибка на горячем пути не выделяют память.
+enum class ErrorCode : std::uint8_t {
+    None,
+    UnknownToken,       // фрагмент - нераспознанный токен
+    ExtraRParen,
+    UnexpectedToken,    // фрагмент - токен
+    UnclosedLParen,
+    UnaryNoArg,
+    BinaryNoArgs,
+    UnknownOperator,
+    EvalUnexpectedToken,
+    NotReduced,
+    DivisionByZero,
+    LogicOperands,
+    ShiftOperands,
+    ShiftRange,
+    NotOperands,
+    UnknownVariable,    // фрагмент - имя
+    NotNoArg,
+    NestingTooDeep,
+    FunctionOperands,
+    FunctionCall,       // фрагмент - имя функции
+    FunctionArity,      // фрагмент - имя функции
+    UnknownFunction,    // фрагмент - имя функции
+    FunctionRecursion,  // фрагмент - имя функции
+    InlineTooLarge,
+    ConstRange,         // только при компиляции (constExpr.h)
+    ConstFraction,
+    ColumnInexact,      // только в колоночном режиме (columnar.h)
+    Count
+};
+
+// Текст без фрагмента. Указатели постоянны: ядра Evaluator отдают их как
+// const char *err, и codeOf() восстанавливает код сравнением указателей.
+inline const char *errorText(ErrorCode code) {
+    static const char *const texts[] = {
+        "",
+        "Неизвестный токен: ",
+        "Ошибка: лишняя ')'",
+        "Ошибка: неожиданный токен ",
+        "Ошибка: не закрыта '('",
+        "Ошибка: унарный '-' без аргумента",
+        "Ошибка: бинарный оператор без двух аргументов",
+        "Неизвестный оператор",
+        "Ошибка: неожиданный токен в вычислении",
+        "Ошибка: выражение не свелось к одному значению",
+        "Деление на ноль",
+        "Логические операции (&, |, ^, and/or/xor) разрешены только для неотрицательных целых двоичных чисел (без точки).",
+        "Сдвиги (<<, >>) разрешены только для неотрицательных целых двоичных чисел (без точки).",
+        "Сдвиг должен быть в диапазоне 0..63.",
+        "NOT (~ / not) разрешён только для неотрицательных целых двоичных чисел (без точки).",
+        "Неизвестная переменная: ",
+        "Ошибка: NOT (~ / not) без аргумента",
+        "Ошибка: слишком глубокая вложенность",
+        "Функции (popcount, clz, ctz, parity, rotl, rotr, pdep, pext) разрешены только для неотрицательных целых двоичных чисел (без точки).",
+        "Ошибка: после имени функции нужна '(': ",
+        "Ошибка: неверное число аргументов у функции ",
+        "Неизвестная функция: ",
+        "Ошибка: функция вызывает саму себя: ",
+        "Ошибка: после подстановки функций выражение слишком большое",
+        "Ошибка: значение не помещается в 64-битное целое",
+        "Ошибка: при компиляции только целые - без точки и деления с остатком",
+        "Ошибка: значение столбца uint64_t больше 2^53 не представимо точно",
+    };
+    static_assert(sizeof(texts) / sizeof(texts[0]) == static_cast<std::size_t>(ErrorCode::Count), "errorText");
+    return texts[static_cast<std::size_t>(code)];
+}
+
+inline ErrorCode codeOf(const char *text) {
+    for (std::uint8_t k = 1; k < static_cast<std::uint8_t>(ErrorCode::Count); ++k) {
+        if (errorText(static_cast<ErrorCode>(k)) == text) return static_cast<ErrorCode>(k);
+    }
+    return ErrorCode::None;
+}
+
+constexpr bool hasSpan(ErrorCode code) {
+    return code == ErrorCode::UnknownToken || code == ErrorCode::UnexpectedToken || code == ErrorCode::UnknownVariable ||
+           code == ErrorCode::FunctionCall || code == ErrorCode::FunctionArity || code == ErrorCode::UnknownFunction ||
+           code == ErrorCode::FunctionRecursion;
+}
+
+struct Status {
+    ErrorCode code = ErrorCode::None;
+    std::uint32_t pos = 0;
+    std::uint32_t len = 0;
+
+    bool ok() const { return code == ErrorCode::None; }
+
+    void fail(ErrorCode c, std::uint32_t p = 0, std::uint32_t l = 0) {
+        code = c;
+        pos = p;
+        len = l;
+    }
+
+    // Текст ошибки как у старых ParseResult/EvalResult.
+    std::string render(std::string_view source) const {
+        std::string s = errorText(code);
+        if (hasSpan(code)) {
+            s += '\'';
+            s.append(source.substr(pos, len));
+            s += '\'';
+        }
+        return s;
+    }
+};
+
+// Ошибка с уже собранным текстом (переменные, бэкенды потока, определения):
+// код - для статистики, а если message не пусто - он вместо текста кода.
+struct Fault {
+    ErrorCode code = ErrorCode::None;
+    std::string message;
+};
+
+#endif
@@ -0,0 +1,499 @@
+#ifndef STREAM_EVALUATOR_GUARD
+#define STREAM_EVALUATOR_GUARD
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "bitVector.h"
+#include "environment.h"
+#include "evaluator.h"
+#include "exactEvaluator.h"
+#include "lexer.h"
+#include "parser.h"
+#include "status.h"
+#include "streamLexer.h"
+
+// Бэкенд double: те же ядра, что у Evaluator. Литерал хранит не больше
+// kMaxDigits цифр каждой части: у целой части значащих цифр больше 1024 - уже
+// бесконечность, а дальние цифры дробной части в double всё равно не попадают.
+class DoubleStream {
+public:
+    using Value = double;
+    using Result = EvalResult;
+
+    static constexpr std::size_t kMaxDigits = 4096;
+
+private:
+    std::string digits;
+
+public:
+    static StreamLexer lexer() { return StreamLexer(kMaxDigits, kMaxDigits, true); }
+
+    static Result success(double v, bool bitwise) { return {true, "", BinaryNumber(v), bitwise}; }
+    static Result failure(ErrorCode code, std::string err) { return {false, std::move(err), BinaryNumber(), false, code}; }
+
+    // Целое до 53 значащих цифр - прямо из слова: оно точное, как и в
+    // fromBinaryString; длиннее и с дробью - через строку цифр.
+    bool literal(StreamLexer &lex, double &out, Fault &f) {
+        LiteralBits &ip = lex.integer();
+        if (!lex.hasPoint() && ip.stored() <= 53) {
+            out = static_cast<double>(ip.low());
+            return true;
+        }
+        if (ip.truncated()) {
+            out = std::numeric_limits<double>::infinity();
+            return true;
+        }
+        digits.clear();
+        ip.appendTo(digits);
+        if (digits.empty()) digits.push_back('0');
+        if (lex.hasPoint()) {
+            digits.push_back('.');
+            lex.fraction().appendTo(digits);
+        }
+        BinaryNumber n;
+        if (!BinaryNumber::fromBinaryString(digits, n)) {
+            f.code = ErrorCode::UnknownToken;
+            return false;
+        }
+        out = n.toDouble();
+        return true;
+    }
+
+    bool variable(const StreamLexer &lex, Environment *env, double &out, Fault &f) {
+        f.code = ErrorCode::UnknownVariable;
+        if (lex.tooLong() || !env) return false;
+        return env->lookupDouble(lex.text(), out, f);
+    }
+
+    bool unary(OpKind op, double &a, bool &bitwise, Fault &f) {
+        const char *err = nullptr;
+        if (!Evaluator::unaryKernel(op)(a, a, err)) {
+            f.code = codeOf(err);
+            return false;
+        }
+        bitwise = Evaluator::isBitwise(op);
+        return true;
+    }
+
+    bool binary(OpKind op, double &a, double &b, bool &bitwise, Fault &f) {
+        BinaryKernel k = Evaluator::binaryKernel(op);
+        const char *err = nullptr;
+        if (!k) {
+            f.code = ErrorCode::UnknownOperator;
+            return false;
+        }
+        if (!k(a, b, a, err)) {
+            f.code = codeOf(err);
+            return false;
+        }
+        bitwise = Evaluator::isBitwise(op);
+        return true;
+    }
+};
+
+// Бэкенд bits: литерал сразу собирается в слова BitVector, ширина - число его
+// цифр, как у BitsEvaluator.
+class BitsStream {
+public:
+    using Value = BitVector;
+    using Result = BitsResult;
+
+    static StreamLexer lexer() { return StreamLexer(0, 0, true); }
+
+    static Result success(BitVector v, bool) { return {true, "", std::move(v)}; }
+    static Result failure(ErrorCode code, std::string err) { return {false, std::move(err), BitVector(), code}; }
+
+    bool literal(StreamLexer &lex, BitVector &out, Fault &f) {
+        if (lex.hasPoint()) {
+            f.message = "В режиме bits числа - только целые двоичные литералы: '" + lex.text() + "'";
+            return false;
+        }
+        if (lex.integer().digits() > BitsEvaluator::kMaxWidth) {
+            f.message = "Ширина больше " + std::to_string(BitsEvaluator::kMaxWidth) + " бит";
+            return false;
+        }
+        out.width = lex.integer().digits();
+        lex.integer().take(out.words);
+        out.words.resize(BitVector::wordsFor(out.width), 0);
+        return true;
+    }
+
+    bool variable(const StreamLexer &lex, Environment *, BitVector &, Fault &f) {
+        f.message = "Переменные недоступны в режиме bits: '" + lex.text() + "'";
+        return false;
+    }
+
+    bool unary(OpKind op, BitVector &a, bool &, Fault &f) {
+        return BitsEvaluator::applyUnary(op, a, f.message);
+    }
+
+    bool binary(OpKind op, BitVector &a, BitVector &b, bool &, Fault &f) {
+        return BitsEvaluator::applyBinary(op, a, b, f.message);
+    }
+};
+
+// Бэкенд exact: литерал - мантисса из слов целой и дробной части, без строки.
+class ExactStream {
+public:
+    using Value = Dyadic;
+    using Result = ExactResult;
+
+private:
+    std::size_t fracBits;
+    std::vector<std::uint64_t> limbs;
+
+public:
+    explicit ExactStream(std::size_t divisionFracBits = ExactEvaluator::kDefaultFracBits)
+        : fracBits(divisionFracBits) {}
+
+    static StreamLexer lexer() { return StreamLexer(0, 0, true); }
+
+    static Result success(Dyadic v, bool bitwise) { return {true, "", std::move(v), bitwise}; }
+    static Result failure(ErrorCode code, std::string err) { return {false, std::move(err), Dyadic(), false, code}; }
+
+    bool literal(StreamLexer &lex, Dyadic &out, Fault &) {
+        lex.integer().take(limbs);
+        BigBinary m(std::move(limbs));
+        std::size_t frac = 0;
+        if (lex.hasPoint()) {
+            frac = lex.fraction().digits();
+            lex.fraction().take(limbs);
+            m = m.shiftedLeft(frac) | BigBinary(std::move(limbs));
+        }
+        out = Dyadic::fromScaled(std::move(m), -static_cast<long long>(frac));
+        limbs.clear();
+        return true;
+    }
+
+    bool variable(const StreamLexer &lex, Environment *env, Dyadic &out, Fault &f) {
+        f.code = ErrorCode::UnknownVariable;
+        if (lex.tooLong() || !env) {
+            f = unknownVariable(lex.text());
+            return false;
+        }
+        return env->lookupExact(lex.text(), out, f);
+    }
+
+    bool unary(OpKind op, Dyadic &a, bool &bitwise, Fault &f) {
+        if (op == OpKind::UnaryMinus) {
+            a = -a;
+            bitwise = false;
+            return true;
+        }
+        ExactResult r = op == OpKind::Not ? ExactEvaluator::applyNot(a) : ExactEvaluator::applyFunction(op, a, Dyadic());
+        if (!r.ok) {
+            f = {r.code, std::move(r.error)};
+            return false;
+        }
+        a = std::move(r.value);
+        bitwise = true;
+        return true;
+    }
+
+    bool binary(OpKind op, Dyadic &a, Dyadic &b, bool &bitwise, Fault &f) {
+        ExactResult r = ExactEvaluator::applyBinary(op, a, b, fracBits);
+        if (!r.ok) {
+            f = {r.code, std::move(r.error)};
+            return false;
+        }
+        a = std::move(r.value);
+        bitwise = r.isBitwiseResult;
+        return true;
+    }
+};
+
+// Вычисление выражений прямо из потока, без строки и без RPN: токены от
+// StreamLexer, разбор по приоритетам операторов, и каждый оператор
+// применяется, как только готовы его аргументы. Память - стек незакрытых
+// операторов и скобок и значения на нём, то есть растёт с вложенностью и
+// размером значений, а не с длиной записи; глубина ограничена maxDepth.
+// Выражения в потоке разделяются ';' или переводом строки, пустые пропускаются.
+// Семантика и ошибки те же, что у InfixParser + вычислителя бэкенда, но
+// ошибку вычисления (и нехватку аргументов) можно получить раньше ошибки
+// разбора в хвосте выражения: строка разбирается целиком, поток - нет.
+template <typename Backend>
+class BasicStreamEvaluator {
+public:
+    using Value = typename Backend::Value;
+    using Result = typename Backend::Result;
+
+    static constexpr std::size_t kDefaultMaxDepth = 1 << 20;
+
+private:
+    // Элемент стека операторов: OpKind или открывающая скобка. '(' вызова
+    // функции лежит над самой функцией и помнит, была ли уже запятая.
+    static constexpr std::uint8_t kLParen = 0xff;
+    static constexpr std::uint8_t kCallParen = 0xfe;
+    static constexpr std::uint8_t kCallParenComma = 0xfd;
+
+    std::size_t maxDepth;
+    Environment *env;
+    Backend backend;
+    StreamLexer lex;
+
+    std::vector<std::uint8_t> ops;
+    std::vector<Value> values;
+
+    ErrorCode code = ErrorCode::None;
+    std::uint64_t errorAt = 0;
+    std::string fragment;
+    std::string message;
+
+    bool lastWasBitwise = false;
+
+    static bool isParen(std::uint8_t op) { return op >= kCallParenComma; }
+
+    bool fail(ErrorCode c, std::uint64_t at, std::string_view text = {}) {
+        code = c;
+        errorAt = at;
+        fragment.assign(text.substr(0, StreamLexer::kMaxFragment));
+        message.clear();
+        return false;
+    }
+
+    bool fail(Fault &f, std::uint64_t at, std::string_view text = {}) {
+        fail(f.code, at, text);
+        message = std::move(f.message);
+        return false;
+    }
+
+    bool pushOp(std::uint8_t op, std::uint64_t at) {
+        if (ops.size() >= maxDepth) return fail(ErrorCode::NestingTooDeep, at);
+        ops.push_back(op);
+        return true;
+    }
+
+    bool reduce(std::uint64_t at) {
+        OpKind op = static_cast<OpKind>(ops.back());
+        ops.pop_back();
+        Fault f;
+        if (operandCount(op) == 1) {
+            if (!backend.unary(op, values.back(), lastWasBitwise, f)) return fail(f, at);
+            return true;
+        }
+        Value b = std::move(values.back());
+        values.pop_back();
+        if (!backend.binary(op, values.back(), b, lastWasBitwise, f)) return fail(f, at);
+        return true;
+    }
+
+    bool hasOpenParen() const {
+        for (std::uint8_t op : ops) {
+            if (isParen(op)) return true;
+        }
+        return false;
+    }
+
+    // Ждали аргумент, а пришла ')' или конец выражения. Непарная скобка -
+    // ошибка разбора, она у InfixParser важнее нехватки аргументов.
+    bool missingOperand(std::uint64_t at, bool atEnd) {
+        if (atEnd && hasOpenParen()) return fail(ErrorCode::UnclosedLParen, at);
+        if (!atEnd && !hasOpenParen()) return fail(ErrorCode::ExtraRParen, at);
+        if (!ops.empty() && ops.back() != kLParen && isParen(ops.back())) return wrongArity(at);
+        if (ops.empty() || ops.back() == kLParen) return fail(ErrorCode::NotReduced, at);
+        OpKind top = static_cast<OpKind>(ops.back());
+        if (top == OpKind::UnaryMinus) return fail(ErrorCode::UnaryNoArg, at);
+        if (top == OpKind::Not) return fail(ErrorCode::NotNoArg, at);
+        return fail(ErrorCode::BinaryNoArgs, at);
+    }
+
+    // Сверху стека - '(' вызова, под ней функция.
+    bool wrongArity(std::uint64_t at) {
+        return fail(ErrorCode::FunctionArity, at, functionName(static_cast<OpKind>(ops[ops.size() - 2])));
+    }
+
+    // Имя функции прочитано, дальше должна быть '(' - обе кладутся в стек.
+    bool call(StreamReader &in, OpKind op, std::uint64_t at) {
+        std::string name = lex.text();
+        StreamToken t = lex.next(in);
+        if (t.type != TokenType::LParen) return fail(ErrorCode::FunctionCall, at, name);
+        if (!pushOp(static_cast<std::uint8_t>(op), at)) return false;
+        return pushOp(kCallParen, t.offset);
+    }
+
+    bool binaryOp(OpKind op, std::uint64_t at) {
+        while (!ops.empty() && !isParen(ops.back())) {
+            OpKind top = static_cast<OpKind>(ops.back());
+            int pTop = precedence(top);
+            int pCur = precedence(op);
+            if (!(pTop > pCur || (pTop == pCur && !isRightAssociative(op)))) break;
+            if (!reduce(at)) return false;
+        }
+        return pushOp(static_cast<std::uint8_t>(op), at);
+    }
+
+    // Одно непустое выражение до разделителя (разделитель не читается).
+    bool evaluate(StreamReader &in, Value &value, bool &bitwise) {
+        ops.clear();
+        values.clear();
+        lastWasBitwise = false;
+        bool expectOperand = true;
+        std::uint64_t end = 0;
+
+        while (true) {
+            StreamToken t = lex.next(in);
+            std::uint64_t at = t.offset;
+            if (t.error != ErrorCode::None) return fail(t.error, at, lex.text());
+            if (t.type == TokenType::End) {
+                end = at;
+                break;
+            }
+
+            switch (t.type) {
+                case TokenType::LParen:
+                    if (!expectOperand) return fail(ErrorCode::UnexpectedToken, at, "(");
+                    if (!pushOp(kLParen, at)) return false;
+                    continue;
+                case TokenType::RParen: {
+                    if (expectOperand) return missingOperand(at, false);
+                    while (!ops.empty() && !isParen(ops.back())) {
+                        if (!reduce(at)) return false;
+                    }
+                    if (ops.empty()) return fail(ErrorCode::ExtraRParen, at);
+                    std::uint8_t paren = ops.back();
+                    if (paren == kLParen) {
+                        ops.pop_back();
+                        continue;
+                    }
+                    int args = paren == kCallParenComma ? 2 : 1;
+                    if (functionArity(static_cast<OpKind>(ops[ops.size() - 2])) != args) return wrongArity(at);
+                    ops.pop_back();
+                    if (!reduce(at)) return false;
+                    continue;
+                }
+                case TokenType::Comma:
+                    if (expectOperand) return fail(ErrorCode::UnexpectedToken, at, ",");
+                    while (!ops.empty() && !isParen(ops.back())) {
+                        if (!reduce(at)) return false;
+                    }
+                    if (ops.empty() || ops.back() == kLParen) return fail(ErrorCode::UnexpectedToken, at, ",");
+                    if (ops.back() == kCallParenComma ||
+                        functionArity(static_cast<OpKind>(ops[ops.size() - 2])) != 2) {
+                        return wrongArity(at);
+                    }
+                    ops.back() = kCallParenComma;
+                    expectOperand = true;
+                    continue;
+                case TokenType::Op: {
+                    OpKind op = t.op;
+                    if (isFunction(op)) {
+                        if (!expectOperand) return fail(ErrorCode::UnexpectedToken, at, lex.text());
+                        if (!call(in, op, at)) return false;
+                        continue;
+                    }
+                    if (expectOperand) {
+                        if (op == OpKind::Sub) op = OpKind::UnaryMinus;
+                        if (op != OpKind::UnaryMinus && op != OpKind::Not) return fail(ErrorCode::BinaryNoArgs, at);
+                        if (!pushOp(static_cast<std::uint8_t>(op), at)) return false;
+                        continue;
+                    }
+                    if (op == OpKind::Not) return fail(ErrorCode::UnexpectedToken, at, lex.text());
+                    if (!binaryOp(op, at)) return false;
+                    expectOperand = true;
+                    continue;
+                }
+                case TokenType::Ident:
+                case TokenType::Number: {
+                    if (!expectOperand) return fail(ErrorCode::UnexpectedToken, at, lex.text());
+                    Value v{};
+                    Fault f;
+                    bool ok = t.type == TokenType::Number ? backend.literal(lex, v, f) : backend.variable(lex, env, v, f);
+                    if (!ok) return fail(f, at, lex.text());
+                    values.push_back(std::move(v));
+                    expectOperand = false;
+                    continue;
+                }
+                default:
+                    return fail(ErrorCode::UnknownToken, at, lex.text());
+            }
+        }
+
+        if (expectOperand) return missingOperand(end, true);
+        while (!ops.empty()) {
+            if (isParen(ops.back())) return fail(ErrorCode::UnclosedLParen, end);
+            if (!reduce(end)) return false;
+        }
+        value = std::move(values.back());
+        values.clear();
+        bitwise = lastWasBitwise;
+        return true;
+    }
+
+    // Префикс как у Session: разбора - то, что находят InfixParser и
+    // подстановка функций (и глубина стека), остальное - вычисления, в том
+    // числе нехватка аргументов: её в строке находит вычислитель.
+    static bool isEvalError(ErrorCode c) {
+        switch (c) {
+            case ErrorCode::UnknownToken:
+            case ErrorCode::ExtraRParen:
+            case ErrorCode::UnexpectedToken:
+            case ErrorCode::UnclosedLParen:
+            case ErrorCode::FunctionCall:
+            case ErrorCode::FunctionArity:
+            case ErrorCode::UnknownFunction:
+            case ErrorCode::FunctionRecursion:
+            case ErrorCode::InlineTooLarge:
+            case ErrorCode::NestingTooDeep:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    std::string errorMessage() const {
+        std::string s = isEvalError(code) ? "Ошибка вычисления: " : "Ошибка разбора: ";
+        if (!message.empty()) {
+            s += message;
+        } else {
+            s += errorText(code);
+            if (hasSpan(code)) {
+                s += '\'';
+                s += fragment;
+                s += '\'';
+            }
+        }
+        s += " (смещение " + std::to_string(errorAt) + ")";
+        return s;
+    }
+
+public:
+    explicit BasicStreamEvaluator(std::size_t depthLimit = kDefaultMaxDepth, Environment *environment = nullptr,
+                                  Backend valueBackend = Backend())
+        : maxDepth(depthLimit ? depthLimit : 1), env(environment), backend(std::move(valueBackend)),
+          lex(Backend::lexer()) {}
+
+    // Следующее выражение потока. false - выражений больше нет.
+    // Ошибка - в out.error, со смещением в байтах от начала потока; остаток
+    // выражения до разделителя пропускается.
+    bool next(StreamReader &in, Result &out) {
+        while (true) {
+            int c = in.peek();
+            if (c < 0) return false;
+            if (StreamLexer::isSpace(c) || c == ';' || c == '\n') { in.get(); continue; }
+            break;
+        }
+
+        Value value{};
+        bool bitwise = false;
+        code = ErrorCode::None;
+        if (evaluate(in, value, bitwise)) {
+            out = Backend::success(std::move(value), bitwise);
+            return true;
+        }
+        values.clear();
+        out = Backend::failure(code, errorMessage());
+        while (!StreamLexer::isTerminator(in.peek())) in.get();
+        return true;
+    }
+};
+
+using StreamEvaluator = BasicStreamEvaluator<DoubleStream>;
+using BitsStreamEvaluator = BasicStreamEvaluator<BitsStream>;
+using ExactStreamEvaluator = BasicStreamEvaluator<ExactStream>;
+
+#endif
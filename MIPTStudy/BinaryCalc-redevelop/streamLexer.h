@@ -0,0 +1,374 @@
+#ifndef STREAM_LEXER_GUARD
+#define STREAM_LEXER_GUARD
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bitText.h"
+#include "lexer.h"
+#include "status.h"
+
+// Чтение из дескриптора через буфер фиксированного размера, из готовой строки
+// в памяти или из отображённого файла. offset() - сколько байт уже прочитано.
+class StreamReader {
+private:
+    int fd = -1;
+    std::vector<char> buf;
+    const char *base = nullptr;
+    const char *p = nullptr;
+    const char *lim = nullptr;
+    const char *mapEnd = nullptr;  // конец отображения; nullptr - не отображение
+    std::size_t window = 0;
+    std::uint64_t before = 0;      // байт в уже отброшенных блоках
+
+    bool fill() {
+        if (mapEnd) {
+            if (lim == mapEnd) return false;
+            ::madvise(const_cast<char *>(base), static_cast<std::size_t>(lim - base), MADV_DONTNEED);
+            before += static_cast<std::uint64_t>(lim - base);
+            base = p = lim;
+            lim += std::min(window, static_cast<std::size_t>(mapEnd - lim));
+            return true;
+        }
+        if (fd < 0) return false;
+        before += static_cast<std::uint64_t>(lim - base);
+        while (true) {
+            ssize_t r = ::read(fd, buf.data(), buf.size());
+            if (r < 0 && errno == EINTR) continue;
+            p = buf.data();
+            lim = p + (r > 0 ? r : 0);
+            if (r <= 0) fd = -1;
+            return r > 0;
+        }
+    }
+
+public:
+    explicit StreamReader(int inFd, std::size_t capacity = 1 << 16) : fd(inFd), buf(capacity) {
+        base = p = lim = buf.data();
+    }
+
+    explicit StreamReader(std::string_view text)
+        : base(text.data()), p(text.data()), lim(text.data() + text.size()) {}
+
+    // Отображение файла (MappedFile) читается окнами по windowBytes, кратным
+    // странице: прочитанное окно отдаётся системе, так что страницы входа не
+    // копятся в памяти процесса.
+    StreamReader(std::string_view mapping, std::size_t windowBytes)
+        : base(mapping.data()), p(base), lim(base), mapEnd(base + mapping.size()), window(windowBytes) {}
+
+    StreamReader(const StreamReader &) = delete;
+    StreamReader &operator=(const StreamReader &) = delete;
+
+    // -1 - конец потока.
+    int peek() {
+        if (p == lim && !fill()) return -1;
+        return static_cast<unsigned char>(*p);
+    }
+
+    int get() {
+        int c = peek();
+        if (c >= 0) ++p;
+        return c;
+    }
+
+    // Непрочитанный остаток текущего блока; пусто - конец потока. Вместе со
+    // skip() - чтение длинных участков без побайтового peek/get.
+    std::string_view buffered() {
+        if (p == lim && !fill()) return std::string_view();
+        return std::string_view(p, static_cast<std::size_t>(lim - p));
+    }
+
+    // n не больше buffered().size().
+    void skip(std::size_t n) { p += n; }
+
+    std::uint64_t offset() const {
+        return before + static_cast<std::uint64_t>(p - base);
+    }
+};
+
+// Цифры двоичного литерала по мере чтения, бит на цифру: полные слова по 64
+// цифры в порядке чтения (старшие первыми) и неполное слово acc. Хранится не
+// больше cap цифр (0 - без ограничения), лишние только считаются. С
+// skipZeros ведущие нули не хранятся.
+class LiteralBits {
+private:
+    std::vector<std::uint64_t> full;
+    std::uint64_t acc = 0;
+    unsigned accBits = 0;
+    std::size_t count = 0;    // цифр всего
+    std::size_t kept = 0;     // сохранено
+    std::size_t dropped = 0;  // не влезло в cap
+    std::size_t cap = 0;
+    bool skipZeros = false;
+
+    void push(char c) {
+        ++count;
+        if (skipZeros && kept == 0 && c == '0') return;
+        if (cap != 0 && kept >= cap) {
+            ++dropped;
+            return;
+        }
+        acc = acc << 1 | static_cast<std::uint64_t>(c - '0');
+        ++kept;
+        if (++accBits == 64) {
+            full.push_back(acc);
+            acc = 0;
+            accBits = 0;
+        }
+    }
+
+    // 64 цифры разом, mask - как у maskBinaryDigits64 (бит j - цифра j).
+    bool pushWord(std::uint64_t mask) {
+        if (skipZeros && kept == 0) {
+            if (mask != 0) return false;
+            count += 64;
+            return true;
+        }
+        if (cap != 0 && kept >= cap) {
+            count += 64;
+            dropped += 64;
+            return true;
+        }
+        if (cap != 0 && cap - kept < 64) return false;
+        std::uint64_t w = reverseBits64(mask);
+        if (accBits == 0) {
+            full.push_back(w);
+        } else {
+            full.push_back(acc << (64 - accBits) | w >> accBits);
+            acc = w & ((std::uint64_t(1) << accBits) - 1);
+        }
+        count += 64;
+        kept += 64;
+        return true;
+    }
+
+public:
+    void reset(std::size_t limit, bool skipLeadingZeros) {
+        full.clear();
+        acc = 0;
+        accBits = 0;
+        count = kept = dropped = 0;
+        cap = limit;
+        skipZeros = skipLeadingZeros;
+    }
+
+    // Цифры 0/1 с начала text, пока они идут; возвращает, сколько прочитано.
+    std::size_t append(std::string_view text) {
+        std::size_t i = 0;
+        while (i < text.size()) {
+            std::uint64_t mask = 0;
+            if (text.size() - i >= 64 && maskBinaryDigits64(text.data() + i, mask) && pushWord(mask)) {
+                i += 64;
+                continue;
+            }
+            std::size_t stop = std::min(text.size(), i + 64);
+            for (; i < stop; ++i) {
+                if (kCharTables.cls[static_cast<unsigned char>(text[i])] != CharClass::Bit) return i;
+                push(text[i]);
+            }
+        }
+        return i;
+    }
+
+    std::size_t digits() const { return count; }
+    std::size_t stored() const { return kept; }
+    bool truncated() const { return dropped != 0; }
+
+    // Сохранённые цифры как число, если их не больше 64.
+    std::uint64_t low() const { return full.empty() ? acc : full[0]; }
+
+    // Сохранённые цифры строкой.
+    void appendTo(std::string &out) const {
+        std::size_t at = out.size();
+        out.resize(at + kept);
+        char *q = &out[at];
+        for (std::uint64_t w : full) {
+            unpackBinaryDigits(&w, 64, q);
+            q += 64;
+        }
+        if (accBits != 0) unpackBinaryDigits(&acc, accBits, q);
+    }
+
+    // Значение сохранённых цифр словами, младшее первым; буфер слов
+    // переходит в limbs без копии, сами цифры сбрасываются.
+    void take(std::vector<std::uint64_t> &limbs) {
+        limbs.swap(full);
+        full.clear();
+        std::reverse(limbs.begin(), limbs.end());
+        if (accBits != 0) {
+            // Все полные слова сдвигаются на accBits, снизу встаёт acc.
+            unsigned r = accBits;
+            limbs.push_back(0);
+            for (std::size_t k = limbs.size() - 1; k > 0; --k) limbs[k] = limbs[k] << r | limbs[k - 1] >> (64 - r);
+            limbs[0] = limbs[0] << r | acc;
+            if (limbs.back() == 0) limbs.pop_back();
+        }
+        acc = 0;
+        accBits = 0;
+        kept = 0;
+    }
+};
+
+// Токены прямо из StreamReader, без строки выражения. Текст токена (имя,
+// начало литерала, нераспознанный символ) - в text(), не длиннее kMaxName.
+// Цифры литерала идут не в текст, а в integer()/fraction() сразу битами, так
+// что литерал любой длины занимает память своего значения, а не своей записи.
+// Выражение кончается на ';', '\n' или конце потока: тогда End, разделитель не
+// читается.
+struct StreamToken {
+    TokenType type = TokenType::End;
+    OpKind op = OpKind::Add;  // у Op: оператор, and/or/xor/not или функция
+    std::uint64_t offset = 0;
+    ErrorCode error = ErrorCode::None;  // End с ошибкой - нераспознанный фрагмент
+};
+
+class StreamLexer {
+public:
+    static constexpr std::size_t kMaxName = 256;
+    static constexpr std::size_t kMaxFragment = 64;
+
+private:
+    std::string word;
+    bool longName = false;
+    bool point = false;
+    std::size_t intCap, fracCap;
+    bool intSkipZeros;
+    LiteralBits intPart, fracPart;
+
+    static bool isNameChar(int c) {
+        if (c < 0) return false;
+        CharClass k = kCharTables.cls[c];
+        return k == CharClass::Alpha || k == CharClass::Bit || k == CharClass::Digit;
+    }
+
+    void keep(char c) {
+        if (word.size() < kMaxFragment) word.push_back(c);
+    }
+
+    // Цифры до первой не-цифры; true, если была хоть одна.
+    bool digits(StreamReader &in, LiteralBits &bits) {
+        std::size_t before = bits.digits();
+        while (true) {
+            std::string_view w = in.buffered();
+            if (w.empty()) break;
+            std::size_t n = bits.append(w);
+            for (std::size_t k = 0; k < n && word.size() < kMaxFragment; ++k) word.push_back(w[k]);
+            in.skip(n);
+            if (n < w.size()) break;
+        }
+        return bits.digits() != before;
+    }
+
+    // Литерал как в Lexer: цифры 0/1 и не больше одной точки, с цифрами по обе
+    // стороны от неё.
+    StreamToken literal(StreamReader &in, StreamToken t) {
+        intPart.reset(intCap, intSkipZeros);
+        fracPart.reset(fracCap, false);
+        bool intDigits = digits(in, intPart);
+        int c = in.peek();
+        point = c >= 0 && kCharTables.cls[c] == CharClass::Dot;
+        if (point) {
+            in.get();
+            keep('.');
+            bool fracDigits = digits(in, fracPart);
+            if (!intDigits || !fracDigits) t.error = ErrorCode::UnknownToken;
+        }
+        t.type = t.error == ErrorCode::None ? TokenType::Number : TokenType::End;
+        return t;
+    }
+
+public:
+    // intLimit/fracLimit - сколько цифр целой и дробной части хранить (0 -
+    // все); skipLeadingZeros - не хранить ведущие нули целой части.
+    explicit StreamLexer(std::size_t intLimit = 0, std::size_t fracLimit = 0, bool skipLeadingZeros = true)
+        : intCap(intLimit), fracCap(fracLimit), intSkipZeros(skipLeadingZeros) {}
+
+    static bool isSpace(int c) { return c >= 0 && c != '\n' && kCharTables.cls[c] == CharClass::Space; }
+    static bool isTerminator(int c) { return c < 0 || c == ';' || c == '\n'; }
+
+    StreamToken next(StreamReader &in) {
+        while (isSpace(in.peek())) in.get();
+        StreamToken t;
+        t.offset = in.offset();
+        word.clear();
+        int c = in.peek();
+        if (isTerminator(c)) return t;
+
+        switch (kCharTables.cls[c]) {
+            case CharClass::LParen:
+                in.get();
+                t.type = TokenType::LParen;
+                return t;
+            case CharClass::RParen:
+                in.get();
+                t.type = TokenType::RParen;
+                return t;
+            case CharClass::Comma:
+                in.get();
+                t.type = TokenType::Comma;
+                return t;
+            case CharClass::Less:
+            case CharClass::Greater: {
+                char first = static_cast<char>(in.get());
+                word.assign(1, first);
+                if (in.peek() != first) {
+                    t.error = ErrorCode::UnknownToken;
+                    return t;
+                }
+                in.get();
+                word.push_back(first);
+                t.type = TokenType::Op;
+                t.op = first == '<' ? OpKind::Shl : OpKind::Shr;
+                return t;
+            }
+            case CharClass::OpChar:
+                in.get();
+                word.assign(1, static_cast<char>(c));
+                t.type = TokenType::Op;
+                t.op = kCharTables.op[c];
+                return t;
+            case CharClass::Alpha:
+                longName = false;
+                // Ключевое слово кончается на первой цифре, как в Lexer.
+                while (in.peek() >= 0 && kCharTables.cls[in.peek()] == CharClass::Alpha && word.size() < kMaxName)
+                    word.push_back(static_cast<char>(in.get()));
+                if (Lexer::isKeyword(word, t.op)) {
+                    t.type = TokenType::Op;
+                    return t;
+                }
+                while (isNameChar(in.peek())) {
+                    char ch = static_cast<char>(in.get());
+                    if (word.size() < kMaxName) word.push_back(ch);
+                    else longName = true;
+                }
+                t.type = TokenType::Ident;
+                return t;
+            case CharClass::Bit:
+            case CharClass::Dot:
+                return literal(in, t);
+            default:
+                word.assign(1, static_cast<char>(in.get()));
+                t.error = ErrorCode::UnknownToken;
+                return t;
+        }
+    }
+
+    // Текст последнего токена; у литерала - первые kMaxFragment символов.
+    const std::string &text() const { return word; }
+    // Имя длиннее kMaxName: в text() только его начало.
+    bool tooLong() const { return longName; }
+
+    // Части последнего литерала.
+    bool hasPoint() const { return point; }
+    LiteralBits &integer() { return intPart; }
+    LiteralBits &fraction() { return fracPart; }
+};
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef TRUTH_TABLE_GUARD
+#define TRUTH_TABLE_GUARD
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bitText.h"
+#include "bitVector.h"
+#include "chainReduce.h"
+#include "parser.h"
+
+// Шаг программы таблицы истинности: вход, константа или логическая операция.
+struct TruthStep {
+    enum class Kind : std::uint8_t { Input, Zero, One, And, Or, Xor, Not };
+    Kind kind = Kind::Zero;
+    std::uint32_t input = 0;  // у Input - номер входа
+};
+
+struct TruthProgram {
+    std::vector<std::string> inputs;  // в порядке первого появления в выражении
+    std::vector<TruthStep> steps;
+    std::size_t depth = 0;            // наибольшая глубина стека
+
+    std::uint64_t rows() const { return std::uint64_t(1) << inputs.size(); }
+    std::uint64_t words() const { return (rows() + 63) / 64; }
+};
+
+// Таблица истинности битового выражения от k однобитовых входов. Строка r -
+// набор входов, где первый вход - старший бит r. Вычисление побитово-срезное:
+// вход j - это не бит, а слово, бит b которого - значение входа в строке
+// 64 * w + b, так что один проход RPN по словам считает 64 строки одними
+// AND/OR/XOR/NOT. Проход идёт сразу по kBlockWords словам через BitKernels
+// (AVX2 по 4 слова, SSE2 по 2), а слова таблицы делятся между потоками.
+class TruthTable {
+public:
+    static constexpr std::size_t kMaxInputs = 30;
+    static constexpr std::size_t kBlockWords = 64;
+    // Столько слов таблицы считается за раз и отдаётся потребителю.
+    static constexpr std::size_t kSegmentWords = std::size_t(1) << 16;
+
+private:
+    // Бит b слова - бит p номера строки 64 * w + b при p < 6.
+    static constexpr std::uint64_t kLanePattern[6] = {
+        0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+        0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL,
+    };
+
+    // Слова first..first+n входа, который задаёт бит p номера строки.
+    static void fillInput(unsigned p, std::uint64_t first, std::size_t n, std::uint64_t *out) {
+        if (p < 6) {
+            std::fill(out, out + n, kLanePattern[p]);
+            return;
+        }
+        for (std::size_t i = 0; i < n; ++i) out[i] = ((first + i) >> (p - 6)) & 1 ? ~std::uint64_t(0) : 0;
+    }
+
+    // Слова first..first+count таблицы в out; stack - буфер вызывающего.
+    static void evaluate(const TruthProgram &p, std::uint64_t first, std::size_t count, std::uint64_t *out,
+                         std::vector<std::uint64_t> &stack) {
+        unsigned k = static_cast<unsigned>(p.inputs.size());
+        stack.resize(p.depth * kBlockWords);
+        for (std::size_t done = 0; done < count; done += kBlockWords) {
+            std::size_t n = std::min(kBlockWords, count - done);
+            std::uint64_t *top = stack.data();
+            for (const TruthStep &s : p.steps) {
+                std::uint64_t *a = top - kBlockWords;
+                switch (s.kind) {
+                    case TruthStep::Kind::Input:
+                        fillInput(k - 1 - s.input, first + done, n, top);
+                        top += kBlockWords;
+                        break;
+                    case TruthStep::Kind::Zero:
+                    case TruthStep::Kind::One:
+                        std::fill(top, top + n, s.kind == TruthStep::Kind::One ? ~std::uint64_t(0) : 0);
+                        top += kBlockWords;
+                        break;
+                    case TruthStep::Kind::Not:
+                        BitKernels::invert(a, a, n);
+                        break;
+                    default: {
+                        std::uint64_t *b = a;
+                        a -= kBlockWords;
+                        BitKernels::Logic l = s.kind == TruthStep::Kind::And ? BitKernels::Logic::And
+                                            : s.kind == TruthStep::Kind::Or  ? BitKernels::Logic::Or
+                                                                             : BitKernels::Logic::Xor;
+                        BitKernels::logic(l, a, b, a, n);
+                        top = b;
+                        break;
+                    }
+                }
+            }
+            std::copy(stack.data(), stack.data() + n, out + done);
+        }
+    }
+
+    static bool isBitLiteral(std::string_view text, bool &one) {
+        std::size_t i = text.find_first_not_of('0');
+        if (i == std::string_view::npos) {
+            one = false;
+            return true;
+        }
+        one = true;
+        return i + 1 == text.size() && text[i] == '1';
+    }
+
+public:
+    // RPN выражения -> программа. Допустимы только and/or/xor/not (& | ^),
+    // константы 0 и 1; каждая переменная - вход.
+    static bool compile(const std::vector<Token> &rpn, std::string_view source, TruthProgram &out,
+                        Fault &err) {
+        out = TruthProgram();
+        std::size_t depth = 0;
+        for (const Token &t : rpn) {
+            TruthStep s;
+            if (t.type == TokenType::Ident) {
+                std::string_view name = t.text(source);
+                auto it = std::find(out.inputs.begin(), out.inputs.end(), name);
+                if (it == out.inputs.end()) {
+                    if (out.inputs.size() == kMaxInputs) {
+                        err.message = "Входов у таблицы истинности не больше " + std::to_string(kMaxInputs);
+                        return false;
+                    }
+                    it = out.inputs.insert(it, std::string(name));
+                }
+                s.kind = TruthStep::Kind::Input;
+                s.input = static_cast<std::uint32_t>(it - out.inputs.begin());
+            } else if (t.type == TokenType::Number) {
+                bool one = false;
+                if (!isBitLiteral(t.text(source), one)) {
+                    err.message = "В таблице истинности константы - только 0 и 1: '" + std::string(t.text(source)) + "'";
+                    return false;
+                }
+                s.kind = one ? TruthStep::Kind::One : TruthStep::Kind::Zero;
+            } else if (t.type == TokenType::Op && (t.op == OpKind::And || t.op == OpKind::Or ||
+                                                   t.op == OpKind::Xor || t.op == OpKind::Not)) {
+                std::size_t need = t.op == OpKind::Not ? 1 : 2;
+                if (depth < need) {
+                    err.code = need == 2 ? ErrorCode::BinaryNoArgs : ErrorCode::NotNoArg;
+                    err.message = errorText(err.code);
+                    return false;
+                }
+                depth -= need - 1;
+                s.kind = t.op == OpKind::And ? TruthStep::Kind::And
+                       : t.op == OpKind::Or  ? TruthStep::Kind::Or
+                       : t.op == OpKind::Xor ? TruthStep::Kind::Xor
+                                             : TruthStep::Kind::Not;
+                out.steps.push_back(s);
+                continue;
+            } else {
+                err.message = "В таблице истинности доступны только and, or, xor, not (& | ^), скобки, 0 и 1";
+                return false;
+            }
+            out.steps.push_back(s);
+            out.depth = std::max(out.depth, ++depth);
+        }
+        if (depth != 1) {
+            err = {ErrorCode::NotReduced, errorText(ErrorCode::NotReduced)};
+            return false;
+        }
+        return true;
+    }
+
+    // Вся таблица по сегментам: сегмент считается в несколько потоков
+    // (ChainReducer::blocks, число потоков - --threads), потом
+    // sink(words, n, rows) получает его слова по порядку; rows - строк в них.
+    // Бит b слова w - строка 64 * w + b; биты за последней строкой - нули.
+    template <typename Sink>
+    static void run(const TruthProgram &p, Sink sink) {
+        std::uint64_t rows = p.rows(), words = p.words();
+        std::vector<std::uint64_t> seg(static_cast<std::size_t>(std::min<std::uint64_t>(words, kSegmentWords)));
+        for (std::uint64_t w = 0; w < words; w += seg.size()) {
+            std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(seg.size(), words - w));
+            ChainReducer::blocks<std::vector<std::uint64_t>>(n, [&](std::size_t lo, std::size_t hi,
+                                                                   std::vector<std::uint64_t> &stack) {
+                evaluate(p, w + lo, hi - lo, seg.data() + lo, stack);
+            });
+            if (rows < 64) seg[0] &= (std::uint64_t(1) << rows) - 1;
+            sink(seg.data(), n, std::min<std::uint64_t>(rows - 64 * w, 64 * static_cast<std::uint64_t>(n)));
+        }
+    }
+
+    // Входы, затем строка из 2^k цифр (строка 0 первой) и число единиц.
+    // Таблица печатается по сегментам, целиком в памяти её нет.
+    static void print(const TruthProgram &p, std::ostream &out) {
+        out << "входы:";
+        for (const std::string &name : p.inputs) out << ' ' << name;
+        if (p.inputs.empty()) out << " нет";
+        out << "\n";
+
+        std::uint64_t ones = 0;
+        std::vector<char> text(64 * kBlockWords);
+        run(p, [&](const std::uint64_t *words, std::size_t n, std::uint64_t rows) {
+            for (std::size_t i = 0; i < n; i += kBlockWords) {
+                std::size_t m = std::min(kBlockWords, n - i);
+                for (std::size_t j = 0; j < m; ++j) {
+                    std::uint64_t r = reverseBits64(words[i + j]);
+                    unpackBinaryDigits(&r, 64, text.data() + 64 * j);
+                    ones += BitOps::popcount(words[i + j]);
+                }
+                std::uint64_t len = std::min<std::uint64_t>(rows - 64 * i, 64 * m);
+                out.write(text.data(), static_cast<std::streamsize>(len));
+            }
+        });
+        out << "   (строк: " << p.rows() << ", единиц: " << ones << ")\n";
+    }
+};
+
+#endif
@@ -0,0 +1,249 @@
+#ifndef USER_FUNCTIONS_GUARD
+#define USER_FUNCTIONS_GUARD
+
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "parser.h"
+
+// Функции пользователя: def name(a, b) = выражение. Тело разбирается один раз
+// при определении и хранится как RPN; в месте вызова оно подставляется в RPN
+// вызывающего вместо Call, параметры - копиями RPN аргументов. Дальше
+// выражение идёт обычным путём (кеш планов, VM, JIT, exact, bits), как если бы
+// тело было написано вручную.
+//
+// Вызовы внутри тела подставляются при определении, так что хранимые тела
+// без Call, а связывание статическое: переопределение g не меняет уже
+// определённую f, которая вызывает g. Поэтому рекурсия возможна только прямая,
+// и она - ошибка.
+class FunctionLibrary {
+public:
+    static constexpr std::size_t kMaxParams = InfixParser::kMaxArgs;
+    // Токенов, добавленных подстановкой в одно выражение (или тело), не больше.
+    static constexpr std::size_t kMaxInlined = std::size_t(1) << 16;
+
+private:
+    struct Function {
+        std::vector<std::string> params;
+        std::vector<std::size_t> uses;  // вхождений каждого параметра в rpn
+        std::string text;               // тело как написано
+        std::string source;             // текст для токенов rpn: тело и тела вызванных функций
+        std::vector<Token> rpn;         // параметры - TokenType::Param
+    };
+
+    std::map<std::string, Function, std::less<>> fns;
+
+    // Тело должно сворачиваться в одно значение: иначе ошибка была бы у
+    // каждого вызова, а не у определения.
+    static ErrorCode checkShape(const std::vector<Token> &rpn) {
+        std::size_t depth = 0;
+        for (const Token &t : rpn) {
+            if (t.type != TokenType::Op) {
+                ++depth;
+                continue;
+            }
+            std::size_t n = static_cast<std::size_t>(operandCount(t.op));
+            if (depth < n) {
+                if (n == 2) return ErrorCode::BinaryNoArgs;
+                return t.op == OpKind::Not ? ErrorCode::NotNoArg : ErrorCode::UnaryNoArg;
+            }
+            depth -= n - 1;
+        }
+        return depth == 1 ? ErrorCode::None : ErrorCode::NotReduced;
+    }
+
+    // Подставляет тела вместо Call из rpn (токены указывают в source). Текст
+    // для токенов out - в text, пустой, если вызовов не было. self - имя
+    // определяемой функции, её вызов - рекурсия.
+    bool expand(const std::vector<Token> &rpn, std::string_view source, std::string_view self,
+                std::vector<Token> &out, std::string &text, Status &st) const {
+        out.clear();
+        text.clear();
+        // Начала поддеревьев на стеке: аргументы вызова - последние из них.
+        std::vector<std::size_t> starts;
+        std::vector<std::pair<const Function *, std::uint32_t>> placed;
+        std::vector<Token> args;
+        std::vector<std::size_t> argEnd;
+
+        for (std::size_t i = 0; i < rpn.size(); ++i) {
+            const Token &t = rpn[i];
+            if (t.type != TokenType::Op) {
+                starts.push_back(out.size());
+                out.push_back(t);
+                continue;
+            }
+            if (t.op != OpKind::Call) {
+                std::size_t n = static_cast<std::size_t>(operandCount(t.op));
+                if (starts.size() < n) {
+                    // Нехватку операндов найдёт вычислитель - раньше любого
+                    // вызова дальше по RPN, так что остаток копируется как есть.
+                    out.insert(out.end(), rpn.begin() + i, rpn.end());
+                    return true;
+                }
+                starts.resize(starts.size() - n + 1);
+                out.push_back(t);
+                continue;
+            }
+
+            std::string_view name = t.text(source);
+            if (name == self) {
+                st.fail(ErrorCode::FunctionRecursion, t.pos, t.len);
+                return false;
+            }
+            auto it = fns.find(name);
+            if (it == fns.end()) {
+                st.fail(ErrorCode::UnknownFunction, t.pos, t.len);
+                return false;
+            }
+            const Function &fn = it->second;
+            std::size_t n = t.commas;
+            if (n != fn.params.size() || starts.size() < n) {
+                st.fail(ErrorCode::FunctionArity, t.pos, t.len);
+                return false;
+            }
+
+            std::size_t base = n == 0 ? out.size() : starts[starts.size() - n];
+            std::size_t grown = fn.rpn.size();
+            argEnd.clear();
+            for (std::size_t k = 0; k < n; ++k) {
+                std::size_t end = k + 1 < n ? starts[starts.size() - n + k + 1] : out.size();
+                argEnd.push_back(end - base);
+                grown = grown - fn.uses[k] + fn.uses[k] * (end - starts[starts.size() - n + k]);
+            }
+            if (base + grown > i + 1 + kMaxInlined) {
+                st.fail(ErrorCode::InlineTooLarge);
+                return false;
+            }
+            args.assign(out.begin() + base, out.end());
+            out.resize(base);
+            starts.resize(starts.size() - n);
+
+            std::uint32_t offset = 0;
+            std::size_t p = 0;
+            while (p < placed.size() && placed[p].first != &fn) ++p;
+            if (p < placed.size()) {
+                offset = placed[p].second;
+            } else {
+                if (text.empty()) text.assign(source);
+                text += ' ';
+                offset = static_cast<std::uint32_t>(text.size());
+                text += fn.source;
+                placed.emplace_back(&fn, offset);
+            }
+
+            for (const Token &b : fn.rpn) {
+                if (b.type == TokenType::Param) {
+                    std::size_t from = b.pos == 0 ? 0 : argEnd[b.pos - 1];
+                    out.insert(out.end(), args.begin() + from, args.begin() + argEnd[b.pos]);
+                } else {
+                    out.push_back(b);
+                    out.back().pos += offset;
+                }
+            }
+            starts.push_back(base);
+        }
+        return true;
+    }
+
+public:
+    // Ошибка - false + err, библиотека не меняется.
+    bool define(const std::string &name, const std::vector<std::string> &params, const std::string &body,
+                Fault &err) {
+        if (params.size() > kMaxParams) {
+            err.message = "Ошибка: у функции больше " + std::to_string(kMaxParams) + " параметров";
+            return false;
+        }
+        for (std::size_t k = 0; k < params.size(); ++k) {
+            for (std::size_t j = 0; j < k; ++j) {
+                if (params[j] == params[k]) {
+                    err.message = "Ошибка: параметр '" + params[k] + "' повторяется";
+                    return false;
+                }
+            }
+        }
+
+        ParseResult pr = InfixParser::toRpn(body, true);
+        if (!pr.ok) {
+            err = {pr.code, pr.error};
+            return false;
+        }
+
+        Function fn;
+        fn.params = params;
+        for (Token &t : pr.rpn) {
+            if (t.type != TokenType::Ident) continue;
+            std::string_view w = t.text(body);
+            for (std::size_t k = 0; k < params.size(); ++k) {
+                if (params[k] != w) continue;
+                t.type = TokenType::Param;
+                t.pos = static_cast<std::uint32_t>(k);
+                t.len = 0;
+                break;
+            }
+        }
+
+        Status st;
+        if (!expand(pr.rpn, body, name, fn.rpn, fn.source, st)) {
+            err = {st.code, st.render(body)};
+            return false;
+        }
+        ErrorCode shape = checkShape(fn.rpn);
+        if (shape != ErrorCode::None) {
+            err = {shape, errorText(shape)};
+            return false;
+        }
+
+        // Параметры могли прийти и из аргументов подставленных вызовов.
+        fn.uses.assign(params.size(), 0);
+        for (const Token &t : fn.rpn) {
+            if (t.type == TokenType::Param) ++fn.uses[t.pos];
+        }
+        fn.text = body;
+        if (fn.source.empty()) fn.source = body;
+        fns[name] = std::move(fn);
+        return true;
+    }
+
+    // Разбор выражения с подстановкой функций; rpn без Call и Param.
+    ParseResult parse(std::string_view expr) const {
+        ParseResult r = InfixParser::toRpn(expr, true);
+        bool calls = false;
+        for (const Token &t : r.rpn) calls = calls || (t.type == TokenType::Op && t.op == OpKind::Call);
+        if (!calls) return r;
+
+        std::vector<Token> out;
+        Status st;
+        if (!expand(r.rpn, expr, std::string_view(), out, r.inlined, st)) {
+            r.ok = false;
+            r.error = st.render(expr);
+            r.code = st.code;
+            r.rpn.clear();
+            r.inlined.clear();
+            return r;
+        }
+        r.rpn = std::move(out);
+        return r;
+    }
+
+    bool empty() const { return fns.empty(); }
+    std::size_t size() const { return fns.size(); }
+
+    void list(std::ostream &out) const {
+        for (const auto &kv : fns) {
+            out << kv.first << "(";
+            for (std::size_t k = 0; k < kv.second.params.size(); ++k) out << (k ? ", " : "") << kv.second.params[k];
+            out << ") = " << kv.second.text << "   (токенов: " << kv.second.rpn.size() << ")\n";
+        }
+    }
+};
+
+// Разбор с функциями пользователя, если они есть у вызывающего.
+inline ParseResult parseWithFunctions(const FunctionLibrary *functions, std::string_view expr) {
+    return functions ? functions->parse(expr) : InfixParser::toRpn(expr);
+}
+
+#endif